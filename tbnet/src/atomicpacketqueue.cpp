@@ -0,0 +1,80 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+/*
+ * constructor
+ */
+AtomicPacketQueue::AtomicPacketQueue() {
+    _head = NULL;
+    atomic_set(&_size, 0);
+}
+
+/*
+ * destructor
+ */
+AtomicPacketQueue::~AtomicPacketQueue() {
+    Packet *packet = __sync_lock_test_and_set(&_head, (Packet*)NULL);
+    while (packet != NULL) {
+        Packet *next = packet->_next;
+        packet->free();
+        packet = next;
+    }
+}
+
+/*
+ * push onto the stack
+ */
+bool AtomicPacketQueue::push(Packet *packet) {
+    atomic_inc(&_size);
+    Packet *head;
+    do {
+        head = _head;
+        packet->_next = head;
+    } while (!__sync_bool_compare_and_swap(&_head, head, packet));
+    return (head == NULL);
+}
+
+/*
+ * take the stack and append it in arrival order
+ */
+int AtomicPacketQueue::moveTo(PacketQueue *destQueue) {
+    if (_head == NULL) {
+        return 0;
+    }
+    Packet *packet = __sync_lock_test_and_set(&_head, (Packet*)NULL);
+
+    Packet *list = NULL;
+    int count = 0;
+    while (packet != NULL) {
+        Packet *next = packet->_next;
+        packet->_next = list;
+        list = packet;
+        packet = next;
+        count ++;
+    }
+    while (list != NULL) {
+        Packet *next = list->_next;
+        destQueue->push(list);
+        list = next;
+    }
+    atomic_sub(count, &_size);
+    return count;
+}
+
+}
@@ -0,0 +1,70 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_ATOMIC_PACKET_QUEUE_H_
+#define TBNET_ATOMIC_PACKET_QUEUE_H_
+
+namespace tbnet {
+
+/*
+ * lock-free multi-producer single-consumer queue linked through
+ * Packet::_next. push is a CAS onto a stack, the consumer takes all of it
+ * with one exchange and reverses it into arrival order. there is no single
+ * pop, so the stack head cannot suffer from ABA.
+ */
+class AtomicPacketQueue {
+
+public:
+    AtomicPacketQueue();
+
+    /*
+     * frees the packets still queued
+     */
+    ~AtomicPacketQueue();
+
+    /*
+     * any thread
+     *
+     * @return true - the queue was empty
+     */
+    bool push(Packet *packet);
+
+    /*
+     * append everything pushed so far, oldest first, to destQueue. one
+     * consumer at a time.
+     *
+     * @return number of packets moved
+     */
+    int moveTo(PacketQueue *destQueue);
+
+    /*
+     * packets queued, may lag behind a concurrent push or moveTo
+     */
+    int size() {
+        return atomic_read(&_size);
+    }
+
+    bool empty() {
+        return (_head == NULL);
+    }
+
+private:
+    Packet * volatile _head;    // newest first
+    atomic_t _size;
+};
+
+}
+
+#endif /*TBNET_ATOMIC_PACKET_QUEUE_H_*/
@@ -0,0 +1,253 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+BufferPool * volatile BufferPool::_gBufferPool = NULL;
+pthread_once_t BufferPool::_gOnce = PTHREAD_ONCE_INIT;
+
+/*
+ * blocks of class cls a thread keeps, and the depot keeps
+ */
+static inline int cacheLimit(int cls) {
+    int limit = (TBNET_POOL_CACHE_BYTES >> (cls + TBNET_POOL_MIN_SHIFT));
+    return (limit > 2 ? limit : 2);
+}
+
+static inline int depotLimit(int cls) {
+    int limit = (TBNET_POOL_DEPOT_BYTES >> (cls + TBNET_POOL_MIN_SHIFT));
+    return (limit > 8 ? limit : 8);
+}
+
+/*
+ * constructor
+ */
+BufferPool::BufferPool() {
+    memset(_depot, 0, sizeof(_depot));
+    memset(_depotCount, 0, sizeof(_depotCount));
+    pthread_key_create(&_key, destroyThreadCache);
+}
+
+/*
+ * destructor, only for pools of their own; caches of threads still running
+ * are left to the process exit
+ */
+BufferPool::~BufferPool() {
+    ThreadCache *cache = (ThreadCache*)pthread_getspecific(_key);
+    if (cache != NULL) {
+        pthread_setspecific(_key, NULL);
+        flushCache(cache);
+        delete cache;
+    }
+    pthread_key_delete(_key);
+    for (int cls = 0; cls < TBNET_POOL_CLASSES; cls++) {
+        while (_depot[cls] != NULL) {
+            Block *block = _depot[cls];
+            _depot[cls] = block->_next;
+            ::free(block);
+        }
+        _depotCount[cls] = 0;
+    }
+}
+
+/*
+ * take a block, from the thread cache, the depot or malloc in that order
+ */
+void *BufferPool::allocate(int size, int *capacity) {
+    int cls = getClass(size, capacity);
+    if (cls < 0) {
+        return malloc(*capacity);
+    }
+
+    ThreadCache *cache = getThreadCache();
+    if (cache->_head[cls] == NULL) { // refill half a cache from the depot
+        int want = cacheLimit(cls) / 2;
+        _mutex[cls].lock();
+        while (_depot[cls] != NULL && cache->_count[cls] < want) {
+            Block *block = _depot[cls];
+            _depot[cls] = block->_next;
+            _depotCount[cls] --;
+            block->_next = cache->_head[cls];
+            cache->_head[cls] = block;
+            cache->_count[cls] ++;
+        }
+        _mutex[cls].unlock();
+        if (cache->_head[cls] == NULL) {
+            return malloc(*capacity);
+        }
+    }
+
+    Block *block = cache->_head[cls];
+    cache->_head[cls] = block->_next;
+    cache->_count[cls] --;
+    return block;
+}
+
+/*
+ * give a block back to the thread cache, half of a full cache moves on to
+ * the depot
+ */
+void BufferPool::deallocate(void *ptr, int capacity) {
+    if (ptr == NULL) {
+        return;
+    }
+    int realCapacity;
+    int cls = getClass(capacity, &realCapacity);
+    if (cls < 0 || realCapacity != capacity) {
+        ::free(ptr);
+        return;
+    }
+
+    ThreadCache *cache = getThreadCache();
+    Block *block = (Block*)ptr;
+    block->_next = cache->_head[cls];
+    cache->_head[cls] = block;
+    cache->_count[cls] ++;
+    if (cache->_count[cls] <= cacheLimit(cls)) {
+        return;
+    }
+
+    int move = cache->_count[cls] / 2;
+    Block *head = cache->_head[cls];
+    Block *tail = head;
+    for (int i = 1; i < move; i++) {
+        tail = tail->_next;
+    }
+    cache->_head[cls] = tail->_next;
+    cache->_count[cls] -= move;
+
+    _mutex[cls].lock();
+    int room = depotLimit(cls) - _depotCount[cls];
+    if (room >= move) {
+        tail->_next = _depot[cls];
+        _depot[cls] = head;
+        _depotCount[cls] += move;
+        head = NULL;
+    }
+    _mutex[cls].unlock();
+
+    while (head != NULL) { // the depot is full
+        block = head;
+        head = (block == tail ? NULL : block->_next);
+        ::free(block);
+    }
+}
+
+/*
+ * give the blocks of the calling thread back to the depot
+ */
+void BufferPool::flushThreadCache() {
+    ThreadCache *cache = (ThreadCache*)pthread_getspecific(_key);
+    if (cache != NULL) {
+        flushCache(cache);
+    }
+}
+
+/*
+ * bytes held in the depot
+ */
+int64_t BufferPool::getDepotBytes() {
+    int64_t bytes = 0;
+    for (int cls = 0; cls < TBNET_POOL_CLASSES; cls++) {
+        _mutex[cls].lock();
+        bytes += (static_cast<int64_t>(_depotCount[cls]) << (cls + TBNET_POOL_MIN_SHIFT));
+        _mutex[cls].unlock();
+    }
+    return bytes;
+}
+
+/*
+ * class of a block of size bytes, capacity is rounded up to a power of two
+ * either way
+ */
+int BufferPool::getClass(int size, int *capacity) {
+    int shift = TBNET_POOL_MIN_SHIFT;
+    while ((1 << shift) < size && shift < 30) {
+        shift ++;
+    }
+    *capacity = (1 << shift);
+    return (shift > TBNET_POOL_MAX_SHIFT ? -1 : shift - TBNET_POOL_MIN_SHIFT);
+}
+
+/*
+ * cache of the calling thread, created on first use
+ */
+BufferPool::ThreadCache *BufferPool::getThreadCache() {
+    ThreadCache *cache = (ThreadCache*)pthread_getspecific(_key);
+    if (cache == NULL) {
+        cache = new ThreadCache();
+        memset(cache, 0, sizeof(ThreadCache));
+        cache->_owner = this;
+        pthread_setspecific(_key, cache);
+    }
+    return cache;
+}
+
+/*
+ * move every block of cache to the depot, or free it when the depot is full
+ */
+void BufferPool::flushCache(ThreadCache *cache) {
+    for (int cls = 0; cls < TBNET_POOL_CLASSES; cls++) {
+        Block *head = cache->_head[cls];
+        cache->_head[cls] = NULL;
+        cache->_count[cls] = 0;
+
+        _mutex[cls].lock();
+        while (head != NULL && _depotCount[cls] < depotLimit(cls)) {
+            Block *block = head;
+            head = block->_next;
+            block->_next = _depot[cls];
+            _depot[cls] = block;
+            _depotCount[cls] ++;
+        }
+        _mutex[cls].unlock();
+
+        while (head != NULL) {
+            Block *block = head;
+            head = block->_next;
+            ::free(block);
+        }
+    }
+}
+
+/*
+ * slow path of getInstance
+ */
+BufferPool &BufferPool::createInstance() {
+    pthread_once(&_gOnce, initInstance);
+    return *_gBufferPool;
+}
+
+/*
+ * the pool is published only once it is built, it is leaked on purpose
+ */
+void BufferPool::initInstance() {
+    BufferPool *pool = new BufferPool();
+    __sync_synchronize();
+    _gBufferPool = pool;
+}
+
+/*
+ * thread exit
+ */
+void BufferPool::destroyThreadCache(void *ptr) {
+    ThreadCache *cache = (ThreadCache*)ptr;
+    cache->_owner->flushCache(cache);
+    delete cache;
+}
+
+}
@@ -0,0 +1,124 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_BUFFERPOOL_H_
+#define TBNET_BUFFERPOOL_H_
+
+namespace tbnet {
+
+#define TBNET_POOL_MIN_SHIFT    5           // smallest class, 32 bytes
+#define TBNET_POOL_MAX_SHIFT    18          // largest class, 256K, beyond it malloc
+#define TBNET_POOL_CLASSES      (TBNET_POOL_MAX_SHIFT - TBNET_POOL_MIN_SHIFT + 1)
+#define TBNET_POOL_CACHE_BYTES  131072      // per thread and class
+#define TBNET_POOL_DEPOT_BYTES  4194304     // per class, shared
+
+/*
+ * size-classed buffer pool behind DataBuffer and PooledPacket.
+ *
+ * blocks are power of two sized, a thread takes and gives them back through
+ * its own cache without locking. a cache running over hands half of its
+ * blocks of that class to the shared depot, a cache running dry refills
+ * from it; beyond the depot limit blocks are freed. a thread gives its
+ * cache back to the depot when it exits.
+ */
+class BufferPool {
+
+public:
+    BufferPool();
+    ~BufferPool();
+
+    /*
+     * take a block of at least size bytes
+     *
+     * @param size: bytes needed
+     * @param capacity: gets the real size of the block, pass it to
+     *                  deallocate
+     * @return the block
+     */
+    void *allocate(int size, int *capacity);
+
+    /*
+     * give a block from allocate back
+     *
+     * @param ptr: the block
+     * @param capacity: its size as returned by allocate
+     */
+    void deallocate(void *ptr, int capacity);
+
+    /*
+     * capacity allocate returns for size
+     */
+    static int getCapacity(int size) {
+        int capacity;
+        getClass(size, &capacity);
+        return capacity;
+    }
+
+    /*
+     * give the blocks cached by the calling thread back to the depot
+     */
+    void flushThreadCache();
+
+    /*
+     * bytes held in the depot
+     */
+    int64_t getDepotBytes();
+
+    /*
+     * the pool of the process, created on first use and never destroyed,
+     * so buffers freed by other statics at exit still find it alive
+     */
+    static BufferPool &getInstance() {
+        BufferPool *pool = _gBufferPool;
+        return (pool != NULL ? *pool : createInstance());
+    }
+
+private:
+    struct Block {
+        Block *_next;
+    };
+
+    struct ThreadCache {
+        BufferPool *_owner;
+        Block *_head[TBNET_POOL_CLASSES];
+        int _count[TBNET_POOL_CLASSES];
+    };
+
+    /*
+     * class of a block of size bytes, -1 - larger than the largest class
+     */
+    static int getClass(int size, int *capacity);
+
+    ThreadCache *getThreadCache();
+    void flushCache(ThreadCache *cache);
+    static void destroyThreadCache(void *cache);
+    static BufferPool &createInstance();
+    static void initInstance();
+
+private:
+    Block *_depot[TBNET_POOL_CLASSES];
+    int _depotCount[TBNET_POOL_CLASSES];
+    tbsys::CThreadMutex _mutex[TBNET_POOL_CLASSES];
+    pthread_key_t _key;
+
+    static BufferPool * volatile _gBufferPool;
+    static pthread_once_t _gOnce;
+};
+
+#define TBNET_BUFFER_POOL tbnet::BufferPool::getInstance()
+
+}
+
+#endif /*TBNET_BUFFERPOOL_H_*/
@@ -21,9 +21,14 @@ namespace tbnet {
  * 캯
  */
 Channel::Channel() {
-    _prev = NULL;
+    _id = 0;
+    _args = NULL;
+    _handler = NULL;
     _next = NULL;
     _expireTime = 0;
+    _state = 0;
+    _pending = 0;
+    _pendingNext = NULL;
 }
 
 /*
@@ -84,9 +84,13 @@ private:
     IPacketHandler *_handler;
     int64_t _expireTime; // ʱ
 
+    volatile uint32_t _state;   // id plus ChannelPool state bits
+    TimerEntry _timerEntry;     // deadline on the ChannelPool wheel
+    volatile int _pending;      // on the ChannelPool pending list
+    Channel *_pendingNext;
+
 private:
-    Channel *_prev;     // 
-    Channel *_next;
+    Channel *_next;     // 
 };
 }
 
@@ -17,28 +17,31 @@
 
 namespace tbnet {
 
-atomic_t ChannelPool::_globalChannelId = {1};
+// slot states, kept in the bits above the 28 bit id
+#define CHANNEL_STATE_FREE      0x80000000U     // id: that of the last use
+#define CHANNEL_STATE_CLAIMED   0x40000000U     // taken out of use, not free yet
+#define CHANNEL_ID_MASK         0x0FFFFFFFU
+
 atomic_t ChannelPool::_globalTotalCount = {0};
 
 /*
  * 캯
  */
-ChannelPool::ChannelPool() {
-    _freeListHead = NULL;
-    _freeListTail = NULL;
-    _useListHead = NULL;
-    _useListTail = NULL;
-    _maxUseCount = 0;
+ChannelPool::ChannelPool() : _deadlines(CHANNEL_DEADLINE_TICK) {
+    memset(_segments, 0, sizeof(_segments));
+    _timeoutList = NULL;
+    _pendingHead = NULL;
+    _capacity = 0;
+    atomic_set(&_cursor, 0);
+    atomic_set(&_useCount, 0);
 }
 
 /*
  * 
  */
 ChannelPool::~ChannelPool() {
-    std::list<Channel*>::iterator it = _clusterList.begin();
-
-    for (;it != _clusterList.end(); it++) {
-        delete[] *it;
+    for (int i = 0; i < _capacity / CHANNEL_CLUSTER_SIZE; i++) {
+        delete[] _segments[i];
     }
 }
 
@@ -48,65 +51,48 @@ ChannelPool::~ChannelPool() {
  * @return һChannel
  */
 Channel *ChannelPool::allocChannel() {
-    Channel *channel = NULL;
-
-    _mutex.lock();
-    if (_freeListHead == NULL) { // ǿգ·һЩŵfreeList
-        assert(CHANNEL_CLUSTER_SIZE>2);
-        Channel *channelCluster = new Channel[CHANNEL_CLUSTER_SIZE];
-        TBSYS_LOG(DEBUG, "Channel:%d (%d)", atomic_add_return(CHANNEL_CLUSTER_SIZE, &_globalTotalCount), sizeof(Channel));
-        _clusterList.push_back(channelCluster);
-        _freeListHead = _freeListTail = &channelCluster[1];
-        for (int i = 2; i < CHANNEL_CLUSTER_SIZE; i++) {
-            _freeListTail->_next = &channelCluster[i];
-            channelCluster[i]._prev = _freeListTail;
-            _freeListTail = _freeListTail->_next;
+    while (true) {
+        int capacity = _capacity;
+        if (atomic_read(&_useCount) * 2 >= capacity && capacity < CHANNEL_MAX_SLOTS) {
+            grow(capacity); // keep half of the slots free, a probe finds one at once
+            continue;
         }
-        _freeListHead->_prev = NULL;
-        _freeListTail->_next = NULL;
-        channel = &channelCluster[0];   // ѵһԪùֱ, ŵfreelist
-    } else {
-        // ͷȡ
-        channel = _freeListHead;
-        _freeListHead = _freeListHead->_next;
-        if (_freeListHead != NULL) {
-            _freeListHead->_prev = NULL;
-        } else {
-            _freeListTail = NULL;
-        }
-    }
 
-    // channelŵ_useList
-    channel->_prev = _useListTail;
-    channel->_next = NULL;
-    channel->_expireTime = TBNET_MAX_TIME+1;
-    if (_useListTail == NULL) {
-        _useListHead = channel;
-    } else {
-        _useListTail->_next = channel;
-    }
-    _useListTail = channel;
+        for (int i = 0; i < capacity; i++) {
+            uint32_t slot = static_cast<uint32_t>(atomic_add_return(1, &_cursor)) % capacity;
+            Channel *channel = getSlot(slot);
+            uint32_t state = channel->_state;
+            if ((state & CHANNEL_STATE_FREE) == 0) {
+                continue;
+            }
+            uint32_t generation = ((state & CHANNEL_ID_MASK) >> CHANNEL_SLOT_BITS) + 1;
+            if (generation > CHANNEL_MAX_GENERATION) {
+                generation = 1; // never 0, the id of slot 0 would be 0
+            }
+            uint32_t id = ((generation << CHANNEL_SLOT_BITS) | slot);
+            if (!__sync_bool_compare_and_swap(&channel->_state, state, CHANNEL_STATE_CLAIMED | id)) {
+                continue;
+            }
 
-    // generate channel id
-    uint32_t id = atomic_add_return(1, &ChannelPool::_globalChannelId);
-    id = (id & 0x0FFFFFFF);
-    if (id == 0)
-    {
-      id = 1;
-      atomic_set(&ChannelPool::_globalChannelId, 1);
-    }
-    channel->_id = id;
-    channel->_handler = NULL;
-    channel->_args = NULL;
+            // set up while claimed, offerChannel and getTimeoutList only
+            // touch channels in use
+            channel->_id = id;
+            channel->_handler = NULL;
+            channel->_args = NULL;
+            channel->_next = NULL;
+            channel->_expireTime = TBNET_MAX_TIME + 1;
+            atomic_inc(&_useCount);
+            __sync_synchronize();
+            channel->_state = id;
+            return channel;
+        }
 
-    // channelŵhashmap
-    _useMap[id] = channel;
-    if (_maxUseCount < (int)_useMap.size()) {
-        _maxUseCount = _useMap.size();
+        if (capacity >= CHANNEL_MAX_SLOTS) {
+            TBSYS_LOG(WARN, "all %d channels are in use", capacity);
+            return NULL;
+        }
+        grow(capacity);
     }
-    _mutex.unlock();
-
-    return channel;
 }
 
 /*
@@ -116,65 +102,20 @@ Channel *ChannelPool::allocChannel() {
  * @return
  */
 bool ChannelPool::freeChannel(Channel *channel) {
-    __gnu_cxx::hash_map<uint32_t, Channel*>::iterator it;
-
-    _mutex.lock();
-    it = _useMap.find(channel->_id);
-    if (it == _useMap.end()) {
-        _mutex.unlock();
+    uint32_t id = channel->_id;
+    if (!__sync_bool_compare_and_swap(&channel->_state, id, CHANNEL_STATE_CLAIMED | id)) {
         return false;
     }
-
-    // ɾ
-    _useMap.erase(it);
-
-    // _userListɾ
-    if (channel == _useListHead) { // head
-        _useListHead = channel->_next;
-    }
-    if (channel == _useListTail) { // tail
-        _useListTail = channel->_prev;
-    }
-    if (channel->_prev != NULL)
-        channel->_prev->_next = channel->_next;
-    if (channel->_next != NULL)
-        channel->_next->_prev = channel->_prev;
-
-    // 뵽_freeList
-    channel->_prev = _freeListTail;
-    channel->_next = NULL;
-    if (_freeListTail == NULL) {
-        _freeListHead = channel;
-    } else {
-        _freeListTail->_next = channel;
-    }
-    _freeListTail = channel;
-    channel->_id = 0;
-    channel->_handler = NULL;
-    channel->_args = NULL;
-
-    _mutex.unlock();
-
+    atomic_dec(&_useCount);
+    release(channel);
     return true;
 }
 
+/*
+ * give back a channel taken by offerChannel
+ */
 bool ChannelPool::appendChannel(Channel *channel) {
-    _mutex.lock();
-
-    // 뵽_freeList
-    channel->_prev = _freeListTail;
-    channel->_next = NULL;
-    if (_freeListTail == NULL) {
-        _freeListHead = channel;
-    } else {
-        _freeListTail->_next = channel;
-    }
-    _freeListTail = channel;
-    channel->_id = 0;
-    channel->_handler = NULL;
-    channel->_args = NULL;
-    _mutex.unlock();
-
+    release(channel);
     return true;
 }
 
@@ -185,72 +126,117 @@ bool ChannelPool::appendChannel(Channel *channel) {
  * @reutrn Channel
  */
 Channel *ChannelPool::offerChannel(uint32_t id) {
-    Channel *channel = NULL;
-
-    __gnu_cxx::hash_map<uint32_t, Channel*>::iterator it;
-    _mutex.lock();
-    it = _useMap.find(id);
-    if (it != _useMap.end()) {
-        channel = it->second;
-        _useMap.erase(it);
-
-        // _userListɾ
-        if (channel == _useListHead) { // head
-            _useListHead = channel->_next;
-        }
-        if (channel == _useListTail) { // tail
-            _useListTail = channel->_prev;
-        }
-        if (channel->_prev != NULL)
-            channel->_prev->_next = channel->_next;
-        if (channel->_next != NULL)
-            channel->_next->_prev = channel->_prev;
-        channel->_prev = NULL;
-        channel->_next = NULL;
+    uint32_t slot = (id & (CHANNEL_MAX_SLOTS - 1));
+    if (id == 0 || static_cast<int>(slot) >= _capacity) {
+        return NULL;
     }
-    _mutex.unlock();
-
+    Channel *channel = getSlot(slot);
+    if (!__sync_bool_compare_and_swap(&channel->_state, id, CHANNEL_STATE_CLAIMED | id)) {
+        return NULL;
+    }
+    atomic_dec(&_useCount);
+    channel->_next = NULL;
     return channel;
 }
 
 /*
- * useListҳʱchannellist,hashmapжӦɾ
+ * take the channels in use that were due before now out of use
  *
  * @param now: ǰʱ
  */
 Channel* ChannelPool::getTimeoutList(int64_t now) {
     Channel *list = NULL;
+    if (now < TBNET_MAX_TIME) {
+        // the wheel hands the due channels to handleTimer
+        tbsys::CThreadGuard guard(&_timeoutMutex);
+        drainPending();
+        _timeoutList = NULL;
+        _deadlines.expire(now);
+        list = _timeoutList;
+        _timeoutList = NULL;
+        return list;
+    }
 
-    _mutex.lock();
-    if (_useListHead == NULL) { //ǿ
-        _mutex.unlock();
+    // everything goes, walking the wheel up to TBNET_MAX_TIME would not end
+    if (atomic_read(&_useCount) == 0) {
         return list;
     }
+    int capacity = _capacity;
+    for (int i = 0; i < capacity; i++) {
+        Channel *channel = getSlot(i);
+        uint32_t state = channel->_state;
+        if ((state & (CHANNEL_STATE_FREE | CHANNEL_STATE_CLAIMED)) != 0 || channel->_expireTime >= now) {
+            continue;
+        }
+        if (!__sync_bool_compare_and_swap(&channel->_state, state, CHANNEL_STATE_CLAIMED | state)) {
+            continue;   // answered in the meantime
+        }
+        atomic_dec(&_useCount);
+        channel->_next = list;
+        list = channel;
+    }
 
-    Channel *channel = _useListHead;
-    while (channel != NULL) {
-        if (channel->_expireTime >= now) break;
-        _useMap.erase(channel->_id);
-        channel = channel->_next;
+    return list;
+}
+
+/*
+ * deadline of a channel in use, handed to the checking thread without
+ * locking. a channel still on the pending list is not pushed again, the
+ * drain reads the deadline written here.
+ */
+void ChannelPool::setExpireTime(Channel *channel, int64_t expireTime) {
+    if (channel == NULL) {
+        return;
     }
+    channel->_expireTime = expireTime;
+    __sync_synchronize();
+    if (!__sync_bool_compare_and_swap(&channel->_pending, 0, 1)) {
+        return;
+    }
+    Channel *head;
+    do {
+        head = _pendingHead;
+        channel->_pendingNext = head;
+    } while (!__sync_bool_compare_and_swap(&_pendingHead, head, channel));
+}
 
-    // гʱlist
-    if (channel != _useListHead) {
-        list = _useListHead;
-        if (channel == NULL) {  // ȫʱ
-            _useListHead = _useListTail = NULL;
+/*
+ * (re)schedule the channels of the pending list, with _timeoutMutex held.
+ * the list is taken whole, so a channel pushed again meanwhile is simply
+ * on the next one.
+ */
+void ChannelPool::drainPending() {
+    Channel *channel = __sync_lock_test_and_set(&_pendingHead, static_cast<Channel*>(NULL));
+    while (channel != NULL) {
+        Channel *next = channel->_pendingNext;
+        channel->_pendingNext = NULL;
+        channel->_pending = 0;
+        __sync_synchronize();   // the deadline read below is the latest one set
+        if ((channel->_state & (CHANNEL_STATE_FREE | CHANNEL_STATE_CLAIMED)) != 0) {
+            _deadlines.cancel(&channel->_timerEntry);   // done already
         } else {
-            if (channel->_prev != NULL) {
-                channel->_prev->_next = NULL;
-            }
-            channel->_prev = NULL;
-            _useListHead = channel;
+            _deadlines.schedule(&channel->_timerEntry, channel->_expireTime);
         }
+        channel = next;
     }
+}
 
-    _mutex.unlock();
-
-    return list;
+/*
+ * a channel deadline is due, called by getTimeoutList through the wheel
+ */
+void ChannelPool::handleTimer(TimerEntry *entry, int64_t now) {
+    Channel *channel = static_cast<Channel*>(entry->getArgs());
+    uint32_t state = channel->_state;
+    __sync_synchronize();   // the deadline read below is that of this use or a later one
+    if ((state & (CHANNEL_STATE_FREE | CHANNEL_STATE_CLAIMED)) != 0 || channel->_expireTime > now) {
+        return;     // answered, or used again and not due yet
+    }
+    if (!__sync_bool_compare_and_swap(&channel->_state, state, CHANNEL_STATE_CLAIMED | state)) {
+        return;     // answered in the meantime
+    }
+    atomic_dec(&_useCount);
+    channel->_next = _timeoutList;
+    _timeoutList = channel;
 }
 
 /*
@@ -259,47 +245,45 @@ Channel* ChannelPool::getTimeoutList(int64_t now) {
  * @param addListӵlist
  */
 bool ChannelPool::appendFreeList(Channel *addList) {
-    // ǿ
-    if (addList == NULL) {
-        return true;
+    while (addList != NULL) {
+        Channel *next = addList->_next;
+        release(addList);
+        addList = next;
     }
+    return true;
+}
 
-    _mutex.lock();
-
-    // tail
-    Channel *tail = addList;
-    while (tail->_next != NULL) {
-        tail->_id = 0;
-        tail->_handler = NULL;
-        tail->_args = NULL;
-        tail = tail->_next;
+/*
+ * add a segment of slots
+ */
+bool ChannelPool::grow(int capacity) {
+    tbsys::CThreadGuard guard(&_mutex);
+    if (_capacity != capacity || capacity >= CHANNEL_MAX_SLOTS) {
+        return false;
     }
-    tail->_id = 0;
-    tail->_handler = NULL;
-    tail->_args = NULL;
-
-    // 뵽_freeList
-    addList->_prev = _freeListTail;
-    if (_freeListTail == NULL) {
-        _freeListHead = addList;
-    } else {
-        _freeListTail->_next = addList;
+    Channel *segment = new Channel[CHANNEL_CLUSTER_SIZE];
+    for (int i = 0; i < CHANNEL_CLUSTER_SIZE; i++) {
+        segment[i]._state = (CHANNEL_STATE_FREE | (capacity + i));
+        segment[i]._timerEntry.setHandler(this, &segment[i]);
     }
-    _freeListTail = tail;
-
-    _mutex.unlock();
+    TBSYS_LOG(DEBUG, "total channels: %d (%d)", atomic_add_return(CHANNEL_CLUSTER_SIZE, &_globalTotalCount),
+              static_cast<int>(sizeof(Channel)));
+    _segments[capacity / CHANNEL_CLUSTER_SIZE] = segment;
+    __sync_synchronize();
+    _capacity = capacity + CHANNEL_CLUSTER_SIZE;
     return true;
 }
 
-void ChannelPool::setExpireTime(Channel *channel, int64_t now)
-{
-    _mutex.lock();
-    if (channel != NULL) {
-        channel->_expireTime = now;
-    } 
-    _mutex.unlock();
+/*
+ * the channel is no longer used, its deadline entry is left to fire idle
+ */
+void ChannelPool::release(Channel *channel) {
+    channel->_handler = NULL;
+    channel->_args = NULL;
+    channel->_next = NULL;
+    __sync_synchronize();
+    channel->_state = (CHANNEL_STATE_FREE | (channel->_state & CHANNEL_ID_MASK));
 }
 
 }
 
-
@@ -16,10 +16,32 @@
 #ifndef TBNET_CHANNEL_POOL_H_
 #define TBNET_CHANNEL_POOL_H_
 
-#define CHANNEL_CLUSTER_SIZE 25
+#define CHANNEL_CLUSTER_SIZE 256                    // channels per segment
+#define CHANNEL_SLOT_BITS 16                        // chid: generation(12) | slot(16)
+#define CHANNEL_MAX_SLOTS (1 << CHANNEL_SLOT_BITS)  // channels in use per connection
+#define CHANNEL_MAX_GENERATION 0xFFF
+#define CHANNEL_DEADLINE_TICK 1000                  // us, resolution of the channel deadlines
 namespace tbnet {
 
-class ChannelPool {
+/*
+ * channels of one connection, lock-free.
+ *
+ * a channel id is its slot in the pool plus the generation of the slot,
+ * bumped on every use, so offerChannel is an array lookup and a CAS on the
+ * slot state, and a late reply to a timed out request does not match the
+ * next user of the slot. slots are handed out round-robin, a slot comes
+ * back only after all others have been used once, so a generation repeats
+ * after (slots x 4095) allocations. the slot array grows by
+ * CHANNEL_CLUSTER_SIZE under a mutex and never shrinks.
+ *
+ * the deadline of every channel in use sits on a wheel of the pool, so a
+ * check finds the channels that are due without a scan and the connection
+ * knows when the next one is due to the millisecond. the wheel belongs to
+ * the thread checking the timeouts: posters hand new deadlines over on a
+ * lock-free list it drains first, and a channel done early is not taken
+ * off, its entry just finds it done (or used again) when it fires.
+ */
+class ChannelPool : public ITimerHandler {
 
 public:
     /*
@@ -57,7 +79,8 @@ public:
     Channel* offerChannel(uint32_t id);
 
     /*
-     * useListҳʱchannellist,hashmapжӦɾ
+     * take the channels in use that were due before now out of use, linked
+     * by _next. TBNET_MAX_TIME takes every channel with a deadline.
      *
      * @param now: ǰʱ
      */
@@ -70,27 +93,74 @@ public:
      */
     bool appendFreeList(Channel *addList);
 
+    /*
+     * id is the channel of a request still waiting for its reply
+     */
+    bool isUsed(uint32_t id) {
+        uint32_t slot = (id & (CHANNEL_MAX_SLOTS - 1));
+        return (id != 0 && static_cast<int>(slot) < _capacity && getSlot(slot)->_state == id);
+    }
+
     /*
      * ĳ
      */
     int getUseListCount() {
-        return static_cast<int32_t>(_useMap.size());
+        return atomic_read(&_useCount);
+    }
+
+    /*
+     * deadline of a channel in use, set once its packet is posted
+     *
+     * @param channel: the channel
+     * @param expireTime: absolute time (us)
+     */
+    void setExpireTime(Channel *channel, int64_t expireTime);
+
+    /*
+     * earliest deadline of the channels in use
+     *
+     * @return absolute time (us), TBNET_MAX_TIME - none
+     */
+    int64_t getNextExpireTime() {
+        return _deadlines.getNextExpireTime();
     }
 
-    void setExpireTime(Channel *channel, int64_t now); 
+    /*
+     * ITimerHandler, a channel deadline is due
+     */
+    void handleTimer(TimerEntry *entry, int64_t now);
 
 private:
-    __gnu_cxx::hash_map<uint32_t, Channel*> _useMap; // ʹõmap
-    std::list<Channel*> _clusterList;                // cluster list
-    tbsys::CThreadMutex _mutex;
+    Channel *getSlot(uint32_t slot) {
+        return &_segments[slot / CHANNEL_CLUSTER_SIZE][slot % CHANNEL_CLUSTER_SIZE];
+    }
+
+    /*
+     * put the deadlines handed over by setExpireTime on the wheel
+     */
+    void drainPending();
 
-    Channel *_freeListHead;             // յ
-    Channel *_freeListTail;
-    Channel *_useListHead;              // ʹõ
-    Channel *_useListTail;
-    int _maxUseCount;                   // ĳ
+    /*
+     * add a segment unless someone else did since capacity was read
+     */
+    bool grow(int capacity);
+
+    /*
+     * the channel is no longer used, hand the slot out again
+     */
+    void release(Channel *channel);
+
+private:
+    Channel *_segments[CHANNEL_MAX_SLOTS / CHANNEL_CLUSTER_SIZE];
+    volatile int _capacity;             // slots in the segments
+    atomic_t _cursor;                   // next slot to try
+    atomic_t _useCount;                 // channels in use
+    tbsys::CThreadMutex _mutex;         // grow
+    TimingWheel _deadlines;             // deadlines of the channels in use, getTimeoutList only
+    Channel * volatile _pendingHead;    // deadlines set since the last check, newest first
+    tbsys::CThreadMutex _timeoutMutex;  // getTimeoutList
+    Channel *_timeoutList;              // built by handleTimer
 
-    static atomic_t _globalChannelId;   // ͳһid
     static atomic_t _globalTotalCount;
 };
 
@@ -28,7 +28,10 @@ Connection::Connection(Socket *socket, IPacketStreamer *streamer, IServerAdapter
     _iocomponent = NULL;
     _queueTimeout = 5000;
     _queueLimit = 50;
-    _queueTotalSize = 0;
+    atomic_set(&_queueWaiters, 0);
+    atomic_set(&_queueBytes, 0);
+    _queueByteLimit = 0;
+    _queueExpireTime = TBNET_MAX_TIME;
 }
 
 /*
@@ -44,20 +47,53 @@ Connection::~Connection() {
  * ӶϿзͶеpacketȫʱ
  */
 void Connection::disconnect() {
+    std::vector<IPacketHandler*> closed;
     _outputCond.lock();
+    _postQueue.moveTo(&_outputQueue);
     _myQueue.moveTo(&_outputQueue);
+    closed.assign(_writableWaiters.begin(), _writableWaiters.end());
+    _writableWaiters.clear();
+    atomic_sub(static_cast<int>(closed.size()), &_queueWaiters);
     _outputCond.unlock();
     checkTimeout(TBNET_MAX_TIME);
+    completeWritable(closed, &ControlPacket::DisconnPacket);
 }
 
 /*
  * packetͶ
  */
 bool Connection::postPacket(Packet *packet, IPacketHandler *packetHandler, void *args, bool noblocking) {
+    return postPacket(packet, packetHandler, args, noblocking, _queueTimeout);
+}
+
+/*
+ * post packet and get a future of its reply
+ */
+PacketFuture Connection::call(Packet *packet, int timeout) {
+    PacketFuture future = PacketFuture::create();
+    if (_isServer || !_streamer->existPacketHeader()) { // no channel to match the reply
+        packet->free();
+        future.retainHandler();
+        future.failHandler(&ControlPacket::BadPacket);
+        return future;
+    }
+    IPacketHandler *handler = future.retainHandler();
+    if (!postPacket(packet, handler, NULL, true, (timeout > 0 ? timeout : _queueTimeout))) {
+        packet->free();
+        future.failHandler(&ControlPacket::DisconnPacket);
+    }
+    return future;
+}
+
+/*
+ * post packet, it times out after timeout ms
+ */
+bool Connection::postPacket(Packet *packet, IPacketHandler *packetHandler, void *args, bool noblocking, int timeout,
+                            uint32_t *channelId) {
     if (!isConnectState()) {
         if (_iocomponent == NULL ||  _iocomponent->isAutoReconn() == false) {
             return false;
-        } else if (_outputQueue.size()>10) {
+        } else if (_postQueue.size() + _outputQueue.size() > 10) {
             return false;
         } else {
             TCPComponent *ioc = dynamic_cast<TCPComponent*>(_iocomponent);
@@ -71,15 +107,11 @@ bool Connection::postPacket(Packet *packet, IPacketHandler *packetHandler, void
         }
     }
     // client, queueȵ
-    _outputCond.lock();
-    _queueTotalSize = _outputQueue.size() + _channelPool.getUseListCount() + _myQueue.size();
-    if (!_isServer && _queueLimit > 0 && noblocking && _queueTotalSize >= _queueLimit) {
-        _outputCond.unlock();
+    if (!_isServer && noblocking && !hasCredit()) {
         return false;
     }
-    _outputCond.unlock();
     Channel *channel = NULL;
-    packet->setExpireTime(_queueTimeout);           // óʱ
+    packet->setExpireTime(timeout);           // óʱ
     if (_streamer->existPacketHeader()) {           // ڰͷ
         uint32_t chid = packet->getChannelId();     // packetȡ
         if (_isServer) {
@@ -96,33 +128,46 @@ bool Connection::postPacket(Packet *packet, IPacketHandler *packetHandler, void
             channel->setHandler(packetHandler);
             channel->setArgs(args);
             packet->setChannel(channel);            // ûȥ
+            if (channelId != NULL) {
+                *channelId = channel->getId();
+            }
+            _channelPool.setExpireTime(channel, packet->getExpireTime());
         }
     }
-    _outputCond.lock();
+    int64_t expireTime = packet->getExpireTime();
+    atomic_add(packet->getQueueSize(), &_queueBytes);  // before it can be written and freed
     // д뵽outputqueue
-    _outputQueue.push(packet);
-    if (_iocomponent != NULL && _outputQueue.size() == 1U) {
-        _iocomponent->enableWrite(true);
-    }
-    _outputCond.unlock();
-    if (!_isServer && _queueLimit > 0) {
+    if (_postQueue.push(packet) && _iocomponent != NULL) { // the queue became non-empty
         _outputCond.lock();
-        _queueTotalSize = _outputQueue.size() + _channelPool.getUseListCount() + _myQueue.size();
-        if ( _queueTotalSize > _queueLimit && noblocking == false) {
-            bool *stop = NULL;
-            if (_iocomponent && _iocomponent->getOwner()) {
-                stop = _iocomponent->getOwner()->getStop();
-            }
-            while (_queueTotalSize > _queueLimit && stop && *stop == false) {
-                if (_outputCond.wait(1000) == false) {
-                    if (!isConnectState()) {
-                        break;
-                    }
-                    _queueTotalSize = _outputQueue.size() + _channelPool.getUseListCount() + _myQueue.size();
+        bool direct = armOutput();
+        _outputCond.unlock();
+        if (direct) {
+            writeDirect();
+        }
+    }
+    lowerQueueExpireTime(expireTime);
+    if (_iocomponent != NULL) {
+        _iocomponent->getOwner()->scheduleTimeout(_iocomponent, expireTime);
+    }
+    if (!_isServer && noblocking == false && !hasCredit()) {
+        bool *stop = NULL;
+        if (_iocomponent && _iocomponent->getOwner()) {
+            stop = _iocomponent->getOwner()->getStop();
+        }
+        // woken for a credit of our own, not together with every other poster
+        PacketFuture writable = whenWritable();
+        while (stop && *stop == false) {
+            if (writable.wait(1000) == false) { // a wakeup may have gone to another poster
+                if (!isConnectState() || hasCredit()) {
+                    break;
                 }
+                continue;
+            }
+            if (writable.getPacket() != NULL || hasCredit()) { // closed, or credit left
+                break;
             }
+            writable = whenWritable();
         }
-        _outputCond.unlock();
     }
 
     if (_isServer && _iocomponent) {
@@ -132,6 +177,14 @@ bool Connection::postPacket(Packet *packet, IPacketHandler *packetHandler, void
     return true;
 }
 
+/*
+ * the output queue became non-empty, arm the write event
+ */
+bool Connection::armOutput() {
+    _iocomponent->enableWrite(true);
+    return false;
+}
+
 /*
  * handlePacket 
  */
@@ -192,6 +245,10 @@ bool Connection::handlePacket(DataBuffer *input, PacketHeader *header) {
         if (channel) {
             _channelPool.appendChannel(channel);
         }
+        // a reply frees a channel, a credit for a writable waiter
+        if (atomic_read(&_queueWaiters) > 0) {
+            wakeWritable();
+        }
     }
 
     return true;
@@ -226,14 +283,30 @@ bool Connection::checkTimeout(int64_t now) {
         _channelPool.appendFreeList(list);
     }
 
-    // PacketQueueʱ
-    _outputCond.lock();
-    Packet *packetList = _outputQueue.getTimeoutList(now);
-    _outputCond.unlock();
+    // PacketQueueʱ, only once a queued packet can be due. the bound
+    // is reset before the posted packets are taken, a post after that
+    // lowers it again
+    Packet *packetList = NULL;
+    if (_queueExpireTime < now || now >= TBNET_MAX_TIME) {
+        int64_t next = TBNET_MAX_TIME;
+        _outputCond.lock();
+        _queueExpireTime = TBNET_MAX_TIME;
+        __sync_synchronize();
+        _postQueue.moveTo(&_outputQueue);
+        packetList = _outputQueue.getExpiredList(now, &next);
+        _outputCond.unlock();
+        lowerQueueExpireTime(next);
+    }
     while (packetList) {
         Packet *packet = packetList;
         packetList = packetList->getNext();
-        channel = packet->getChannel();
+        // the channel may have timed out already and be used again, it
+        // still belongs to the packet only if the id matches
+        channel = NULL;
+        if (packet->getChannel() != NULL) {
+            channel = _channelPool.offerChannel(packet->getChannelId());
+        }
+        atomic_sub(packet->getQueueSize(), &_queueBytes);
         packet->free();
         if (channel) {
             packetHandler = channel->getHandler();
@@ -245,23 +318,128 @@ bool Connection::checkTimeout(int64_t now) {
                 packetHandler->handlePacket(&ControlPacket::TimeoutPacket, channel->getArgs());
                 channel->setArgs(NULL);
             }
-            _channelPool.freeChannel(channel);
+            _channelPool.appendChannel(channel);
         }
     }
 
-    // client, queueȵ
-    if (!_isServer && _queueLimit > 0 &&  _queueTotalSize > _queueLimit) {
-        _outputCond.lock();
-        _queueTotalSize = _outputQueue.size() + _channelPool.getUseListCount() + _myQueue.size();
-        if (_queueTotalSize <= _queueLimit) {
-            _outputCond.broadcast();
-        }
-        _outputCond.unlock();
+    if (atomic_read(&_queueWaiters) > 0) {
+        wakeWritable();
     }
 
     return true;
 }
 
+/*
+ * post a request with its own timeout
+ */
+bool Connection::postRequest(Packet *packet, IPacketHandler *packetHandler, void *args, int timeout,
+                             uint32_t *channelId) {
+    return postPacket(packet, packetHandler, args, true, timeout, channelId);
+}
+
+/*
+ * complete a request before its reply, the channel is claimed like the
+ * reply or the timeout would, so only one of them gets it
+ */
+bool Connection::cancel(uint32_t channelId) {
+    Channel *channel = _channelPool.offerChannel(channelId);
+    if (channel == NULL) {
+        return false;
+    }
+    IPacketHandler *packetHandler = channel->getHandler();
+    if (packetHandler == NULL) {
+        packetHandler = _defaultPacketHandler;
+    }
+    if (packetHandler != NULL) {
+        packetHandler->handlePacket(&ControlPacket::TimeoutPacket, channel->getArgs());
+        channel->setArgs(NULL);
+    }
+    _channelPool.appendChannel(channel);
+    if (atomic_read(&_queueWaiters) > 0) {
+        wakeWritable();
+    }
+    return true;
+}
+
+/*
+ * a future ready once the connection has credit again
+ */
+PacketFuture Connection::whenWritable() {
+    PacketFuture future = PacketFuture::create();
+    IPacketHandler *handler = future.retainHandler();
+    _outputCond.lock();
+    atomic_inc(&_queueWaiters);     // counted before the credits are read, a waker sees it
+    if (hasCredit()) {
+        atomic_dec(&_queueWaiters);
+        _outputCond.unlock();
+        handler->handlePacket(NULL, NULL);
+        return future;
+    }
+    _writableWaiters.push_back(handler);
+    _outputCond.unlock();
+    return future;
+}
+
+/*
+ * take as many writable waiters as there are credits, each as soon as
+ * its credit is back
+ */
+void Connection::takeWritable(std::vector<IPacketHandler*> *ready) {
+    int credits = getCredits();
+    if (getByteCredits() <= 0) {
+        credits = 0;
+    }
+    while (credits > 0 && !_writableWaiters.empty()) {
+        ready->push_back(_writableWaiters.front());
+        _writableWaiters.pop_front();
+        atomic_dec(&_queueWaiters);
+        credits --;
+    }
+}
+
+/*
+ * complete the writable waiters taken
+ */
+void Connection::completeWritable(const std::vector<IPacketHandler*> &ready, Packet *packet) {
+    for (size_t i = 0; i < ready.size(); i++) {
+        ready[i]->handlePacket(packet, NULL);
+    }
+}
+
+/*
+ * credits came back
+ */
+void Connection::wakeWritable() {
+    std::vector<IPacketHandler*> ready;
+    _outputCond.lock();
+    takeWritable(&ready);
+    _outputCond.unlock();
+    completeWritable(ready, NULL);
+}
+
+/*
+ * when checkTimeout has to run next
+ */
+int64_t Connection::getNextTimeout(int64_t now) {
+    UNUSED(now);
+    int64_t next = _channelPool.getNextExpireTime();
+    int64_t queued = _queueExpireTime;
+    return (queued < next ? queued : next);
+}
+
+/*
+ * the earliest expire time of the queued packets is at most expireTime
+ */
+void Connection::lowerQueueExpireTime(int64_t expireTime) {
+    int64_t queued;
+    do {
+        queued = _queueExpireTime;
+        if (queued <= expireTime) {
+            return;
+        }
+    } while (!__sync_bool_compare_and_swap(&_queueExpireTime, queued, expireTime));
+}
+
 /**
  * ״̬
  */
@@ -17,6 +17,7 @@
 #define TBNET_CONNECTION_H_
 
 #define READ_WRITE_SIZE 8192
+#define READ_WRITE_BUDGET 262144    // edge-triggered: bytes per event and direction
 #ifndef UNUSED
 #define UNUSED(v) ((void)(v))
 #endif
@@ -67,6 +68,35 @@ public:
      */
     bool postPacket(Packet *packet, IPacketHandler *packetHandler = NULL, void *args = NULL, bool noblocking = true);
 
+    /*
+     * post packet and get a future of its reply, client only. the future
+     * completes once: with the reply, or with TimeoutPacket when timeout
+     * passes or the connection goes away. never blocks on the queue limit.
+     *
+     * @param packet: the request, owned by the connection even if it
+     *                could not be posted
+     * @param timeout: ms, 0 - the queue timeout of the connection
+     * @return the future, DisconnPacket if the packet was not posted
+     */
+    PacketFuture call(Packet *packet, int timeout = 0);
+
+    /*
+     * post a request, non-blocking, with a timeout of its own
+     *
+     * @param timeout: ms
+     * @param channelId: gets the channel of the request, see cancel
+     * @return false - not posted, the packet is still the caller's
+     */
+    bool postRequest(Packet *packet, IPacketHandler *packetHandler, void *args, int timeout, uint32_t *channelId);
+
+    /*
+     * give up a request: its handler gets TimeoutPacket now, a reply
+     * coming later is dropped
+     *
+     * @return false - the request is done already
+     */
+    bool cancel(uint32_t channelId);
+
     /*
      * յʱĴ
      */
@@ -77,6 +107,15 @@ public:
      */
     bool checkTimeout(int64_t now);
 
+    /*
+     * when checkTimeout has to run next: the earliest channel deadline or
+     * expire time of a queued packet
+     *
+     * @param now: current time (us)
+     * @return absolute time (us), TBNET_MAX_TIME - nothing to check
+     */
+    int64_t getNextTimeout(int64_t now);
+
     /*
      * д
      */
@@ -94,6 +133,40 @@ public:
       UNUSED(v);
     }
 
+    /*
+     * let a posting thread write an idle socket itself, TCP only
+     */
+    virtual void setDirectWrite(bool v) {
+        UNUSED(v);
+    }
+
+    /*
+     * send payloads (Packet::getPayload) of at least threshold bytes with
+     * MSG_ZEROCOPY, TCP only. such a packet is freed once the kernel has
+     * reported the send complete, not when the write returns. worth it
+     * for payloads of some 10KB and more.
+     *
+     * @param threshold: bytes, 0 - off (default)
+     */
+    virtual void setZeroCopy(int threshold) {
+        UNUSED(threshold);
+    }
+
+    /*
+     * the output queue became non-empty, called with _outputCond held: arm
+     * the write event, or claim the output side for a direct write
+     *
+     * @return true - the caller calls writeDirect() after unlocking
+     */
+    virtual bool armOutput();
+
+    /*
+     * write from the posting thread after armOutput() returned true
+     */
+    virtual void writeDirect() {
+        ;
+    }
+
     /*
      * öеĳʱʱ
      */
@@ -115,6 +188,59 @@ public:
         _queueLimit = limit;
     }
 
+    /*
+     * limit of the bytes (Packet::getQueueSize) posted and not written
+     * yet, client only, 0 - no limit (default)
+     */
+    void setQueueByteLimit(int limit) {
+        _queueByteLimit = limit;
+    }
+
+    /*
+     * packets a client can post before the queue limit is reached,
+     * INT_MAX - no limit
+     */
+    int getCredits() {
+        if (_isServer || _queueLimit <= 0) {
+            return INT_MAX;
+        }
+        return _queueLimit - getQueueTotalSize();
+    }
+
+    /*
+     * bytes a client can post before the byte limit is reached, INT_MAX -
+     * no limit
+     */
+    int getByteCredits() {
+        if (_isServer || _queueByteLimit <= 0) {
+            return INT_MAX;
+        }
+        return _queueByteLimit - atomic_read(&_queueBytes);
+    }
+
+    /*
+     * a non-blocking postPacket is accepted
+     */
+    bool hasCredit() {
+        return (getCredits() > 0 && getByteCredits() > 0);
+    }
+
+    /*
+     * packets posted and not written yet, plus channels waiting for a
+     * reply: the load of the connection
+     */
+    int getOutstanding() {
+        return getQueueTotalSize();
+    }
+
+    /*
+     * a future ready once the connection has credit again, right away if it
+     * has. it completes without a packet, or with DisconnPacket when the
+     * connection goes away first. waiters are woken one per credit
+     * returned, oldest first.
+     */
+    PacketFuture whenWritable();
+
     /**
      * ״̬
      */
@@ -150,6 +276,61 @@ public:
 protected:
     void disconnect();
 
+    /*
+     * postPacket with the timeout (ms) of this packet, channelId gets the
+     * channel of a request
+     */
+    bool postPacket(Packet *packet, IPacketHandler *packetHandler, void *args, bool noblocking, int timeout,
+                    uint32_t *channelId = NULL);
+
+    /*
+     * packets posted and not written yet, plus channels waiting for a reply
+     */
+    int getQueueTotalSize() {
+        return _postQueue.size() + _outputQueue.size() + _myQueue.size() + _channelPool.getUseListCount();
+    }
+
+    /*
+     * move everything posted, oldest first, to queue, with _outputCond held
+     */
+    void takeOutput(PacketQueue *queue) {
+        _outputQueue.moveTo(queue);
+        _postQueue.moveTo(queue);
+    }
+
+    /*
+     * take as many writable waiters as there are credits, with _outputCond
+     * held. complete them with completeWritable after unlocking.
+     */
+    void takeWritable(std::vector<IPacketHandler*> *ready);
+
+    /*
+     * complete the writable waiters taken
+     *
+     * @param packet: NULL - credits returned, DisconnPacket - closed
+     */
+    void completeWritable(const std::vector<IPacketHandler*> &ready, Packet *packet);
+
+    /*
+     * credits came back: reply, timeout or packets written
+     */
+    void wakeWritable();
+
+    /*
+     * a packet due at expireTime is queued
+     */
+    void lowerQueueExpireTime(int64_t expireTime);
+
+    /*
+     * a queued packet not worth writing any more: due, or its request is
+     * done (timed out or cancelled). the timeout of the request is left to
+     * its channel.
+     */
+    bool isStale(Packet *packet, int64_t now) {
+        return (packet->getExpireTime() < now ||
+                (packet->getChannel() != NULL && !_channelPool.isUsed(packet->getChannelId())));
+    }
+
 protected:
     IPacketHandler *_defaultPacketHandler;  // connectionĬϵpacket handler
     bool _isServer;                         // Ƿ
@@ -158,13 +339,18 @@ protected:
     IPacketStreamer *_streamer;             // Packet
     IServerAdapter *_serverAdapter;         // 
 
+    AtomicPacketQueue _postQueue;           // posted by any thread, lock-free
     PacketQueue _outputQueue;               // Ͷ
     PacketQueue _inputQueue;                // Ͷ
     PacketQueue _myQueue;                   // writeдʱʱ
     tbsys::CThreadCond _outputCond;         // Ͷе
     ChannelPool _channelPool;               // channel pool
     int _queueTimeout;                      // гʱʱ
-    int _queueTotalSize;                    // ܳ
+    atomic_t _queueWaiters;                 // entries in _writableWaiters
+    std::deque<IPacketHandler*> _writableWaiters;   // whenWritable, oldest first
+    atomic_t _queueBytes;                   // Packet::getQueueSize of the packets queued
+    int _queueByteLimit;                    // 0 - no limit
+    volatile int64_t _queueExpireTime;      // lower bound of the expire times of the queued packets
     int _queueLimit;                        // , ֵpostͻᱻwait
 };
 }
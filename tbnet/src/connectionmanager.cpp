@@ -28,6 +28,11 @@ ConnectionManager::ConnectionManager(Transport *transport, IPacketStreamer *stre
     _packetHandler = packetHandler;
     _queueLimit = 256;
     _queueTimeout = 5000;
+    _poolSize = 1;
+    _poolPolicy = ConnectionPool::PICK_LEAST_LOADED;
+    _poolIdleTime = TBNET_POOL_IDLE_TIME;
+    _hedgePercentile = 95;
+    _poolMap = new TBNET_POOL_MAP();
     _status = 0;
 }
 
@@ -35,16 +40,29 @@ ConnectionManager::ConnectionManager(Transport *transport, IPacketStreamer *stre
  * 
  */
 ConnectionManager::~ConnectionManager() {
+    TBNET_POOL_MAP::iterator it;
+    for (it = _poolMap->begin(); it != _poolMap->end(); ++it) {
+        delete it->second;
+    }
+    for (it = _closedPools.begin(); it != _closedPools.end(); ++it) {
+        delete it->second;
+    }
+    delete _poolMap;
 }
 
+/*
+ * close everything, the pools are kept until the manager goes: a sender
+ * may still hold one
+ */
 void ConnectionManager::cleanup() {
     _status = 1;
     _mutex.lock();
-    TBNET_CONN_MAP::iterator it;
-    for (it = _connectMap.begin(); it != _connectMap.end(); ++it) {
-        _transport->disconnect(it->second);
+    TBNET_POOL_MAP::iterator it;
+    for (it = _poolMap->begin(); it != _poolMap->end(); ++it) {
+        it->second->disconnect();
+        _closedPools[it->first] = it->second;
     }
-    _connectMap.clear();
+    publish(new TBNET_POOL_MAP());
     _mutex.unlock();
 }
 
@@ -52,6 +70,18 @@ void ConnectionManager::cleanup() {
  * ӷ
  */
 Connection *ConnectionManager::getConnection(uint64_t serverId) {
+    Connection *conn = acquire(serverId);
+    if (conn != NULL) {
+        conn->getIOComponent()->setHandedOut();
+    }
+    ConnectionPool::release(conn);
+    return conn;
+}
+
+/*
+ * a connection of the pool of serverId, referenced
+ */
+Connection *ConnectionManager::acquire(uint64_t serverId) {
     if (_status == 1) {
         return NULL;
     }
@@ -59,28 +89,62 @@ Connection *ConnectionManager::getConnection(uint64_t serverId) {
         return NULL;
     }
 
-    tbsys::CThreadGuard guard(&_mutex);
+    ConnectionPool *pool = getPool(serverId);
+    return pool->getConnection(_poolPolicy, _poolIdleTime);
+}
 
-    TBNET_CONN_MAP::iterator it ;
-    it = _connectMap.find(serverId);
-    if (it != _connectMap.end()) {
-        return it->second;
+/*
+ * pool of serverId, looked up in the current snapshot without locking. a
+ * miss takes _mutex and publishes a snapshot with the pool added, created
+ * with the defaults. connecting is left to the pool, so a slow server
+ * only holds up its own senders.
+ */
+ConnectionPool *ConnectionManager::getPool(uint64_t serverId) {
+    int phase = _readers.enter();
+    TBNET_POOL_MAP *map = _poolMap;
+    TBNET_POOL_MAP::iterator it = map->find(serverId);
+    ConnectionPool *pool = (it != map->end() ? it->second : NULL);
+    _readers.leave(phase);
+    if (pool != NULL) {
+        return pool;
     }
 
-    // transportлȡ
-    char spec[64];
-    sprintf(spec, "tcp:%s", tbsys::CNetUtil::addrToString(serverId).c_str());
-    Connection *conn = _transport->connect(spec, _streamer, true);
-    if (!conn) {
-        TBSYS_LOG(WARN, "ӵʧ: %s", spec);
-        return NULL;
+    tbsys::CThreadGuard guard(&_mutex);
+    map = _poolMap;
+    it = map->find(serverId);
+    if (it != map->end()) {
+        return it->second;
+    }
+    it = _closedPools.find(serverId);
+    if (it != _closedPools.end()) {
+        pool = it->second;
+        _closedPools.erase(it);
+        pool->reopen();
     } else {
-        conn->setDefaultPacketHandler(_packetHandler);
-        conn->setQueueLimit(_queueLimit);
-        conn->setQueueTimeout(_queueTimeout);
-        _connectMap[serverId] = conn;
+        pool = new ConnectionPool(_transport, _streamer, serverId);
     }
-    return conn;
+    pool->setDefaultPacketHandler(_packetHandler);
+    pool->setQueueLimit(_queueLimit);
+    pool->setQueueTimeout(_queueTimeout);
+    pool->setPoolSize(_poolSize);
+    pool->getLatency()->setPercentile(_hedgePercentile);
+
+    TBNET_POOL_MAP *next = new TBNET_POOL_MAP(*map);
+    (*next)[serverId] = pool;
+    publish(next);
+    return pool;
+}
+
+/*
+ * make map the snapshot, with _mutex held. the old one is freed once the
+ * lookups that may have loaded it are done, a lookup holds it for one find.
+ */
+void ConnectionManager::publish(TBNET_POOL_MAP *map) {
+    TBNET_POOL_MAP *old = _poolMap;
+    __sync_synchronize();   // filled before it is seen
+    _poolMap = map;
+    _readers.synchronize();
+    delete old;
 }
 
 /**
@@ -88,13 +152,14 @@ Connection *ConnectionManager::getConnection(uint64_t serverId) {
  */
 Connection *ConnectionManager::connect(uint64_t serverId,
                                        IPacketHandler *packetHandler, int queueLimit, int queueTimeout) {
-    Connection *conn = getConnection(serverId);
-    if (conn != NULL) {
-        conn->setDefaultPacketHandler(packetHandler);
-        conn->setQueueLimit(queueLimit);
-        conn->setQueueTimeout(queueTimeout);
+    if (_status == 1 || serverId == 0) {
+        return NULL;
     }
-    return conn;
+    ConnectionPool *pool = getPool(serverId);
+    pool->setDefaultPacketHandler(packetHandler);
+    pool->setQueueLimit(queueLimit);
+    pool->setQueueTimeout(queueTimeout);
+    return getConnection(serverId);
 }
 
 /**
@@ -102,12 +167,14 @@ Connection *ConnectionManager::connect(uint64_t serverId,
  */
 void ConnectionManager::disconnect(uint64_t serverId) {
     _mutex.lock();
-    TBNET_CONN_MAP::iterator it = _connectMap.find(serverId);
-    if (it != _connectMap.end()) {
-        if (it->second) {
-            _transport->disconnect(it->second);
-        }
-        _connectMap.erase(it);
+    TBNET_POOL_MAP::iterator it = _poolMap->find(serverId);
+    if (it != _poolMap->end()) {
+        ConnectionPool *pool = it->second;
+        TBNET_POOL_MAP *next = new TBNET_POOL_MAP(*_poolMap);
+        next->erase(serverId);
+        publish(next);
+        pool->disconnect();
+        _closedPools[serverId] = pool;
     }
     _mutex.unlock();
 }
@@ -117,10 +184,7 @@ void ConnectionManager::disconnect(uint64_t serverId) {
  */
 void ConnectionManager::setDefaultQueueLimit(uint64_t serverId, int queueLimit) {
     if (serverId) {
-        Connection *conn = getConnection(serverId);
-        if (conn != NULL) {
-            conn->setQueueLimit(queueLimit);
-        }
+        getPool(serverId)->setQueueLimit(queueLimit);
     } else {
         _queueLimit = queueLimit;
     }
@@ -131,10 +195,7 @@ void ConnectionManager::setDefaultQueueLimit(uint64_t serverId, int queueLimit)
  */
 void ConnectionManager::setDefaultQueueTimeout(uint64_t serverId, int queueTimeout) {
     if (serverId) {
-        Connection *conn = getConnection(serverId);
-        if (conn != NULL) {
-            conn->setQueueTimeout(queueTimeout);
-        }
+        getPool(serverId)->setQueueTimeout(queueTimeout);
     } else {
         _queueTimeout = queueTimeout;
     }
@@ -145,26 +206,323 @@ void ConnectionManager::setDefaultQueueTimeout(uint64_t serverId, int queueTimeo
  */
 void ConnectionManager::setDefaultPacketHandler(uint64_t serverId, IPacketHandler *packetHandler) {
     if (serverId) {
-        Connection *conn = getConnection(serverId);
-        if (conn != NULL) {
-            conn->setDefaultPacketHandler(packetHandler);
-        }
+        getPool(serverId)->setDefaultPacketHandler(packetHandler);
     } else {
         _packetHandler = packetHandler;
     }
 }
 
+/*
+ * connections per server
+ */
+void ConnectionManager::setDefaultPoolSize(uint64_t serverId, int poolSize) {
+    if (serverId) {
+        getPool(serverId)->setPoolSize(poolSize);
+    } else {
+        _poolSize = poolSize;
+    }
+}
+
+/*
+ * how a connection of a pool is picked
+ */
+void ConnectionManager::setPoolPolicy(int policy) {
+    _poolPolicy = policy;
+}
+
+/*
+ * ms a pooled connection may stay unused
+ */
+void ConnectionManager::setPoolIdleTime(int idleTime) {
+    _poolIdleTime = static_cast<int64_t>(idleTime) * 1000;
+}
+
 /**
  * ݰ
  */
 bool ConnectionManager::sendPacket(uint64_t serverId, Packet *packet, IPacketHandler *packetHandler, void *args, bool noblocking) {
-    Connection *conn = getConnection(serverId);
+    Connection *conn = acquire(serverId);
     if (conn) {
-        return conn->postPacket(packet, packetHandler, args, noblocking);
+        bool rc = conn->postPacket(packet, packetHandler, args, noblocking);
+        ConnectionPool::release(conn);
+        return rc;
     }
     return false;
 }
 
+/*
+ * future of the reply to packet from serverId
+ */
+PacketFuture ConnectionManager::call(uint64_t serverId, Packet *packet, int timeout) {
+    Connection *conn = acquire(serverId);
+    if (conn) {
+        PacketFuture future = conn->call(packet, timeout);
+        ConnectionPool::release(conn);
+        return future;
+    }
+    packet->free();
+    return PacketFuture(&ControlPacket::DisconnPacket);
+}
+
+/*
+ * a hedged call: the request (attempt 0) and its hedge (attempt 1) report
+ * here, the reply that wins completes the future of the caller. it holds
+ * a reference per attempt, one for its timer and one for hedgedCall. the
+ * connections of both attempts are taken by hedgedCall and referenced
+ * until it goes, so the hedge sent from the timer thread never connects
+ * or waits for a connect.
+ */
+class ConnectionManager::Hedge : public IPacketHandler, public ITimerHandler {
+
+public:
+    Hedge(ConnectionManager *manager, IPacketHandler *result, Packet *spare, int64_t deadline) {
+        _manager = manager;
+        _result = result;
+        _spare = spare;
+        _deadline = deadline;
+        _pending = 0;
+        _done = false;
+        memset(_attempts, 0, sizeof(_attempts));
+        _timer.setHandler(this, NULL);
+        atomic_set(&_ref, 1);
+    }
+
+    ~Hedge() {
+        if (_spare != NULL) {
+            _spare->free();
+        }
+        ConnectionPool::release(_attempts[0]._conn);
+        ConnectionPool::release(_attempts[1]._conn);
+    }
+
+    void addRef() {
+        atomic_inc(&_ref);
+    }
+
+    void release() {
+        if (atomic_dec_return(&_ref) == 0) {
+            delete this;
+        }
+    }
+
+    /*
+     * attempt index goes out on conn of pool, referenced, NULL - it fails
+     */
+    void setConnection(int index, ConnectionPool *pool, Connection *conn) {
+        _attempts[index]._pool = pool;
+        _attempts[index]._conn = conn;
+    }
+
+    /*
+     * hedge at expireTime unless done by then
+     */
+    void arm(int64_t expireTime) {
+        addRef();
+        _manager->_transport->scheduleTimer(&_timer, expireTime);
+    }
+
+    /*
+     * send attempt index on its connection, a packet that cannot be posted
+     * completes it with DisconnPacket
+     */
+    void post(int index, Packet *packet) {
+        int64_t now = tbsys::CTimeUtil::getTime();
+        int timeout = static_cast<int>((_deadline - now) / 1000);
+        Attempt *attempt = &_attempts[index];
+        Connection *conn = attempt->_conn;
+
+        addRef();
+        _mutex.lock();
+        _pending ++;
+        attempt->_startTime = now;
+        _mutex.unlock();
+
+        uint32_t channelId = 0;
+        if (conn == NULL || timeout <= 0 ||
+                !conn->postRequest(packet, this, reinterpret_cast<void*>(static_cast<long>(index)), timeout, &channelId)) {
+            packet->free();
+            handlePacket(&ControlPacket::DisconnPacket, reinterpret_cast<void*>(static_cast<long>(index)));
+            return;
+        }
+
+        _mutex.lock();
+        attempt->_channelId = channelId;
+        attempt->_posted = true;
+        bool cancel = (_done && !attempt->_finished);
+        _mutex.unlock();
+        if (cancel) { // the other attempt won meanwhile
+            conn->cancel(channelId);
+        }
+    }
+
+    /*
+     * IPacketHandler, an attempt is done
+     */
+    HPRetCode handlePacket(Packet *packet, void *args) {
+        int index = static_cast<int>(reinterpret_cast<long>(args));
+        Attempt *attempt = &_attempts[index];
+        bool regular = packet->isRegularPacket();
+        if (attempt->_pool != NULL && (regular ||
+                static_cast<ControlPacket*>(packet)->getCommand() == ControlPacket::CMD_TIMEOUT_PACKET)) {
+            // a cancelled attempt counts too, it was at least that slow
+            attempt->_pool->getLatency()->record(tbsys::CTimeUtil::getTime() - attempt->_startTime);
+        }
+
+        Packet *spare = NULL;
+        bool win = false;
+        Attempt *loser = NULL;
+        _mutex.lock();
+        attempt->_finished = true;
+        _pending --;
+        if (!_done) {
+            if (regular) {
+                win = true;
+            } else if (_spare != NULL) { // failed before the hedge, hedge now
+                spare = _spare;
+                _spare = NULL;
+            } else {
+                win = (_pending == 0); // the last one fails the call
+            }
+        }
+        if (win) {
+            _done = true;
+            Attempt *other = &_attempts[1 - index];
+            if (other->_posted && !other->_finished) {
+                loser = other;
+            }
+        }
+        _mutex.unlock();
+
+        if (win) {
+            if (_manager->_transport->cancelTimer(&_timer)) {
+                release();
+            }
+            _result->handlePacket(packet, NULL);
+            if (loser != NULL) {
+                loser->_conn->cancel(loser->_channelId);
+            }
+        } else if (regular) {
+            packet->free();
+        }
+        if (spare != NULL) {
+            post(1, spare);
+        }
+        release();
+        return IPacketHandler::FREE_CHANNEL;
+    }
+
+    /*
+     * ITimerHandler, the request is slow: send the hedge, on the connection
+     * hedgedCall took, without blocking
+     */
+    void handleTimer(TimerEntry *entry, int64_t now) {
+        UNUSED(entry);
+        UNUSED(now);
+        _mutex.lock();
+        Packet *spare = (_done ? NULL : _spare);
+        if (spare != NULL) {
+            _spare = NULL;
+        }
+        _mutex.unlock();
+        if (spare != NULL) {
+            post(1, spare);
+        }
+        release();
+    }
+
+private:
+    struct Attempt {
+        ConnectionPool *_pool;
+        Connection *_conn;
+        int64_t _startTime;
+        uint32_t _channelId;
+        bool _posted;
+        bool _finished;
+    };
+
+    ConnectionManager *_manager;
+    IPacketHandler *_result;        // completes the future of the caller
+    Packet *_spare;                 // the clone, until it is sent
+    int64_t _deadline;              // us
+    int _pending;                   // attempts out
+    bool _done;
+    Attempt _attempts[2];
+    TimerEntry _timer;
+    atomic_t _ref;
+    tbsys::CThreadMutex _mutex;
+};
+
+/*
+ * call serverId, hedged to hedgeServerId past the hedge percentile
+ */
+PacketFuture ConnectionManager::hedgedCall(uint64_t serverId, uint64_t hedgeServerId, Packet *packet, int timeout) {
+    Packet *spare = NULL;
+    if (hedgeServerId != 0 && hedgeServerId != serverId && _status != 1) {
+        spare = packet->clone();
+    }
+    int64_t now = tbsys::CTimeUtil::getTime();
+    // both connections are taken here, where blocking for a connect is
+    // fine; the hedge may go out from the timer thread
+    ConnectionPool *hedgePool = NULL;
+    Connection *hedgeConn = NULL;
+    if (spare != NULL) {
+        hedgePool = getPool(hedgeServerId);
+        hedgeConn = hedgePool->getConnection(_poolPolicy, _poolIdleTime);
+        if (hedgeConn == NULL) { // nowhere to hedge to
+            spare->free();
+            spare = NULL;
+        }
+    }
+    if (spare == NULL) {
+        return call(serverId, packet, timeout);
+    }
+
+    int64_t deadline = now + static_cast<int64_t>(timeout > 0 ? timeout : _queueTimeout) * 1000;
+    ConnectionPool *pool = NULL;
+    Connection *conn = NULL;
+    int64_t delay = -1;
+    if (serverId != 0) {
+        pool = getPool(serverId);
+        conn = pool->getConnection(_poolPolicy, _poolIdleTime);
+        delay = pool->getLatency()->getPercentile(TBNET_HEDGE_MIN_SAMPLES);
+    }
+
+    PacketFuture future = PacketFuture::create();
+    Hedge *hedge = new Hedge(this, future.retainHandler(), spare, deadline);
+    hedge->setConnection(0, pool, conn);
+    hedge->setConnection(1, hedgePool, hedgeConn);
+    if (delay >= 0 && now + delay < deadline) {
+        hedge->arm(now + delay);
+    }
+    hedge->post(0, packet);
+    hedge->release();
+    return future;
+}
+
+/*
+ * hedge percentile of every server
+ */
+void ConnectionManager::setHedgePercentile(int percentile) {
+    tbsys::CThreadGuard guard(&_mutex);
+    _hedgePercentile = percentile;
+    TBNET_POOL_MAP::iterator it;
+    for (it = _poolMap->begin(); it != _poolMap->end(); ++it) {
+        it->second->getLatency()->setPercentile(percentile);
+    }
+}
+
+/*
+ * load of serverId, 0 if it has no pool
+ */
+int ConnectionManager::getOutstanding(uint64_t serverId) {
+    int phase = _readers.enter();
+    TBNET_POOL_MAP *map = _poolMap;
+    TBNET_POOL_MAP::iterator it = map->find(serverId);
+    ConnectionPool *pool = (it != map->end() ? it->second : NULL);
+    _readers.leave(phase);
+    return (pool != NULL ? pool->getOutstanding() : 0);
+}
+
 // Ƿܱ
 bool ConnectionManager::isAlive(uint64_t serverId) {
     tbnet::Socket socket;
@@ -22,8 +22,13 @@
 namespace tbnet {
 
 typedef __gnu_cxx::hash_map<uint64_t, Connection*, __gnu_cxx::hash<int> > TBNET_CONN_MAP;
+typedef __gnu_cxx::hash_map<uint64_t, ConnectionPool*, __gnu_cxx::hash<int> > TBNET_POOL_MAP;
+
+#define TBNET_HEDGE_MIN_SAMPLES 100     // latencies of a server before its requests are hedged
 
 class ConnectionManager {
+    friend class ReplicaSet;
+
 public:
     /*
      * 캯
@@ -61,11 +66,56 @@ public:
      */
     void setDefaultPacketHandler(uint64_t serverId, IPacketHandler *packetHandler);
 
+    /**
+     * connections to serverId at most, serverId 0 - the default of the
+     * servers connected later. 1 by default.
+     */
+    void setDefaultPoolSize(uint64_t serverId, int poolSize);
+
+    /**
+     * ConnectionPool::PickPolicy, PICK_LEAST_LOADED by default
+     */
+    void setPoolPolicy(int policy);
+
+    /**
+     * ms a pooled connection may stay unused before it is closed, 0 -
+     * never closed
+     */
+    void setPoolIdleTime(int idleTime);
+
     /**
      * ݰ
      */
     bool sendPacket(uint64_t serverId, Packet *packet, IPacketHandler *packetHandler = NULL, void *args = NULL, bool noblocking = true);
 
+    /**
+     * Connection::call on the connection to serverId
+     */
+    PacketFuture call(uint64_t serverId, Packet *packet, int timeout = 0);
+
+    /**
+     * call for an idempotent request that may be sent twice. once it has
+     * been out longer than the hedge percentile of the latencies of
+     * serverId, Packet::clone of it goes to hedgeServerId as well; the
+     * first reply wins and the other request is cancelled. a request that
+     * fails first goes to hedgeServerId right away. the timeout counts
+     * from the call for both. a packet without clone, or a hedgeServerId
+     * no connection can be had to, is a plain call. the connections of
+     * both are taken by the caller, the hedge does not connect.
+     */
+    PacketFuture hedgedCall(uint64_t serverId, uint64_t hedgeServerId, Packet *packet, int timeout = 0);
+
+    /**
+     * percentile of the latencies past which a request is hedged, 95 by
+     * default
+     */
+    void setHedgePercentile(int percentile);
+
+    /**
+     * packets to serverId queued or waiting for a reply, over its pool
+     */
+    int getOutstanding(uint64_t serverId);
+
     /**
      * destroy
      */
@@ -73,6 +123,12 @@ public:
 
     /**
      * õһ
+     *
+     * no reference is kept, the connection may be closed by another
+     * thread. it is freed no sooner than TBNET_DELETE_GRACE after that, a
+     * caller holding it longer takes part in the epoch reclamation, see
+     * Transport::getEpochManager. sendPacket and call hold a reference of
+     * their own.
      */
     Connection *getConnection(uint64_t serverId);
 
@@ -81,6 +137,17 @@ public:
      */
     static bool isAlive(uint64_t serverId);
 
+private:
+    class Hedge;
+
+    ConnectionPool *getPool(uint64_t serverId);
+
+    /*
+     * a connection with a reference, see ConnectionPool::getConnection
+     */
+    Connection *acquire(uint64_t serverId);
+    void publish(TBNET_POOL_MAP *map);
+
 private:
     Transport *_transport;
     IPacketStreamer *_streamer;
@@ -88,9 +155,15 @@ private:
     int _queueLimit;
     int _queueTimeout;
     int _status;
-
-    TBNET_CONN_MAP _connectMap;
-    tbsys::CThreadMutex _mutex;
+    int _poolSize;
+    int _poolPolicy;
+    int64_t _poolIdleTime;
+    int _hedgePercentile;
+
+    TBNET_POOL_MAP *volatile _poolMap;     // snapshot, replaced as a whole under _mutex
+    TBNET_POOL_MAP _closedPools;            // disconnected, reused if the server comes back
+    ReaderCount _readers;                   // lookups in the snapshot
+    tbsys::CThreadMutex _mutex;             // serializes the writers
 };
 
 }
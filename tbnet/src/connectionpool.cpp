@@ -0,0 +1,356 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+/*
+ * constructor
+ */
+ConnectionPool::ConnectionPool(Transport *transport, IPacketStreamer *streamer, uint64_t serverId) {
+    _transport = transport;
+    _streamer = streamer;
+    _serverId = serverId;
+    _packetHandler = NULL;
+    _queueLimit = 256;
+    _queueTimeout = 5000;
+    _poolSize = 1;
+    _lastShrink = tbsys::CTimeUtil::getTime();
+    _closed = false;
+    memset(_slots, 0, sizeof(_slots));
+}
+
+/*
+ * destructor, the connections stay open: disconnect first
+ */
+ConnectionPool::~ConnectionPool() {
+}
+
+/*
+ * pick a connection, open one if the pick falls on an empty slot or every
+ * connection is loaded
+ */
+Connection *ConnectionPool::getConnection(int policy, int64_t idleTime) {
+    if (_closed) {
+        return NULL;
+    }
+    int64_t now = tbsys::CTimeUtil::getTime();
+    if (idleTime > 0 && now - _lastShrink >= TBNET_POOL_SHRINK_INTERVAL) {
+        _lastShrink = now;
+        shrink(now, idleTime);
+    }
+
+    int size = _poolSize;
+    int index = -1;
+    int empty = -1;
+    int phase = _readers.enter();
+    if (policy == PICK_THREAD_AFFINITY) {
+        int slot = getAffinitySlot() % size;
+        if (_slots[slot]._conn != NULL) {
+            index = slot;
+        } else {
+            empty = slot;
+        }
+    } else {
+        int minLoad = INT_MAX;
+        for (int i = 0; i < size; i++) {
+            Connection *conn = _slots[i]._conn;
+            if (conn == NULL) {
+                if (empty < 0) {
+                    empty = i;
+                }
+                continue;
+            }
+            int load = conn->getOutstanding();
+            if (load < minLoad) {
+                minLoad = load;
+                index = i;
+            }
+        }
+        if (index >= 0 && minLoad < TBNET_POOL_GROW_OUTSTANDING) {
+            empty = -1;
+        }
+    }
+    _readers.leave(phase);
+
+    Connection *conn = NULL;
+    if (empty >= 0) {
+        conn = connectSlot(empty, (index < 0));
+    }
+    if (conn == NULL) { // could not connect, any connection will do
+        conn = acquire(index, now);
+    }
+    return conn;
+}
+
+/*
+ * reference the connection of a slot, it is not closed before the reader
+ * count is left
+ */
+Connection *ConnectionPool::acquire(int index, int64_t now) {
+    Connection *conn = NULL;
+    int phase = _readers.enter();
+    if (index >= 0) {
+        conn = _slots[index]._conn;
+    }
+    for (int i = 0; i < _poolSize && conn == NULL; i++) {
+        conn = _slots[i]._conn;
+        index = i;
+    }
+    if (conn != NULL) {
+        conn->getIOComponent()->addRef();
+        _slots[index]._lastUse = now;
+    }
+    _readers.leave(phase);
+    return conn;
+}
+
+/*
+ * close idle connections
+ */
+int ConnectionPool::shrink(int64_t now, int64_t idleTime) {
+    tbsys::CThreadGuard guard(&_cond);
+    int count = 0;
+    for (int i = 0; i < TBNET_POOL_MAX_CONNECTIONS; i++) {
+        if (_slots[i]._conn != NULL) {
+            count ++;
+        }
+    }
+    Connection *conns[TBNET_POOL_MAX_CONNECTIONS];
+    int closed = 0;
+    for (int i = 0; i < TBNET_POOL_MAX_CONNECTIONS && count > 1; i++) {
+        Connection *conn = _slots[i]._conn;
+        if (conn == NULL || _slots[i]._connecting || now - _slots[i]._lastUse < idleTime || conn->getOutstanding() > 0) {
+            continue;
+        }
+        _slots[i]._conn = NULL;
+        conns[closed ++] = conn;
+        count --;
+    }
+    close(conns, closed);
+    if (closed > 0) {
+        TBSYS_LOG(INFO, "closed %d idle connections to %s, %d left",
+                  closed, tbsys::CNetUtil::addrToString(_serverId).c_str(), count);
+    }
+    return closed;
+}
+
+/*
+ * close every connection
+ */
+void ConnectionPool::disconnect() {
+    tbsys::CThreadGuard guard(&_cond);
+    _closed = true;
+    Connection *conns[TBNET_POOL_MAX_CONNECTIONS];
+    int count = 0;
+    for (int i = 0; i < TBNET_POOL_MAX_CONNECTIONS; i++) {
+        if (_slots[i]._conn != NULL) {
+            conns[count ++] = _slots[i]._conn;
+            _slots[i]._conn = NULL;
+        }
+    }
+    close(conns, count);
+}
+
+/*
+ * connect again
+ */
+void ConnectionPool::reopen() {
+    tbsys::CThreadGuard guard(&_cond);
+    _closed = false;
+}
+
+/*
+ * resize, the connections of the slots dropped are closed
+ */
+void ConnectionPool::setPoolSize(int poolSize) {
+    if (poolSize < 1) {
+        poolSize = 1;
+    } else if (poolSize > TBNET_POOL_MAX_CONNECTIONS) {
+        poolSize = TBNET_POOL_MAX_CONNECTIONS;
+    }
+    tbsys::CThreadGuard guard(&_cond);
+    _poolSize = poolSize;
+    Connection *conns[TBNET_POOL_MAX_CONNECTIONS];
+    int count = 0;
+    for (int i = poolSize; i < TBNET_POOL_MAX_CONNECTIONS; i++) {
+        if (_slots[i]._conn != NULL) {
+            conns[count ++] = _slots[i]._conn;
+            _slots[i]._conn = NULL;
+        }
+    }
+    close(conns, count);
+}
+
+/*
+ * the slots are empty already: wait for the pickers that may have read
+ * them, then close. one still using a connection holds a reference.
+ */
+void ConnectionPool::close(Connection **conns, int count) {
+    if (count == 0) {
+        return;
+    }
+    _readers.synchronize();
+    for (int i = 0; i < count; i++) {
+        _transport->disconnect(conns[i]);
+    }
+}
+
+/*
+ * connections open
+ */
+int ConnectionPool::getConnectionCount() {
+    int count = 0;
+    for (int i = 0; i < TBNET_POOL_MAX_CONNECTIONS; i++) {
+        if (_slots[i]._conn != NULL) {
+            count ++;
+        }
+    }
+    return count;
+}
+
+/*
+ * load of the pool
+ */
+int ConnectionPool::getOutstanding() {
+    int load = 0;
+    int phase = _readers.enter();
+    for (int i = 0; i < TBNET_POOL_MAX_CONNECTIONS; i++) {
+        Connection *conn = _slots[i]._conn;
+        if (conn != NULL) {
+            load += conn->getOutstanding();
+        }
+    }
+    _readers.leave(phase);
+    return load;
+}
+
+/*
+ * packet handler of every connection
+ */
+void ConnectionPool::setDefaultPacketHandler(IPacketHandler *packetHandler) {
+    tbsys::CThreadGuard guard(&_cond);
+    _packetHandler = packetHandler;
+    for (int i = 0; i < TBNET_POOL_MAX_CONNECTIONS; i++) {
+        if (_slots[i]._conn != NULL) {
+            _slots[i]._conn->setDefaultPacketHandler(packetHandler);
+        }
+    }
+}
+
+/*
+ * queue limit of every connection
+ */
+void ConnectionPool::setQueueLimit(int queueLimit) {
+    tbsys::CThreadGuard guard(&_cond);
+    _queueLimit = queueLimit;
+    for (int i = 0; i < TBNET_POOL_MAX_CONNECTIONS; i++) {
+        if (_slots[i]._conn != NULL) {
+            _slots[i]._conn->setQueueLimit(queueLimit);
+        }
+    }
+}
+
+/*
+ * queue timeout of every connection
+ */
+void ConnectionPool::setQueueTimeout(int queueTimeout) {
+    tbsys::CThreadGuard guard(&_cond);
+    _queueTimeout = queueTimeout;
+    for (int i = 0; i < TBNET_POOL_MAX_CONNECTIONS; i++) {
+        if (_slots[i]._conn != NULL) {
+            _slots[i]._conn->setQueueTimeout(queueTimeout);
+        }
+    }
+}
+
+/*
+ * the thread id scrambled, pthread_t is an aligned address
+ */
+int ConnectionPool::getAffinitySlot() {
+    uint64_t id = static_cast<uint64_t>(pthread_self());
+    id *= 0x9E3779B97F4A7C15ULL;
+    return static_cast<int>(id >> 33);
+}
+
+/*
+ * connect the slot, the connect runs unlocked with the slot marked. the
+ * connection is referenced under the lock, no one closes it meanwhile.
+ */
+Connection *ConnectionPool::connectSlot(int index, bool mayWait) {
+    Connection *conn = NULL;
+    bool waited = false;
+    _cond.lock();
+    while (!_closed && index < _poolSize) {
+        conn = _slots[index]._conn;
+        if (conn != NULL) {
+            break;
+        }
+        if (!_slots[index]._connecting) {
+            if (waited) { // the connect waited for failed
+                break;
+            }
+            _slots[index]._connecting = true;
+            _cond.unlock();
+            conn = open();
+            _cond.lock();
+            _slots[index]._connecting = false;
+            if (conn != NULL && (_closed || index >= _poolSize)) { // dropped meanwhile
+                _transport->disconnect(conn);
+                conn = NULL;
+            }
+            if (conn != NULL) {
+                _slots[index]._lastUse = tbsys::CTimeUtil::getTime();
+                __sync_synchronize();   // set up before it is seen
+                _slots[index]._conn = conn;
+            }
+            _cond.broadcast();
+            break;
+        }
+        if (!mayWait) {
+            break;
+        }
+        _cond.wait();
+        waited = true;
+    }
+    if (conn != NULL) {
+        conn->getIOComponent()->addRef();
+        _slots[index]._lastUse = tbsys::CTimeUtil::getTime();
+    }
+    _cond.unlock();
+    return conn;
+}
+
+/*
+ * open a connection with the settings of the pool
+ */
+Connection *ConnectionPool::open() {
+    char spec[64];
+    sprintf(spec, "tcp:%s", tbsys::CNetUtil::addrToString(_serverId).c_str());
+    Connection *conn = _transport->connect(spec, _streamer, true);
+    if (conn == NULL) {
+        TBSYS_LOG(WARN, "connect to %s failed", spec);
+        return NULL;
+    }
+    _cond.lock();
+    conn->setDefaultPacketHandler(_packetHandler);
+    conn->setQueueLimit(_queueLimit);
+    conn->setQueueTimeout(_queueTimeout);
+    _cond.unlock();
+    return conn;
+}
+
+}
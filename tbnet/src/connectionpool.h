@@ -0,0 +1,180 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_CONNECTIONPOOL_H_
+#define TBNET_CONNECTIONPOOL_H_
+
+namespace tbnet {
+
+#define TBNET_POOL_MAX_CONNECTIONS  64          // per server
+#define TBNET_POOL_GROW_OUTSTANDING 4           // least loaded: grow when every connection has as many
+#define TBNET_POOL_IDLE_TIME        60000000    // us, unused that long a connection is closed
+#define TBNET_POOL_SHRINK_INTERVAL  1000000     // us, between two looks for idle connections
+
+/*
+ * the connections of a ConnectionManager to one server.
+ *
+ * a pool opens its connections lazily, up to its size: a slot is connected
+ * the first time it is picked. a connection not picked for the idle time
+ * is closed again, the last one is kept. picking reads the slots without
+ * locking, opening and closing take the lock of the pool. a slot being
+ * connected is marked, the connect runs unlocked: other callers use an
+ * open connection meanwhile, or, if there is none, wait for that one.
+ *
+ * a connection picked comes with a reference, Transport does not free it
+ * before release. the pick is a ReaderCount read: a connection taken out of
+ * its slot is closed once no picker can still be adding its reference.
+ */
+class ConnectionPool {
+
+public:
+    enum PickPolicy {
+        PICK_LEAST_LOADED = 0,  // fewest requests queued and waiting for a reply
+        PICK_THREAD_AFFINITY    // the same slot for a thread, spreads senders
+    };
+
+    ConnectionPool(Transport *transport, IPacketStreamer *streamer, uint64_t serverId);
+    ~ConnectionPool();
+
+    /*
+     * a connection to the server, opened if need be
+     *
+     * @param policy: PickPolicy
+     * @param idleTime: us, see shrink
+     * @return NULL - could not connect, or closed; else the connection with
+     *         a reference to give back with release
+     */
+    Connection *getConnection(int policy, int64_t idleTime);
+
+    /*
+     * give back the reference of getConnection
+     */
+    static void release(Connection *conn) {
+        if (conn != NULL) {
+            conn->getIOComponent()->subRef();
+        }
+    }
+
+    /*
+     * close the connections not picked for idleTime that have nothing
+     * outstanding, but the last one
+     *
+     * @return connections closed
+     */
+    int shrink(int64_t now, int64_t idleTime);
+
+    /*
+     * close every connection, getConnection returns NULL until reopen
+     */
+    void disconnect();
+
+    /*
+     * connect again after disconnect
+     */
+    void reopen();
+
+    /*
+     * connections at most, [1, TBNET_POOL_MAX_CONNECTIONS], connections
+     * beyond a smaller size are closed
+     */
+    void setPoolSize(int poolSize);
+
+    int getPoolSize() {
+        return _poolSize;
+    }
+
+    /*
+     * connections open
+     */
+    int getConnectionCount();
+
+    /*
+     * Connection::getOutstanding summed over the connections
+     */
+    int getOutstanding();
+
+    /*
+     * set on every connection, opened or to be opened
+     */
+    void setDefaultPacketHandler(IPacketHandler *packetHandler);
+    void setQueueLimit(int queueLimit);
+    void setQueueTimeout(int queueTimeout);
+
+    uint64_t getServerId() {
+        return _serverId;
+    }
+
+    /*
+     * latencies of the hedged requests to the server
+     */
+    LatencyHistogram *getLatency() {
+        return &_latency;
+    }
+
+private:
+    /*
+     * slot index of the calling thread
+     */
+    int getAffinitySlot();
+
+    /*
+     * the connection of slot index, connected if need be
+     *
+     * @param mayWait: wait if another thread connects the slot, else
+     *                 return NULL
+     */
+    Connection *connectSlot(int index, bool mayWait);
+
+    /*
+     * the connection of slot index with a reference, of any slot if index
+     * is -1 or the slot emptied meanwhile
+     */
+    Connection *acquire(int index, int64_t now);
+
+    /*
+     * close the connections taken out of their slots, with _cond held
+     */
+    void close(Connection **conns, int count);
+
+    /*
+     * open a connection to the server, unlocked
+     */
+    Connection *open();
+
+private:
+    struct Slot {
+        Connection *volatile _conn;
+        volatile int64_t _lastUse;
+        bool _connecting;       // with _cond held
+    };
+
+    Transport *_transport;
+    IPacketStreamer *_streamer;
+    uint64_t _serverId;
+    IPacketHandler *_packetHandler;
+    int _queueLimit;
+    int _queueTimeout;
+    volatile int _poolSize;
+    volatile int64_t _lastShrink;
+    volatile bool _closed;
+    Slot _slots[TBNET_POOL_MAX_CONNECTIONS];
+    LatencyHistogram _latency;
+    ReaderCount _readers;           // pickers reading the slots
+    tbsys::CThreadCond _cond;       // guards the slots, signaled when a connect ends
+};
+
+}
+
+#endif /*TBNET_CONNECTIONPOOL_H_*/
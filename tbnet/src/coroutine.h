@@ -0,0 +1,322 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_COROUTINE_H_
+#define TBNET_COROUTINE_H_
+
+/*
+ * optional C++20 coroutine support, header only: the library itself stays
+ * C++98, this header is empty unless the compiler implements coroutines.
+ *
+ *   CoroutineTask fanOut(Connection *a, Connection *b, CoroutineScheduler *s) {
+ *       std::vector<PacketFuture> parts;
+ *       parts.push_back(a->call(new GetRequest(key), 50));
+ *       parts.push_back(b->call(new GetRequest(key), 50));
+ *       co_await awaitAll(parts, s);
+ *       Packet *reply = co_await asyncCall(a, new SetRequest(key), 50, s);
+ *       ...
+ *   }
+ */
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <coroutine>
+#include <exception>
+#include "tbnet.h"
+#include "ThreadPool.h"
+
+namespace tbnet {
+
+/*
+ * where a suspended coroutine goes on
+ */
+class CoroutineScheduler {
+public:
+    virtual ~CoroutineScheduler() {}
+
+    /*
+     * resume handle on a thread of the scheduler
+     */
+    virtual void schedule(std::coroutine_handle<> handle) = 0;
+};
+
+/*
+ * resumes coroutines on the threads of a PacketQueueThread. the packets
+ * pushed by the application to getThread() still go to its handler, so a
+ * server adapter can queue requests and start coroutines on the same
+ * threads. coroutines still queued when the thread stops without
+ * waitFinish are never resumed.
+ */
+class PacketQueueScheduler : public CoroutineScheduler, public IPacketQueueHandler {
+
+public:
+    /*
+     * @param threadCount: threads of the queue
+     * @param handler: gets the packets the application pushes
+     * @param args: passed to handler
+     */
+    PacketQueueScheduler(int threadCount, IPacketQueueHandler *handler = NULL, void *args = NULL) {
+        _handler = handler;
+        _args = args;
+        _thread.setThreadParameter(threadCount, this, NULL);
+    }
+
+    void start() {
+        _thread.start();
+    }
+
+    void stop(bool waitFinish = false) {
+        _thread.stop(waitFinish);
+    }
+
+    void wait() {
+        _thread.wait();
+    }
+
+    PacketQueueThread *getThread() {
+        return &_thread;
+    }
+
+    void schedule(std::coroutine_handle<> handle) {
+        _thread.push(new ResumePacket(handle));
+    }
+
+    /*
+     * IPacketQueueHandler
+     */
+    bool handlePacketQueue(Packet *packet, void *args) {
+        ResumePacket *resume = dynamic_cast<ResumePacket*>(packet);
+        if (resume != NULL) {
+            resume->_handle.resume();
+            return true;
+        }
+        if (_handler == NULL) {
+            return true;
+        }
+        return _handler->handlePacketQueue(packet, _args);
+    }
+
+private:
+    /*
+     * a coroutine to resume, never sent
+     */
+    class ResumePacket : public Packet {
+    public:
+        explicit ResumePacket(std::coroutine_handle<> handle) : _handle(handle) {}
+
+        bool encode(DataBuffer *output) {
+            UNUSED(output);
+            return false;
+        }
+
+        bool decode(DataBuffer *input, PacketHeader *header) {
+            UNUSED(input);
+            UNUSED(header);
+            return false;
+        }
+
+        std::coroutine_handle<> _handle;
+    };
+
+private:
+    PacketQueueThread _thread;
+    IPacketQueueHandler *_handler;
+    void *_args;
+};
+
+/*
+ * resumes coroutines on the workers of a tbutil::ThreadPool. a coroutine
+ * the pool refuses (destroyed, queue full) is resumed on the calling
+ * thread.
+ */
+class ThreadPoolScheduler : public CoroutineScheduler {
+
+public:
+    explicit ThreadPoolScheduler(tbutil::ThreadPool *pool) : _pool(pool) {}
+
+    void schedule(std::coroutine_handle<> handle) {
+        ResumeItem *item = new ResumeItem(handle);
+        if (_pool->execute(item) != 0) {
+            TBSYS_LOG(WARN, "thread pool refused a coroutine, resumed in place");
+            delete item;
+            handle.resume();
+        }
+    }
+
+private:
+    class ResumeItem : public tbutil::ThreadPoolWorkItem {
+    public:
+        explicit ResumeItem(std::coroutine_handle<> handle) : _handle(handle) {}
+
+        void execute(const tbutil::ThreadPool *pool) {
+            UNUSED(pool);
+            _handle.resume();
+        }
+
+        void destroy() {
+            delete this;
+        }
+
+    private:
+        std::coroutine_handle<> _handle;
+    };
+
+private:
+    tbutil::ThreadPool *_pool;
+};
+
+/*
+ * co_await on a PacketFuture: the reply, or the ControlPacket the future
+ * completed with. the coroutine goes on on scheduler, or, with NULL, on
+ * the thread completing the future - an I/O or the timeout thread, which
+ * must not block.
+ */
+class PacketAwaiter : public IFutureHandler {
+
+public:
+    PacketAwaiter(const PacketFuture &future, CoroutineScheduler *scheduler)
+        : _future(future), _scheduler(scheduler), _step(0) {}
+
+    bool await_ready() {
+        return _future.isReady();
+    }
+
+    /*
+     * the future may complete before onReady() returns, the second of the
+     * two to get here resumes
+     */
+    bool await_suspend(std::coroutine_handle<> handle) {
+        _handle = handle;
+        _future.onReady(this);
+        return __sync_bool_compare_and_swap(&_step, 0, 1);
+    }
+
+    /*
+     * the packet belongs to the future, it lives as long as a copy of it
+     */
+    Packet *await_resume() {
+        return _future.getPacket();
+    }
+
+    /*
+     * IFutureHandler
+     */
+    void handleFuture(PacketFuture *future, void *args) {
+        UNUSED(future);
+        UNUSED(args);
+        if (__sync_bool_compare_and_swap(&_step, 0, 2)) {
+            return;     // not suspended yet, await_suspend goes on
+        }
+        if (_scheduler != NULL) {
+            _scheduler->schedule(_handle);
+        } else {
+            _handle.resume();
+        }
+    }
+
+private:
+    PacketFuture _future;
+    CoroutineScheduler *_scheduler;
+    std::coroutine_handle<> _handle;
+    volatile int _step;     // 1 - suspended, 2 - completed first
+};
+
+/*
+ * co_await on a move to scheduler
+ */
+class ScheduleAwaiter {
+
+public:
+    explicit ScheduleAwaiter(CoroutineScheduler *scheduler) : _scheduler(scheduler) {}
+
+    bool await_ready() {
+        return (_scheduler == NULL);
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        _scheduler->schedule(handle);
+    }
+
+    void await_resume() {}
+
+private:
+    CoroutineScheduler *_scheduler;
+};
+
+/*
+ * return type of a coroutine nobody waits for: it starts right away and
+ * frees itself when it returns
+ */
+class CoroutineTask {
+
+public:
+    struct promise_type {
+        CoroutineTask get_return_object() {
+            return CoroutineTask();
+        }
+
+        std::suspend_never initial_suspend() {
+            return std::suspend_never();
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return std::suspend_never();
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            TBSYS_LOG(ERROR, "exception escaped a coroutine");
+            std::terminate();
+        }
+    };
+};
+
+/*
+ * Connection::call, awaited
+ */
+inline PacketAwaiter asyncCall(Connection *conn, Packet *packet, int timeout = 0,
+                               CoroutineScheduler *scheduler = NULL) {
+    return PacketAwaiter(conn->call(packet, timeout), scheduler);
+}
+
+/*
+ * ConnectionManager::call, awaited
+ */
+inline PacketAwaiter asyncCall(ConnectionManager *manager, uint64_t serverId, Packet *packet,
+                               int timeout = 0, CoroutineScheduler *scheduler = NULL) {
+    return PacketAwaiter(manager->call(serverId, packet, timeout), scheduler);
+}
+
+/*
+ * PacketFuture::whenAll, awaited. it returns NULL, the replies are in
+ * the futures.
+ */
+inline PacketAwaiter awaitAll(const std::vector<PacketFuture> &futures,
+                              CoroutineScheduler *scheduler = NULL) {
+    return PacketAwaiter(PacketFuture::whenAll(futures), scheduler);
+}
+
+/*
+ * go on on a thread of scheduler
+ */
+inline ScheduleAwaiter resumeOn(CoroutineScheduler *scheduler) {
+    return ScheduleAwaiter(scheduler);
+}
+
+}
+
+#endif
+
+#endif /*TBNET_COROUTINE_H_*/
@@ -42,7 +42,7 @@ public:
      */
     void destroy() {
         if (_pstart) {
-            free(_pstart);
+            TBNET_BUFFER_POOL.deallocate(_pstart, static_cast<int32_t>(_pend - _pstart));
             _pend = _pfree = _pdata = _pstart = NULL;
         }
     }
@@ -85,10 +85,18 @@ public:
         _pdata = _pfree = _pstart;
     }
 
+    /*
+     * an empty buffer goes back to the pool, a large one holding little is
+     * copied into a MAX_BUFFER_SIZE block
+     */
     void shrink() {
         if (_pstart == NULL) {
             return;
         }
+        if (_pfree == _pdata) {
+            destroy();
+            return;
+        }
         if ((_pend - _pstart) <= MAX_BUFFER_SIZE || (_pfree - _pdata) > MAX_BUFFER_SIZE) {
             return;
         }
@@ -96,17 +104,18 @@ public:
         int dlen = static_cast<int32_t>(_pfree - _pdata);
         if (dlen < 0) dlen = 0;
 
-        unsigned char *newbuf = (unsigned char*)malloc(MAX_BUFFER_SIZE);
+        int bufsize;
+        unsigned char *newbuf = (unsigned char*)TBNET_BUFFER_POOL.allocate(MAX_BUFFER_SIZE, &bufsize);
         assert(newbuf != NULL);
 
         if (dlen > 0) {
             memcpy(newbuf, _pdata, dlen);
         }
-        free(_pstart);
+        TBNET_BUFFER_POOL.deallocate(_pstart, static_cast<int32_t>(_pend - _pstart));
 
         _pdata = _pstart = newbuf;
         _pfree = _pstart + dlen;
-        _pend = _pstart + MAX_BUFFER_SIZE;
+        _pend = _pstart + bufsize;
 
         return;
     }
@@ -410,9 +419,8 @@ private:
      */
     inline void expand(int need) {
         if (_pstart == NULL) {
-            int len = 256;
-            while (len < need) len <<= 1;
-            _pfree = _pdata = _pstart = (unsigned char*)malloc(len);
+            int len;
+            _pfree = _pdata = _pstart = (unsigned char*)TBNET_BUFFER_POOL.allocate(need > 256 ? need : 256, &len);
             _pend = _pstart + len;
         } else if (_pend - _pfree < need) { // ռ䲻
             int flen = static_cast<int32_t>((_pend - _pfree) + (_pdata - _pstart));
@@ -423,7 +431,7 @@ private:
                 while (bufsize - dlen < need)
                     bufsize <<= 1;
 
-                unsigned char *newbuf = (unsigned char *)malloc(bufsize);
+                unsigned char *newbuf = (unsigned char *)TBNET_BUFFER_POOL.allocate(bufsize, &bufsize);
                 if (newbuf == NULL)
                 {
                   TBSYS_LOG(ERROR, "expand data buffer failed, length: %d", bufsize);
@@ -432,7 +440,7 @@ private:
                 if (dlen > 0) {
                     memcpy(newbuf, _pdata, dlen);
                 }
-                free(_pstart);
+                TBNET_BUFFER_POOL.deallocate(_pstart, static_cast<int32_t>(_pend - _pstart));
 
                 _pdata = _pstart = newbuf;
                 _pfree = _pstart + dlen;
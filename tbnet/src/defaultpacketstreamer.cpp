@@ -118,7 +118,8 @@ bool DefaultPacketStreamer::encode(Packet *packet, DataBuffer *output) {
         return false;
     }
     // 
-    header->_dataLen = output->getDataLen() - oldLen - headerSize;
+    const char *payload = NULL;
+    header->_dataLen = output->getDataLen() - oldLen - headerSize + packet->getPayload(payload);
     // հѳȻصbuffer
     if (dataLenOffset >= 0) {
         unsigned char *ptr = (unsigned char *)(output->getData() + dataLenOffset);
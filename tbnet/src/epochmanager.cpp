@@ -0,0 +1,156 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+/*
+ * constructor
+ */
+EpochManager::EpochManager(int reserved, int workers) {
+    _epoch = 1;
+    _reserved = (reserved > 0 ? reserved : 0);
+    _slotCount = _reserved + (workers > 0 ? workers : 0);
+    _slots = new Slot[_slotCount > 0 ? _slotCount : 1];
+    for (int i = 0; i < _slotCount; i++) {
+        _slots[i]._epoch = 0;
+        _slots[i]._used = (i < _reserved ? 1 : 0);
+    }
+}
+
+/*
+ * destructor
+ */
+EpochManager::~EpochManager() {
+    delete[] _slots;
+    _slots = NULL;
+}
+
+/*
+ * take a free worker slot
+ */
+int EpochManager::registerThread() {
+    for (int i = _reserved; i < _slotCount; i++) {
+        if (_slots[i]._used == 0 && __sync_bool_compare_and_swap(&_slots[i]._used, 0, 1)) {
+            quiescent(i);
+            return i;
+        }
+    }
+    TBSYS_LOG(ERROR, "no epoch slot left, %d in use", _slotCount);
+    return -1;
+}
+
+/*
+ * give a worker slot back
+ */
+void EpochManager::unregisterThread(int id) {
+    if (id < _reserved || id >= _slotCount) {
+        return;
+    }
+    offline(id);
+    __sync_lock_release(&_slots[id]._used);
+}
+
+/*
+ * quiescent point, the store has to be visible before the thread reads
+ * any shared pointer again
+ */
+void EpochManager::quiescent(int id) {
+    if (id < 0 || id >= _slotCount) {
+        return;
+    }
+    _slots[id]._epoch = _epoch;
+    __sync_synchronize();
+}
+
+/*
+ * offline until the next quiescent point
+ */
+void EpochManager::offline(int id) {
+    if (id < 0 || id >= _slotCount) {
+        return;
+    }
+    __sync_synchronize();
+    _slots[id]._epoch = 0;
+}
+
+/*
+ * the oldest online epoch, the current one if there is none; id has to be
+ * stored before the caller lets the pointer go
+ */
+void EpochManager::hold(int id) {
+    if (id < 0 || id >= _slotCount) {
+        return;
+    }
+    int64_t oldest = _epoch;
+    for (int i = 0; i < _slotCount; i++) {
+        int64_t e = _slots[i]._epoch;
+        if (e != 0 && e < oldest) {
+            oldest = e;
+        }
+    }
+    _slots[id]._epoch = oldest;
+    __sync_synchronize();
+}
+
+/*
+ * take over the epoch of another slot
+ */
+void EpochManager::inherit(int id, int from) {
+    if (id < 0 || id >= _slotCount || from < 0 || from >= _slotCount) {
+        return;
+    }
+    int64_t e = _slots[from]._epoch;
+    int64_t mine = _slots[id]._epoch;
+    if (e != 0 && (mine == 0 || e < mine)) {
+        _slots[id]._epoch = e;
+        __sync_synchronize();
+    }
+}
+
+/*
+ * start a new epoch
+ */
+int64_t EpochManager::retire() {
+    return __sync_add_and_fetch(&_epoch, 1);
+}
+
+/*
+ * no online thread can still hold a pointer retired at epoch
+ */
+bool EpochManager::isSafe(int64_t epoch) {
+    __sync_synchronize();
+    for (int i = 0; i < _slotCount; i++) {
+        int64_t e = _slots[i]._epoch;
+        if (e != 0 && e < epoch) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * slot id is online below epoch
+ */
+bool EpochManager::isBehind(int id, int64_t epoch) {
+    if (id < 0 || id >= _slotCount) {
+        return false;
+    }
+    int64_t e = _slots[id]._epoch;
+    return (e != 0 && e < epoch);
+}
+
+}
@@ -0,0 +1,111 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_EPOCHMANAGER_H_
+#define TBNET_EPOCHMANAGER_H_
+
+namespace tbnet {
+
+#define TBNET_MAX_EPOCH_WORKERS 64
+
+/*
+ * quiescent-state based reclamation.
+ *
+ * every participating thread owns a slot holding the global epoch it read
+ * at its last quiescent point (a point where it holds no pointer to a
+ * retired object), or 0 while it is offline. an object retired at epoch E
+ * may be freed once no online slot is below E.
+ *
+ * slots [0, reserved) belong to fixed owners (the event loops), the others
+ * are handed out by registerThread.
+ */
+class EpochManager {
+
+public:
+    /*
+     * @param reserved: number of fixed slots
+     * @param workers: number of slots for registerThread
+     */
+    EpochManager(int reserved, int workers = TBNET_MAX_EPOCH_WORKERS);
+
+    ~EpochManager();
+
+    /*
+     * take a free worker slot, the thread is online from now on
+     *
+     * @return slot id, -1 - no slot left
+     */
+    int registerThread();
+
+    /*
+     * give a slot from registerThread back
+     */
+    void unregisterThread(int id);
+
+    /*
+     * quiescent point: the thread holds no pointer it got before
+     */
+    void quiescent(int id);
+
+    /*
+     * the thread holds no pointer until its next quiescent(), used before
+     * blocking for long
+     */
+    void offline(int id);
+
+    /*
+     * put slot id online no later than any thread online now: a pointer
+     * one of them hands over stays protected until id is quiescent again
+     */
+    void hold(int id);
+
+    /*
+     * move slot id back to the epoch of slot from when that is older, id
+     * takes over what from protects
+     */
+    void inherit(int id, int from);
+
+    /*
+     * start a new epoch, call after the object has been unlinked
+     *
+     * @return the epoch to stamp the retired object with
+     */
+    int64_t retire();
+
+    /*
+     * an object retired at epoch may be freed
+     */
+    bool isSafe(int64_t epoch);
+
+    /*
+     * slot id is one of those keeping an object retired at epoch
+     */
+    bool isBehind(int id, int64_t epoch);
+
+private:
+    struct Slot {
+        volatile int64_t _epoch;        // 0 - offline
+        volatile int _used;
+        char _pad[64 - sizeof(int64_t) - sizeof(int)];
+    };
+
+    volatile int64_t _epoch;            // global epoch
+    Slot *_slots;
+    int _reserved;
+    int _slotCount;
+};
+}
+
+#endif /*TBNET_EPOCHMANAGER_H_*/
@@ -22,15 +22,46 @@ namespace tbnet {
  */
 EPollSocketEvent::EPollSocketEvent() {
     _iepfd = epoll_create(MAX_SOCKET_EVENTS);
+    _edgeTriggered = false;
+
+    // level-triggered, drained by getEvents
+    _wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeupfd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.data.ptr = NULL;
+        ev.events = EPOLLIN;
+        if (epoll_ctl(_iepfd, EPOLL_CTL_ADD, _wakeupfd, &ev) != 0) {
+            TBSYS_LOG(ERROR, "add wakeup eventfd failed: %s(%d)", strerror(errno), errno);
+        }
+    } else {
+        TBSYS_LOG(ERROR, "eventfd failed: %s(%d)", strerror(errno), errno);
+    }
 }
 
 /*
  * 캯
  */
 EPollSocketEvent::~EPollSocketEvent() {
+    if (_wakeupfd >= 0) {
+        close(_wakeupfd);
+    }
     close(_iepfd);
 }
 
+/*
+ * make getEvents return now
+ */
+void EPollSocketEvent::wakeUp() {
+    if (_wakeupfd >= 0) {
+        uint64_t one = 1;
+        // EAGAIN: the counter is full, a wakeup is pending anyway
+        if (write(_wakeupfd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            TBSYS_LOG(WARN, "wakeup failed: %s(%d)", strerror(errno), errno);
+        }
+    }
+}
+
 /*
  * Socket¼
  *
@@ -53,6 +84,9 @@ bool EPollSocketEvent::addEvent(Socket *socket, bool enableRead, bool enableWrit
     if (enableWrite) {
         ev.events |= EPOLLOUT;
     }
+    if (_edgeTriggered) {
+        ev.events |= EPOLLET;
+    }
 
     //_mutex.lock();
     bool rc = (epoll_ctl(_iepfd, EPOLL_CTL_ADD, socket->getSocketHandle(), &ev) == 0);
@@ -83,6 +117,9 @@ bool EPollSocketEvent::setEvent(Socket *socket, bool enableRead, bool enableWrit
     if (enableWrite) {
         ev.events |= EPOLLOUT;
     }
+    if (_edgeTriggered) {
+        ev.events |= EPOLLET;
+    }
 
     //_mutex.lock();
     bool rc = (epoll_ctl(_iepfd, EPOLL_CTL_MOD, socket->getSocketHandle(), &ev) == 0);
@@ -137,6 +174,11 @@ int EPollSocketEvent::getEvents(int timeout, IOEvent *ioevents, int cnt) {
     // events¼תIOEvent¼
     for (int i = 0; i < res; i++) {
         ioevents[i]._ioc = (IOComponent*)events[i].data.ptr;
+        if (ioevents[i]._ioc == NULL) { // wakeup eventfd, nothing else to report
+            uint64_t value;
+            while (read(_wakeupfd, &value, sizeof(value)) > 0) ;
+            continue;
+        }
         if (events[i].events & (EPOLLERR | EPOLLHUP)) {
             ioevents[i]._errorOccurred = true;
         }
@@ -69,8 +69,28 @@ public:
      */
     int getEvents(int timeout, IOEvent *events, int cnt);
 
+    /*
+     * register sockets with EPOLLET from now on, set before any socket is
+     * added
+     */
+    bool setEdgeTriggered(bool on) {
+        _edgeTriggered = on;
+        return true;
+    }
+
+    bool isEdgeTriggered() {
+        return _edgeTriggered;
+    }
+
+    /*
+     * make getEvents return now: the wakeup eventfd turns readable
+     */
+    void wakeUp();
+
 private:
+    int _wakeupfd;    // eventfd, registered with a NULL ioc
     int _iepfd;    // epollfd
+    bool _edgeTriggered;    // EPOLLET
 //    tbsys::CThreadMutex _mutex;  // fd
 };
 }
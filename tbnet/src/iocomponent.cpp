@@ -29,9 +29,15 @@ IOComponent::IOComponent(Transport *owner, Socket *socket) {
     atomic_set(&_refcount, 0);
     _state = TBNET_UNCONNECTED; // 
     _autoReconn = false; // ҪԶ
+    _loop = NULL;
     _prev = _next = NULL;
     _lastUseTime = tbsys::CTimeUtil::getTime();
     _inUsed = false;
+    _retireEpoch = 0;
+    _retireTime = 0;
+    _handedOut = false;
+    _readPending = _writePending = _readyQueued = false;
+    _writeOn = false;
 }
 
 /*
@@ -67,6 +67,16 @@ public:
      */
     virtual bool handleReadEvent() = 0;
 
+    /*
+     * an error was reported for the socket, which may just be zero copy
+     * completions waiting in its error queue
+     *
+     * @return true - handled, the socket is fine
+     */
+    virtual bool handleErrorEvent() {
+        return false;
+    }
+
     /*
      * ʱ
      *
@@ -74,6 +84,18 @@ public:
      */
     virtual void checkTimeout(int64_t now) = 0;
 
+    /*
+     * when checkTimeout has to run next, the transport only calls
+     * checkTimeout when this is due
+     *
+     * @param    now current time (us)
+     * @return   absolute time (us), TBNET_MAX_TIME - nothing to check
+     */
+    virtual int64_t getNextTimeout(int64_t now) {
+        UNUSED(now);
+        return TBNET_MAX_TIME;
+    }
+
     /*
      * õsocket
      *
@@ -94,9 +116,24 @@ public:
      * ܶд
      *
      * @param writeOn дǷ
+     *
+     * level-triggered the registered write interest is tracked, so only a
+     * change costs an epoll_ctl. edge-triggered EPOLLOUT stays registered
+     * and a MOD only kicks the loop into a write event: one kick is out
+     * until the loop takes it (writeOn false), later calls are free.
+     * callers hold the connection output lock
      */
     void enableWrite(bool writeOn) {
         if (_socketEvent) {
+            if (_socketEvent->isEdgeTriggered()) {
+                if (!writeOn || _writeOn) {
+                    _writeOn = writeOn;
+                    return; // taken, or a write event is on its way already
+                }
+            } else if (writeOn == _writeOn) {
+                return;     // already registered that way, skip the epoll_ctl
+            }
+            _writeOn = writeOn;
             _socketEvent->setEvent(_socket, true, writeOn);
         }
     }
@@ -176,6 +213,51 @@ public:
      */
     Transport *getOwner();
 
+    /*
+     * handed out without a reference, see ConnectionManager::getConnection:
+     * kept TBNET_DELETE_GRACE after its removal
+     */
+    void setHandedOut() {
+        _handedOut = true;
+    }
+
+    /*
+     * bind to an event loop before being added to the transport,
+     * NULL lets the transport pick one
+     */
+    void setLoop(EventLoop *loop) {
+        _loop = loop;
+    }
+
+    /*
+     * event loop this component is bound to
+     */
+    EventLoop *getLoop() {
+        return _loop;
+    }
+
+    /*
+     * registered edge-triggered
+     */
+    bool isEdgeTriggered() {
+        return (_socketEvent != NULL && _socketEvent->isEdgeTriggered());
+    }
+
+    /*
+     * edge-triggered: the last read stopped at its byte budget before
+     * EAGAIN, the loop has to read again without a new event
+     */
+    void setReadPending(bool on) {
+        _readPending = on;
+    }
+
+    /*
+     * edge-triggered: the last write stopped at its byte budget
+     */
+    void setWritePending(bool on) {
+        _writePending = on;
+    }
+
 protected:
     Transport *_owner;
     Socket *_socket;    // һSocketļ
@@ -185,11 +267,20 @@ protected:
     bool _autoReconn;   // Ƿ
     bool _isServer;     // ǷΪ
     bool _inUsed;       // Ƿ
+    bool _writeOn;      // EPOLLOUT registered, edge-triggered: a write event is on its way
     int64_t _lastUseTime;   // ʹõϵͳʱ
 
 private:
+    EventLoop *_loop;   // event loop this component is bound to
     IOComponent *_prev; // 
     IOComponent *_next; // 
+    TimerEntry _timeoutEntry;   // timeout / delete check on the transport wheel
+    int64_t _retireEpoch;       // epoch it was removed at
+    int64_t _retireTime;        // us, when it was removed
+    bool _handedOut;            // handed out without a reference
+    bool _readPending;          // read budget ran out
+    bool _writePending;         // write budget ran out
+    bool _readyQueued;          // on the ready list of its loop
 };
 }
 
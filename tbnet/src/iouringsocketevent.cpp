@@ -0,0 +1,495 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#endif
+
+namespace tbnet {
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+// user_data of the requests: sockets carry (fd + 1, generation)
+#define TBNET_URING_UD_IGNORE 0ULL
+#define TBNET_URING_UD_WAKEUP 1ULL
+#define TBNET_URING_UD(fd, gen) (((static_cast<uint64_t>(fd) + 1) << 32) | (gen))
+
+/*
+ * constructor
+ */
+IOUringSocketEvent::IOUringSocketEvent() {
+    _ringfd = -1;
+    _wakeupfd = -1;
+    _edgeTriggered = false;
+    _ring = _sqes = _cqes = NULL;
+    _ringSize = _sqesSize = 0;
+    _sqHead = _sqTail = _cqHead = _cqTail = NULL;
+    _sqArray = NULL;
+    _sqMask = _sqEntries = _cqMask = 0;
+    _loopStarted = false;
+}
+
+/*
+ * destructor
+ */
+IOUringSocketEvent::~IOUringSocketEvent() {
+    if (_sqes != NULL) {
+        munmap(_sqes, _sqesSize);
+    }
+    if (_ring != NULL) {
+        munmap(_ring, _ringSize);
+    }
+    if (_ringfd >= 0) {
+        close(_ringfd);
+    }
+    if (_wakeupfd >= 0) {
+        close(_wakeupfd);
+    }
+}
+
+/*
+ * set the ring up, needs a kernel that never drops completions, takes a
+ * timeout in io_uring_enter and maps both rings at once (5.11+), and has
+ * multishot polls (5.13+). the last has no feature bit: the multishot
+ * poll of the wakeup eventfd fails right away without it
+ */
+bool IOUringSocketEvent::init() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _ringfd = static_cast<int>(syscall(__NR_io_uring_setup, TBNET_URING_ENTRIES, &params));
+    if (_ringfd < 0) {
+        TBSYS_LOG(WARN, "io_uring_setup failed: %s(%d)", strerror(errno), errno);
+        return false;
+    }
+    unsigned need = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_SINGLE_MMAP;
+    if ((params.features & need) != need) {
+        TBSYS_LOG(WARN, "io_uring lacks features: %x", params.features);
+        return false;
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    _ringSize = (sqSize > cqSize ? sqSize : cqSize);
+    void *ring = mmap(NULL, _ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      _ringfd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        TBSYS_LOG(WARN, "mmap io_uring failed: %s(%d)", strerror(errno), errno);
+        return false;
+    }
+    _ring = ring;
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      _ringfd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        TBSYS_LOG(WARN, "mmap io_uring sqes failed: %s(%d)", strerror(errno), errno);
+        return false;
+    }
+    _sqes = sqes;
+
+    char *base = static_cast<char*>(_ring);
+    _sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    _sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    _sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    _sqEntries = params.sq_entries;
+    _cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    _cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    _cqes = base + params.cq_off.cqes;
+
+    _wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeupfd < 0) {
+        TBSYS_LOG(WARN, "eventfd failed: %s(%d)", strerror(errno), errno);
+        return false;
+    }
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*>(getSqe());
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = _wakeupfd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = TBNET_URING_UD_WAKEUP;
+    __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+    if (enter(1, 0, 0, 0) < 0 || (enter(0, 0, IORING_ENTER_GETEVENTS, 0) < 0 && errno != ETIME)) {
+        TBSYS_LOG(WARN, "io_uring_enter failed: %s(%d)", strerror(errno), errno);
+        return false;
+    }
+    unsigned head = *_cqHead;
+    unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head ++) {
+        struct io_uring_cqe *cqe = static_cast<struct io_uring_cqe*>(_cqes) + (head & _cqMask);
+        if (cqe->user_data == TBNET_URING_UD_WAKEUP && cqe->res < 0) {
+            TBSYS_LOG(WARN, "io_uring lacks multishot poll: %s(%d)", strerror(-cqe->res), -cqe->res);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * add socket
+ */
+bool IOUringSocketEvent::addEvent(Socket *socket, bool enableRead, bool enableWrite) {
+    return setEvents(socket, (enableRead ? POLLIN : 0) | (enableWrite ? POLLOUT : 0), true);
+}
+
+/*
+ * change the events of socket
+ */
+bool IOUringSocketEvent::setEvent(Socket *socket, bool enableRead, bool enableWrite) {
+    return setEvents(socket, (enableRead ? POLLIN : 0) | (enableWrite ? POLLOUT : 0), false);
+}
+
+/*
+ * remove socket, its poll request is cancelled with the next submission
+ */
+bool IOUringSocketEvent::removeEvent(Socket *socket) {
+    int fd = socket->getSocketHandle();
+    if (fd < 0) {
+        return false;
+    }
+    _mutex.lock();
+    if (fd >= static_cast<int>(_regs.size()) || _regs[fd]._ioc == NULL) {
+        _mutex.unlock();
+        return false;
+    }
+    Registration *reg = &_regs[fd];
+    cancelPoll(fd, reg);
+    reg->_ioc = NULL;
+    reg->_events = 0;
+    _mutex.unlock();
+    if (!inLoopThread()) {
+        wakeUp();
+    }
+    return true;
+}
+
+/*
+ * (re)register socket with events, a changed poll request is cancelled and
+ * armed again under a new generation. edge-triggered it is armed again
+ * unchanged too: like EPOLL_CTL_MOD the new poll reports what the socket
+ * is ready for right now, which is how IOComponent::enableWrite kicks the
+ * loop into a write event
+ */
+bool IOUringSocketEvent::setEvents(Socket *socket, uint32_t events, bool add) {
+    int fd = socket->getSocketHandle();
+    if (fd < 0) {
+        return false;
+    }
+    _mutex.lock();
+    if (fd >= static_cast<int>(_regs.size())) {
+        if (!add) {
+            _mutex.unlock();
+            return false;
+        }
+        Registration empty;
+        memset(&empty, 0, sizeof(empty));
+        _regs.resize(fd + 1, empty);
+    }
+    Registration *reg = &_regs[fd];
+    if (!add && reg->_ioc == NULL) {
+        _mutex.unlock();
+        return false;
+    }
+    if (reg->_ioc == socket->getIOComponent() && reg->_events == events && !_edgeTriggered) {
+        _mutex.unlock();
+        return true;
+    }
+    cancelPoll(fd, reg);
+    reg->_ioc = socket->getIOComponent();
+    reg->_events = events;
+    if (events != 0) {
+        armPoll(fd, reg);
+    }
+    _mutex.unlock();
+    if (!inLoopThread()) {
+        wakeUp();
+    }
+    return true;
+}
+
+/*
+ * queue the poll request of reg, with _mutex held
+ */
+void IOUringSocketEvent::armPoll(int fd, Registration *reg) {
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*>(getSqe());
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = reg->_events;
+    sqe->len = (_edgeTriggered ? IORING_POLL_ADD_MULTI : 0);
+    sqe->user_data = TBNET_URING_UD(fd, reg->_gen);
+    __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+    reg->_armed = true;
+}
+
+/*
+ * cancel the poll request of reg, with _mutex held. its completions are
+ * stale from now on.
+ */
+void IOUringSocketEvent::cancelPoll(int fd, Registration *reg) {
+    if (reg->_armed) {
+        struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*>(getSqe());
+        if (sqe != NULL) {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = TBNET_URING_UD(fd, reg->_gen);
+            sqe->user_data = TBNET_URING_UD_IGNORE;
+            __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+        }
+        reg->_armed = false;
+    }
+    reg->_gen ++;
+}
+
+/*
+ * next free submission entry, cleared, with _mutex held. a full queue is
+ * submitted on the spot.
+ */
+void *IOUringSocketEvent::getSqe() {
+    unsigned tail = *_sqTail;
+    if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries) {
+        enter(_sqEntries, 0, 0, 0);
+        if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries) {
+            TBSYS_LOG(ERROR, "io_uring submission queue full");
+            return NULL;
+        }
+    }
+    unsigned index = tail & _sqMask;
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*>(_sqes) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    _sqArray[index] = index;
+    return sqe;
+}
+
+/*
+ * io_uring_enter, waiting at most timeout ms (< 0 - forever) when
+ * IORING_ENTER_GETEVENTS is set
+ */
+int IOUringSocketEvent::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, int timeout) {
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if ((flags & IORING_ENTER_GETEVENTS) && timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000LL;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    flags |= IORING_ENTER_EXT_ARG;
+    return static_cast<int>(syscall(__NR_io_uring_enter, _ringfd, toSubmit, minComplete,
+                                    flags, &arg, sizeof(arg)));
+}
+
+/*
+ * turn the completions into events, with _mutex held. a level-triggered
+ * poll that is done is noted for rearm
+ */
+int IOUringSocketEvent::reap(IOEvent *events, int cnt) {
+    int n = 0;
+    unsigned head = *_cqHead;
+    unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail && n < cnt) {
+        struct io_uring_cqe *cqe = static_cast<struct io_uring_cqe*>(_cqes) + (head & _cqMask);
+        uint64_t userData = cqe->user_data;
+        int res = cqe->res;
+        bool more = ((cqe->flags & IORING_CQE_F_MORE) != 0);
+        head ++;
+
+        if (userData == TBNET_URING_UD_IGNORE) {
+            continue;
+        }
+        if (userData == TBNET_URING_UD_WAKEUP) {
+            uint64_t value;
+            while (read(_wakeupfd, &value, sizeof(value)) > 0) ;
+            if (!more) {
+                struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*>(getSqe());
+                if (sqe != NULL) {
+                    sqe->opcode = IORING_OP_POLL_ADD;
+                    sqe->fd = _wakeupfd;
+                    sqe->poll32_events = POLLIN;
+                    sqe->len = IORING_POLL_ADD_MULTI;
+                    sqe->user_data = TBNET_URING_UD_WAKEUP;
+                    __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+                }
+            }
+            continue;
+        }
+
+        int fd = static_cast<int>(userData >> 32) - 1;
+        uint32_t gen = static_cast<uint32_t>(userData);
+        if (fd < 0 || fd >= static_cast<int>(_regs.size())) {
+            continue;
+        }
+        Registration *reg = &_regs[fd];
+        if (reg->_gen != gen || reg->_ioc == NULL) { // cancelled in the meantime
+            continue;
+        }
+        if (!more) {
+            reg->_armed = false;
+        }
+
+        memset(&events[n], 0, sizeof(IOEvent));
+        events[n]._ioc = reg->_ioc;
+        if (res < 0 || (res & (POLLERR | POLLHUP)) != 0) {
+            events[n]._errorOccurred = true;
+        }
+        if (res > 0 && (res & POLLIN) != 0) {
+            events[n]._readOccurred = true;
+        }
+        if (res > 0 && (res & POLLOUT) != 0) {
+            events[n]._writeOccurred = true;
+        }
+        n ++;
+
+        // level-triggered: armed again once the loop has handled the event,
+        // a poll armed now would report it a second time
+        if (!reg->_armed && res >= 0) {
+            _rearm.push_back(fd);
+        }
+    }
+    __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+/*
+ * arm the level-triggered polls whose events the loop has handled since,
+ * unless removed or armed again in the meantime, with _mutex held
+ */
+void IOUringSocketEvent::rearm() {
+    for (size_t i = 0; i < _rearm.size(); i++) {
+        Registration *reg = &_regs[_rearm[i]];
+        if (reg->_ioc != NULL && !reg->_armed && reg->_events != 0) {
+            armPoll(_rearm[i], reg);
+        }
+    }
+    _rearm.clear();
+}
+
+/*
+ * submit the queued requests and wait for events, one syscall when nothing
+ * is ready yet. the events of the last call have been handled by now
+ */
+int IOUringSocketEvent::getEvents(int timeout, IOEvent *events, int cnt) {
+    if (!_loopStarted) {
+        _loopThread = pthread_self();
+        _loopStarted = true;
+    }
+    if (cnt > MAX_SOCKET_EVENTS) {
+        cnt = MAX_SOCKET_EVENTS;
+    }
+
+    _mutex.lock();
+    rearm();
+    int n = reap(events, cnt);
+    unsigned pending = *_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    _mutex.unlock();
+
+    if (n > 0 && pending == 0) {
+        return n;
+    }
+    int rc;
+    if (n == 0 && timeout != 0) {
+        rc = enter(pending, 1, IORING_ENTER_GETEVENTS, timeout);
+    } else {
+        rc = enter(pending, 0, 0, 0);
+    }
+    if (rc < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        return (n > 0 ? n : -1);
+    }
+    if (n == 0) {
+        _mutex.lock();
+        n = reap(events, cnt);
+        _mutex.unlock();
+    }
+    return n;
+}
+
+/*
+ * make getEvents return now
+ */
+void IOUringSocketEvent::wakeUp() {
+    if (_wakeupfd >= 0) {
+        uint64_t one = 1;
+        if (write(_wakeupfd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            TBSYS_LOG(WARN, "wakeup failed: %s(%d)", strerror(errno), errno);
+        }
+    }
+}
+
+/*
+ * submissions made here go out with the next getEvents without a wakeup
+ */
+bool IOUringSocketEvent::inLoopThread() {
+    return (_loopStarted && pthread_equal(_loopThread, pthread_self()));
+}
+
+#else
+
+/*
+ * built without <linux/io_uring.h>: init fails and the transport falls back
+ * to epoll
+ */
+IOUringSocketEvent::IOUringSocketEvent() {
+    _ringfd = -1;
+    _wakeupfd = -1;
+    _edgeTriggered = false;
+    _loopStarted = false;
+}
+
+IOUringSocketEvent::~IOUringSocketEvent() {
+}
+
+bool IOUringSocketEvent::init() {
+    return false;
+}
+
+bool IOUringSocketEvent::addEvent(Socket *socket, bool enableRead, bool enableWrite) {
+    UNUSED(socket);
+    UNUSED(enableRead);
+    UNUSED(enableWrite);
+    return false;
+}
+
+bool IOUringSocketEvent::setEvent(Socket *socket, bool enableRead, bool enableWrite) {
+    UNUSED(socket);
+    UNUSED(enableRead);
+    UNUSED(enableWrite);
+    return false;
+}
+
+bool IOUringSocketEvent::removeEvent(Socket *socket) {
+    UNUSED(socket);
+    return false;
+}
+
+int IOUringSocketEvent::getEvents(int timeout, IOEvent *events, int cnt) {
+    UNUSED(timeout);
+    UNUSED(events);
+    UNUSED(cnt);
+    return -1;
+}
+
+void IOUringSocketEvent::wakeUp() {
+}
+
+#endif
+
+}
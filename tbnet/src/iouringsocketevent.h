@@ -0,0 +1,147 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_IOURINGSOCKETEVENT_H_
+#define TBNET_IOURINGSOCKETEVENT_H_
+
+namespace tbnet {
+
+#define TBNET_URING_ENTRIES 1024
+
+/*
+ * SocketEvent on io_uring poll requests.
+ *
+ * interest changes are queued as submissions and go to the kernel together
+ * with the wait for completions, one io_uring_enter per loop iteration
+ * instead of an epoll_ctl per change. level-triggered sockets get one-shot
+ * polls that are re-armed after their event has been handled, edge-triggered
+ * ones multishot polls. submissions are made by the loop thread only, other
+ * threads queue them and wake the loop up.
+ *
+ * readiness only: what it saves are the epoll_ctl calls, a request still
+ * costs the read and the write TCPConnection makes itself. recv and send
+ * through the ring, multishot recv and registered buffers are not done,
+ * they would need a completion-based read and write path in TCPConnection
+ * in place of its synchronous one.
+ */
+class IOUringSocketEvent : public SocketEvent {
+
+public:
+    IOUringSocketEvent();
+
+    ~IOUringSocketEvent();
+
+    /*
+     * set the ring up
+     *
+     * @return false - io_uring (or a feature it needs) is missing
+     */
+    bool init();
+
+    /*
+     * add socket
+     *
+     * @param socket: the socket
+     * @param enableRead: read events
+     * @param enableWrite: write events
+     * @return true - ok
+     */
+    bool addEvent(Socket *socket, bool enableRead, bool enableWrite);
+
+    /*
+     * change the events of socket
+     *
+     * @param socket: the socket
+     * @param enableRead: read events
+     * @param enableWrite: write events
+     * @return true - ok
+     */
+    bool setEvent(Socket *socket, bool enableRead, bool enableWrite);
+
+    /*
+     * remove socket
+     *
+     * @param socket: the socket
+     * @return true - ok
+     */
+    bool removeEvent(Socket *socket);
+
+    /*
+     * submit the queued requests and wait for events
+     *
+     * @param timeout: ms
+     * @param events: event array
+     * @param cnt: size of events
+     * @return number of events, 0 - timeout
+     */
+    int getEvents(int timeout, IOEvent *events, int cnt);
+
+    bool setEdgeTriggered(bool on) {
+        _edgeTriggered = on;
+        return true;
+    }
+
+    bool isEdgeTriggered() {
+        return _edgeTriggered;
+    }
+
+    /*
+     * make getEvents return now
+     */
+    void wakeUp();
+
+private:
+    struct Registration {
+        IOComponent *_ioc;
+        uint32_t _events;       // poll events, 0 - none
+        uint32_t _gen;          // completions of older generations are stale
+        bool _armed;            // a poll request is in flight
+    };
+
+    bool setEvents(Socket *socket, uint32_t events, bool add);
+    void armPoll(int fd, Registration *reg);
+    void cancelPoll(int fd, Registration *reg);
+    void *getSqe();
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, int timeout);
+    int reap(IOEvent *events, int cnt);
+    void rearm();
+    bool inLoopThread();
+
+private:
+    int _ringfd;
+    int _wakeupfd;                  // eventfd, polled through the ring
+    bool _edgeTriggered;
+    void *_ring;                    // sq and cq rings (single mmap)
+    size_t _ringSize;
+    void *_sqes;
+    size_t _sqesSize;
+    volatile unsigned *_sqHead;
+    volatile unsigned *_sqTail;
+    unsigned *_sqArray;
+    unsigned _sqMask;
+    unsigned _sqEntries;
+    volatile unsigned *_cqHead;
+    volatile unsigned *_cqTail;
+    unsigned _cqMask;
+    void *_cqes;
+    std::vector<Registration> _regs;    // by fd
+    std::vector<int> _rearm;            // level-triggered polls done, armed by the next getEvents
+    pthread_t _loopThread;
+    volatile bool _loopStarted;
+    tbsys::CThreadMutex _mutex;         // sq and _regs
+};
+}
+
+#endif /*TBNET_IOURINGSOCKETEVENT_H_*/
@@ -0,0 +1,144 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+/*
+ * constructor
+ */
+LatencyHistogram::LatencyHistogram(int percentile) {
+    for (int i = 0; i < TBNET_HISTOGRAM_BUCKETS; i++) {
+        atomic_set(&_buckets[i], 0);
+    }
+    atomic_set(&_count, 0);
+    atomic_set(&_sinceRefresh, 0);
+    _decaying = 0;
+    _value = -1;
+    setPercentile(percentile);
+}
+
+/*
+ * count the sample, the thread filling the window halves it
+ */
+void LatencyHistogram::record(int64_t latency) {
+    atomic_inc(&_buckets[getBucket(latency)]);
+    if (atomic_add_return(1, &_count) >= TBNET_HISTOGRAM_WINDOW) {
+        decay();
+    }
+    if (atomic_add_return(1, &_sinceRefresh) >= TBNET_HISTOGRAM_REFRESH) {
+        atomic_set(&_sinceRefresh, 0);
+        _value = compute();
+    }
+}
+
+/*
+ * percentile once there are enough samples
+ */
+int64_t LatencyHistogram::getPercentile(int minSamples) {
+    if (atomic_read(&_count) < minSamples) {
+        return -1;
+    }
+    int64_t value = _value;
+    if (value < 0) { // enough samples, not computed yet
+        value = compute();
+        _value = value;
+    }
+    return value;
+}
+
+/*
+ * percentile to compute
+ */
+void LatencyHistogram::setPercentile(int percentile) {
+    if (percentile < 1) {
+        percentile = 1;
+    } else if (percentile > 99) {
+        percentile = 99;
+    }
+    _percentile = percentile;
+    _value = -1;
+}
+
+/*
+ * the power of two of latency and its next TBNET_HISTOGRAM_SUB_BITS bits
+ */
+int LatencyHistogram::getBucket(int64_t latency) {
+    uint64_t v = (latency > 0 ? static_cast<uint64_t>(latency) : 0);
+    if (v < (1 << TBNET_HISTOGRAM_SUB_BITS)) {
+        return static_cast<int>(v);
+    }
+    int shift = 63 - __builtin_clzll(v) - TBNET_HISTOGRAM_SUB_BITS;
+    int bucket = ((shift + 1) << TBNET_HISTOGRAM_SUB_BITS) +
+                 static_cast<int>((v >> shift) & ((1 << TBNET_HISTOGRAM_SUB_BITS) - 1));
+    return (bucket < TBNET_HISTOGRAM_BUCKETS ? bucket : TBNET_HISTOGRAM_BUCKETS - 1);
+}
+
+/*
+ * largest latency of the bucket
+ */
+int64_t LatencyHistogram::getBound(int bucket) {
+    if (bucket < (1 << TBNET_HISTOGRAM_SUB_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> TBNET_HISTOGRAM_SUB_BITS) - 1;
+    int64_t base = (static_cast<int64_t>(1 << TBNET_HISTOGRAM_SUB_BITS) +
+                    (bucket & ((1 << TBNET_HISTOGRAM_SUB_BITS) - 1))) << shift;
+    return base + (static_cast<int64_t>(1) << shift) - 1;
+}
+
+/*
+ * walk the buckets up to the percentile, the counts may move meanwhile
+ */
+int64_t LatencyHistogram::compute() {
+    int64_t total = 0;
+    for (int i = 0; i < TBNET_HISTOGRAM_BUCKETS; i++) {
+        total += atomic_read(&_buckets[i]);
+    }
+    if (total == 0) {
+        return -1;
+    }
+    int64_t rank = (total * _percentile + 99) / 100;
+    int64_t seen = 0;
+    for (int i = 0; i < TBNET_HISTOGRAM_BUCKETS; i++) {
+        seen += atomic_read(&_buckets[i]);
+        if (seen >= rank) {
+            return getBound(i);
+        }
+    }
+    return getBound(TBNET_HISTOGRAM_BUCKETS - 1);
+}
+
+/*
+ * halve every bucket, one thread at a time. samples recorded meanwhile
+ * may be halved or not, that much does not matter.
+ */
+void LatencyHistogram::decay() {
+    if (!__sync_bool_compare_and_swap(&_decaying, 0, 1)) {
+        return;
+    }
+    int count = 0;
+    for (int i = 0; i < TBNET_HISTOGRAM_BUCKETS; i++) {
+        int half = atomic_read(&_buckets[i]) / 2;
+        atomic_sub(half, &_buckets[i]);
+        count += atomic_read(&_buckets[i]);
+    }
+    atomic_set(&_count, count);
+    __sync_synchronize();
+    _decaying = 0;
+}
+
+}
@@ -0,0 +1,89 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_LATENCYHISTOGRAM_H_
+#define TBNET_LATENCYHISTOGRAM_H_
+
+namespace tbnet {
+
+#define TBNET_HISTOGRAM_SUB_BITS    2           // 4 buckets per power of two, within 25%
+#define TBNET_HISTOGRAM_BUCKETS     (64 << TBNET_HISTOGRAM_SUB_BITS)
+#define TBNET_HISTOGRAM_WINDOW      4096        // samples, beyond it the counts are halved
+#define TBNET_HISTOGRAM_REFRESH     64          // samples between two percentile updates
+
+/*
+ * histogram of latencies (us) with log sized buckets, recording is lock
+ * free. old samples fade: the counts are halved whenever the window is
+ * full, so the percentile follows the recent latencies.
+ */
+class LatencyHistogram {
+
+public:
+    /*
+     * @param percentile: percentile getPercentile returns, (0, 100)
+     */
+    LatencyHistogram(int percentile = 95);
+
+    /*
+     * add a sample
+     */
+    void record(int64_t latency);
+
+    /*
+     * the percentile of the samples, updated every few samples
+     *
+     * @return us, -1 - fewer than minSamples samples
+     */
+    int64_t getPercentile(int minSamples);
+
+    void setPercentile(int percentile);
+
+    /*
+     * samples counted now
+     */
+    int getCount() {
+        return atomic_read(&_count);
+    }
+
+private:
+    static int getBucket(int64_t latency);
+
+    /*
+     * upper bound of the bucket
+     */
+    static int64_t getBound(int bucket);
+
+    /*
+     * compute the percentile
+     */
+    int64_t compute();
+
+    /*
+     * halve the counts
+     */
+    void decay();
+
+private:
+    atomic_t _buckets[TBNET_HISTOGRAM_BUCKETS];
+    atomic_t _count;
+    atomic_t _sinceRefresh;
+    volatile int _decaying;
+    volatile int _percentile;
+    volatile int64_t _value;            // last computed, -1 - none
+};
+
+}
+
+#endif /*TBNET_LATENCYHISTOGRAM_H_*/
@@ -0,0 +1,57 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_LOOPTASK_H_
+#define TBNET_LOOPTASK_H_
+
+namespace tbnet {
+
+/*
+ * a piece of work run on an I/O thread, see Transport::runInLoop and
+ * Transport::runAfter. the transport owns the task from then on: free() is
+ * called after runTask(), or instead of it when the transport stops first.
+ * a task is queued or scheduled once at a time.
+ */
+class LoopTask {
+    friend class EventLoop;
+    friend class Transport;
+
+public:
+    LoopTask() {
+        _next = NULL;
+    }
+
+    virtual ~LoopTask() {}
+
+    /*
+     * runs on the I/O thread of the event loop
+     */
+    virtual void runTask() = 0;
+
+    /*
+     * the transport is done with the task, a task that is reused overrides
+     * this and keeps ownership
+     */
+    virtual void free() {
+        delete this;
+    }
+
+private:
+    LoopTask *_next;            // task queue of the loop
+    TimerEntry _timerEntry;     // runAfter
+};
+}
+
+#endif /*TBNET_LOOPTASK_H_*/
@@ -19,6 +19,7 @@
 namespace tbnet {
 
 #define TBNET_PACKET_FLAG 0x416e4574  // AnEt
+#define TBNET_PACKET_HEADER_SIZE 16   // flag, chid, pcode and dataLen on the wire
 
 class PacketHeader {
 public:
@@ -29,6 +30,7 @@ public:
 
 class Packet {
     friend class PacketQueue;
+    friend class AtomicPacketQueue;
 
 public:
     /*
@@ -107,6 +109,42 @@ public:
      */
     virtual bool encode(DataBuffer *output) = 0;
 
+    /*
+     * payload written out right after what encode() produced, without
+     * being copied into the output buffer: large values go from the
+     * packet's own memory to the socket (writev). the memory has to stay
+     * valid and unchanged until the packet is freed, which happens once it
+     * has been written. DefaultPacketStreamer counts it in _dataLen.
+     *
+     * @param data: set to the payload
+     * @return payload length, 0 - none (default)
+     */
+    virtual int getPayload(const char *&data) {
+        data = NULL;
+        return 0;
+    }
+
+    /*
+     * bytes counted against the byte limit of the output queue while the
+     * packet waits in it, the header plus the payload by default. override
+     * it when encode writes a lot, it must not change while queued.
+     */
+    virtual int getQueueSize() {
+        const char *data = NULL;
+        return TBNET_PACKET_HEADER_SIZE + getPayload(data);
+    }
+
+    /*
+     * a new packet to send the same request again, with the same pcode
+     * and content. requests that may be sent twice (idempotent ones)
+     * override it to be hedged, see ConnectionManager::hedgedCall.
+     *
+     * @return NULL - not to be sent again (default)
+     */
+    virtual Packet *clone() {
+        return NULL;
+    }
+
     /*
      * ⿪
      *
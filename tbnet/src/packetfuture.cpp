@@ -0,0 +1,327 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+/*
+ * result shared by the handles of a future. it is the packet handler of
+ * the channel of a call and the callback of the parts of a whenAll,
+ * each holding a reference until it has been called.
+ */
+class PacketFuture::State : public IPacketHandler, public IFutureHandler {
+
+public:
+    /*
+     * @param pending: parts a whenAll waits for
+     */
+    State(int pending) {
+        atomic_set(&_ref, 0);
+        atomic_set(&_pending, pending);
+        _packet = NULL;
+        _ready = false;
+    }
+
+    /*
+     * frees the reply, ControlPacket::free does nothing
+     */
+    ~State() {
+        if (_packet != NULL) {
+            _packet->free();
+        }
+    }
+
+    void addRef() {
+        atomic_inc(&_ref);
+    }
+
+    void release() {
+        if (atomic_dec_return(&_ref) == 0) {
+            delete this;
+        }
+    }
+
+    /*
+     * set the result and run the callbacks, the first call wins
+     */
+    void complete(Packet *packet) {
+        std::vector<Callback> handlers;
+        _cond.lock();
+        if (_ready) {
+            _cond.unlock();
+            if (packet != NULL) {
+                packet->free();
+            }
+            return;
+        }
+        _packet = packet;
+        _ready = true;
+        handlers.swap(_handlers);
+        _cond.broadcast();
+        _cond.unlock();
+
+        if (!handlers.empty()) {
+            PacketFuture future(this);
+            for (size_t i = 0; i < handlers.size(); i++) {
+                handlers[i].first->handleFuture(&future, handlers[i].second);
+            }
+        }
+    }
+
+    /*
+     * the channel of the call is done: reply, timeout or disconnect
+     */
+    HPRetCode handlePacket(Packet *packet, void *args) {
+        UNUSED(args);
+        complete(packet);
+        release();
+        return IPacketHandler::FREE_CHANNEL;
+    }
+
+    /*
+     * a part of a whenAll is ready
+     */
+    void handleFuture(PacketFuture *future, void *args) {
+        UNUSED(future);
+        UNUSED(args);
+        if (atomic_dec_return(&_pending) == 0) {
+            complete(NULL);
+        }
+        release();
+    }
+
+public:
+    typedef std::pair<IFutureHandler*, void*> Callback;
+
+    atomic_t _ref;
+    atomic_t _pending;                      // whenAll parts not ready yet
+    Packet *_packet;
+    volatile bool _ready;
+    std::vector<Callback> _handlers;    // run once ready
+    tbsys::CThreadCond _cond;
+};
+
+/*
+ * runs the handler of then once the future it waits for is ready and
+ * completes the future then made, deleted with that
+ */
+class PacketFuture::Continuation : public IFutureHandler {
+
+public:
+    Continuation(State *next, IContinuationHandler *handler, void *args) {
+        _next = next;
+        _next->addRef();
+        _handler = handler;
+        _args = args;
+    }
+
+    void handleFuture(PacketFuture *future, void *args) {
+        UNUSED(args);
+        Packet *packet = future->getPacket();
+        Packet *result = packet;    // an error passes on
+        if (packet == NULL || packet->isRegularPacket()) {
+            result = _handler->handleContinuation(future, _args);
+        }
+        _next->complete(result);
+        _next->release();
+        delete this;
+    }
+
+private:
+    State *_next;
+    IContinuationHandler *_handler;
+    void *_args;
+};
+
+/*
+ * an empty future
+ */
+PacketFuture::PacketFuture() {
+    _state = NULL;
+}
+
+/*
+ * a future ready with packet
+ */
+PacketFuture::PacketFuture(Packet *packet) {
+    _state = new State(0);
+    _state->addRef();
+    _state->complete(packet);
+}
+
+/*
+ * another handle to state
+ */
+PacketFuture::PacketFuture(State *state) {
+    _state = state;
+    if (_state != NULL) {
+        _state->addRef();
+    }
+}
+
+PacketFuture::PacketFuture(const PacketFuture &other) {
+    _state = other._state;
+    if (_state != NULL) {
+        _state->addRef();
+    }
+}
+
+PacketFuture &PacketFuture::operator=(const PacketFuture &other) {
+    if (other._state != NULL) {
+        other._state->addRef();
+    }
+    if (_state != NULL) {
+        _state->release();
+    }
+    _state = other._state;
+    return *this;
+}
+
+PacketFuture::~PacketFuture() {
+    if (_state != NULL) {
+        _state->release();
+    }
+}
+
+/*
+ * completed
+ */
+bool PacketFuture::isReady() {
+    return (_state != NULL && _state->_ready);
+}
+
+/*
+ * wait until the future is ready
+ */
+bool PacketFuture::wait(int timeout) {
+    if (_state == NULL) {
+        return false;
+    }
+    if (_state->_ready) {
+        return true;
+    }
+    int64_t end = tbsys::CTimeUtil::getTime() + static_cast<int64_t>(timeout) * 1000;
+    _state->_cond.lock();
+    while (!_state->_ready) {
+        if (timeout <= 0) {
+            _state->_cond.wait();
+            continue;
+        }
+        int64_t left = end - tbsys::CTimeUtil::getTime();
+        if (left <= 0) {
+            break;
+        }
+        _state->_cond.wait(static_cast<int>((left + 999) / 1000));
+    }
+    bool ready = _state->_ready;
+    _state->_cond.unlock();
+    return ready;
+}
+
+/*
+ * wait, then the result
+ */
+Packet *PacketFuture::get(int timeout) {
+    if (!wait(timeout)) {
+        return NULL;
+    }
+    return getPacket();
+}
+
+/*
+ * the result, NULL - not ready
+ */
+Packet *PacketFuture::getPacket() {
+    if (!isReady()) {
+        return NULL;
+    }
+    __sync_synchronize();   // _packet is set before _ready
+    return _state->_packet;
+}
+
+/*
+ * register handler to be called once the future is ready
+ */
+void PacketFuture::onReady(IFutureHandler *handler, void *args) {
+    if (_state == NULL || handler == NULL) {
+        return;
+    }
+    _state->_cond.lock();
+    if (!_state->_ready) {
+        _state->_handlers.push_back(State::Callback(handler, args));
+        _state->_cond.unlock();
+        return;
+    }
+    _state->_cond.unlock();
+    handler->handleFuture(this, args);
+}
+
+/*
+ * a future completed with what handler makes of the result
+ */
+PacketFuture PacketFuture::then(IContinuationHandler *handler, void *args) {
+    if (_state == NULL || handler == NULL) {
+        return PacketFuture();
+    }
+    State *next = new State(0);
+    PacketFuture future(next);
+    onReady(new Continuation(next, handler, args));
+    return future;
+}
+
+/*
+ * a future ready once every one of futures is
+ */
+PacketFuture PacketFuture::whenAll(const std::vector<PacketFuture> &futures) {
+    State *state = new State(1);    // held until every part is registered
+    PacketFuture all(state);
+    for (size_t i = 0; i < futures.size(); i++) {
+        PacketFuture part = futures[i];
+        if (!part.isValid()) {
+            continue;
+        }
+        atomic_inc(&state->_pending);
+        state->addRef();
+        part.onReady(state);
+    }
+    state->addRef();
+    state->handleFuture(NULL, NULL);
+    return all;
+}
+
+/*
+ * a future to be completed through retainHandler
+ */
+PacketFuture PacketFuture::create() {
+    return PacketFuture(new State(0));
+}
+
+/*
+ * the handler of the channel of a call
+ */
+IPacketHandler *PacketFuture::retainHandler() {
+    _state->addRef();
+    return _state;
+}
+
+/*
+ * the packet of a call could not be posted
+ */
+void PacketFuture::failHandler(Packet *packet) {
+    _state->handlePacket(packet, NULL);
+}
+
+}
@@ -0,0 +1,178 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_PACKETFUTURE_H_
+#define TBNET_PACKETFUTURE_H_
+
+namespace tbnet {
+
+/*
+ * callback of a PacketFuture, see PacketFuture::onReady
+ */
+class IFutureHandler {
+public:
+    virtual ~IFutureHandler() {}
+
+    /*
+     * the future is ready
+     *
+     * @param future: the future
+     * @param args: as passed to onReady
+     */
+    virtual void handleFuture(PacketFuture *future, void *args) = 0;
+};
+
+/*
+ * continuation of a PacketFuture, see PacketFuture::then
+ */
+class IContinuationHandler {
+public:
+    virtual ~IContinuationHandler() {}
+
+    /*
+     * the future is ready with a result that is not an error
+     *
+     * @param future: the future
+     * @param args: as passed to then
+     * @return result of the future then made: a packet it owns from now
+     *         on (not the packet of future, that stays with future), a
+     *         ControlPacket for an error, or NULL
+     */
+    virtual Packet *handleContinuation(PacketFuture *future, void *args) = 0;
+};
+
+/*
+ * result of Connection::call, completed once by the reply, the timeout or
+ * the disconnect of its channel.
+ *
+ * a PacketFuture is a handle, copies share the same result. the reply is
+ * owned by the result and freed with the last handle.
+ *
+ *   PacketFuture f = conn->call(packet, 100);
+ *   Packet *reply = f.get(200);
+ *   if (reply != NULL && reply->isRegularPacket()) ...
+ */
+class PacketFuture {
+    friend class Connection;
+    friend class ConnectionManager;
+    friend class PacketFutureTF;
+
+public:
+    /*
+     * an empty future, not valid
+     */
+    PacketFuture();
+
+    /*
+     * a future that is ready with packet, it owns a regular packet
+     */
+    explicit PacketFuture(Packet *packet);
+
+    PacketFuture(const PacketFuture &other);
+    PacketFuture &operator=(const PacketFuture &other);
+    ~PacketFuture();
+
+    /*
+     * made by call, whenAll or with a packet
+     */
+    bool isValid() {
+        return (_state != NULL);
+    }
+
+    /*
+     * completed
+     */
+    bool isReady();
+
+    /*
+     * wait until the future is ready
+     *
+     * @param timeout: ms, 0 - wait forever
+     * @return true - ready
+     */
+    bool wait(int timeout = 0);
+
+    /*
+     * wait, then the result: the reply, or a ControlPacket -
+     * TimeoutPacket if the call timed out or the connection went away,
+     * DisconnPacket if it could not be posted, BadPacket if the reply
+     * did not decode. a whenAll future has no packet.
+     *
+     * @param timeout: ms, 0 - wait forever
+     * @return the result, NULL - not ready in time
+     */
+    Packet *get(int timeout = 0);
+
+    /*
+     * the result, NULL - not ready
+     */
+    Packet *getPacket();
+
+    /*
+     * register handler to be called once the future is ready, on the
+     * thread completing it or right away on this one if it is ready
+     * already. handlers registered before that run in the order they were
+     * registered. a callback, see then for a continuation.
+     */
+    void onReady(IFutureHandler *handler, void *args = NULL);
+
+    /*
+     * a future completed with what handler makes of this one's result,
+     * handler runs where an onReady handler would. an error, a
+     * ControlPacket, skips handler and passes on as the result, so a
+     * chain of then ends with the first error.
+     *
+     *   PacketFuture f = conn->call(packet, 100).then(&decoder).then(&next);
+     *
+     * @return the new future, not valid if this one is not
+     */
+    PacketFuture then(IContinuationHandler *handler, void *args = NULL);
+
+    /*
+     * a future ready once every one of futures is, its parts keep their
+     * own results
+     */
+    static PacketFuture whenAll(const std::vector<PacketFuture> &futures);
+
+private:
+    class State;
+    class Continuation;
+
+    explicit PacketFuture(State *state);
+
+    /*
+     * a future to be completed through retainHandler
+     */
+    static PacketFuture create();
+
+    /*
+     * the handler a channel completes the future through, it holds a
+     * reference until it is called
+     */
+    IPacketHandler *retainHandler();
+
+    /*
+     * complete a future whose packet could not be posted, drops the
+     * reference retainHandler took
+     */
+    void failHandler(Packet *packet);
+
+private:
+    State *_state;
+};
+
+}
+
+#endif /*TBNET_PACKETFUTURE_H_*/
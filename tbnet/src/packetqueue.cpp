@@ -143,6 +143,48 @@ Packet *PacketQueue::getTimeoutList(int64_t now) {
     return list;
 }
 
+/*
+ * take out the packets due before now, in queue order
+ */
+Packet *PacketQueue::getExpiredList(int64_t now, int64_t *nextExpireTime) {
+    Packet *list = NULL;
+    Packet *listTail = NULL;
+    Packet *prev = NULL;
+    Packet *packet = _head;
+    int64_t next = TBNET_MAX_TIME;
+    while (packet != NULL) {
+        Packet *following = packet->_next;
+        int64_t t = packet->getExpireTime();
+        if (t == 0 || t >= now) {
+            if (t != 0 && t < next) {
+                next = t;
+            }
+            prev = packet;
+            packet = following;
+            continue;
+        }
+        if (prev == NULL) {
+            _head = following;
+        } else {
+            prev->_next = following;
+        }
+        if (_tail == packet) {
+            _tail = prev;
+        }
+        _size --;
+        packet->_next = NULL;
+        if (listTail == NULL) {
+            list = packet;
+        } else {
+            listTail->_next = packet;
+        }
+        listTail = packet;
+        packet = following;
+    }
+    *nextExpireTime = next;
+    return list;
+}
+
 /*
  * ȡpacket list
  */
@@ -66,6 +66,15 @@ public:
      */
     Packet *getTimeoutList(int64_t now);
 
+    /*
+     * take out the packets due before now wherever they are, the queue
+     * needs not be ordered by expire time
+     *
+     * @param nextExpireTime: gets the earliest expire time of the packets
+     *                        left, TBNET_MAX_TIME - none
+     */
+    Packet *getExpiredList(int64_t now, int64_t *nextExpireTime);
+
     /*
      * ȡpacket list
      */
@@ -28,6 +28,8 @@ PacketQueueThread::PacketQueueThread() : tbsys::CDefaultRunnable() {
 
     _speed_t2 = _speed_t1 = tbsys::CTimeUtil::getTime();
     _overage = 0;
+    _epochs = NULL;
+    _queueSlot = -1;
 }
 
 // 
@@ -42,11 +44,29 @@ PacketQueueThread::PacketQueueThread(int threadCount, IPacketQueueHandler *handl
 
     _speed_t2 = _speed_t1 = tbsys::CTimeUtil::getTime();
     _overage = 0;
+    _epochs = NULL;
+    _queueSlot = -1;
 }
 
 // 
 PacketQueueThread::~PacketQueueThread() {
     stop();
+    if (_epochs != NULL) {
+        _epochs->unregisterThread(_queueSlot);
+    }
+}
+
+/*
+ * the workers register a slot each and are quiescent after every packet,
+ * offline while the queue is empty. a pointer a packet carries is handed
+ * over by an online pusher: the first packet of an empty queue puts the
+ * queue slot online no later than the pusher, a worker popping a packet
+ * takes over that epoch before the queue slot goes offline.
+ */
+void PacketQueueThread::setEpochManager(EpochManager *epochs) {
+    _epochs = epochs;
+    _queueSlot = epochs->registerThread();
+    epochs->offline(_queueSlot);
 }
 
 // ̲߳
@@ -71,7 +91,7 @@ void PacketQueueThread::stop(bool waitFinish) {
 bool PacketQueueThread::push(Packet *packet, int maxQueueLen, bool block) {
     // if queue stoped or not started yet, free packet
     if (_stop || _thread == NULL) {
-        delete packet;
+        packet->free();
         return true;
     }
     // check max length of this queue
@@ -90,13 +110,16 @@ bool PacketQueueThread::push(Packet *packet, int maxQueueLen, bool block) {
         _pushcond.unlock();
         
         if (_stop) {
-            delete packet;
+            packet->free();
             return true;
         }
     }
 
     // д
     _cond.lock();
+    if (_epochs != NULL && _queue.size() == 0) {
+        _epochs->hold(_queueSlot);
+    }
     _queue.push(packet);
     _cond.unlock();
     _cond.signal();
@@ -126,6 +149,9 @@ void PacketQueueThread::pushQueue(PacketQueue &packetQueue, int maxQueueLen) {
 
     // д
     _cond.lock();
+    if (_epochs != NULL && _queue.size() == 0 && packetQueue.size() > 0) {
+        _epochs->hold(_queueSlot);
+    }
     packetQueue.moveTo(&_queue);
     _cond.unlock();
     _cond.signal();
@@ -134,8 +160,12 @@ void PacketQueueThread::pushQueue(PacketQueue &packetQueue, int maxQueueLen) {
 // Runnable ӿ
 void PacketQueueThread::run(tbsys::CThread *thread, void *arg) {
     Packet *packet = NULL;
+    int slot = (_epochs != NULL ? _epochs->registerThread() : -1);
     while (!_stop) {
         _cond.lock();
+        if (_epochs != NULL && _queue.size() == 0) { // nothing held while waiting
+            _epochs->offline(slot);
+        }
         while (!_stop && _queue.size() == 0) {
             _cond.wait();
         }
@@ -148,6 +178,7 @@ void PacketQueueThread::run(tbsys::CThread *thread, void *arg) {
         if (_waitTime>0) checkSendSpeed();
         // ȡpacket
         packet = _queue.pop();
+        popEpoch(slot);
         _cond.unlock();
 
         // push ڵ?
@@ -164,19 +195,26 @@ void PacketQueueThread::run(tbsys::CThread *thread, void *arg) {
             ret = _handler->handlePacketQueue(packet, _args);
         }
         // false, ɾ
-        if (ret) delete packet;
+        if (ret) packet->free();
+        if (_epochs != NULL) {
+            _epochs->quiescent(slot);
+        }
     }
     if (_waitFinish) { // queueеtask
       bool ret = true;
         _cond.lock();
         while (_queue.size() > 0) {
             packet = _queue.pop();
+            popEpoch(slot);
             _cond.unlock();
             ret = true;
             if (_handler) {
                 ret = _handler->handlePacketQueue(packet, _args);
             }
-            if (ret) delete packet;
+            if (ret) packet->free();
+            if (_epochs != NULL) {
+                _epochs->quiescent(slot);
+            }
 
             _cond.lock();
         }
@@ -184,10 +222,28 @@ void PacketQueueThread::run(tbsys::CThread *thread, void *arg) {
     } else {   // queueеfree
         _cond.lock();
         while (_queue.size() > 0) {
-            delete _queue.pop();
+            _queue.pop()->free();
         }
+        popEpoch(-1);
         _cond.unlock();
     }
+    if (_epochs != NULL) {
+        _epochs->unregisterThread(slot);
+    }
+}
+
+/*
+ * a packet was popped by the thread of slot, with _cond held: the thread
+ * takes over the epoch of the queue, which goes offline once empty
+ */
+void PacketQueueThread::popEpoch(int slot) {
+    if (_epochs == NULL) {
+        return;
+    }
+    _epochs->inherit(slot, _queueSlot);
+    if (_queue.size() == 0) {
+        _epochs->offline(_queueSlot);
+    }
 }
 
 // Ƿ㴦ٶ
@@ -39,6 +39,12 @@ public:
     // 
     void setThreadParameter(int threadCount, IPacketQueueHandler *handler, void *args);
 
+    /*
+     * take part in the epoch reclamation of a Transport, see
+     * Transport::getEpochManager. call before start()
+     */
+    void setEpochManager(EpochManager *epochs);
+
     // stop
     void stop(bool waitFinish = false);
 
@@ -73,6 +79,8 @@ private:
     //void PacketQueueThread::checkSendSpeed()
     void checkSendSpeed();
 
+    void popEpoch(int slot);
+
 private:
     PacketQueue _queue;
     IPacketQueueHandler *_handler;
@@ -89,6 +97,9 @@ private:
 
     // Ƿڵȴ
     bool _waiting;
+
+    EpochManager *_epochs;
+    int _queueSlot;         // epoch slot protecting what is queued
 };
 }
 
@@ -0,0 +1,76 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+/*
+ * constructor
+ */
+PooledPacketFactory::PooledPacketFactory() {
+}
+
+/*
+ * destructor
+ */
+PooledPacketFactory::~PooledPacketFactory() {
+}
+
+/*
+ * packets of pcode are built by creator, registered before the factory is
+ * handed to a streamer
+ */
+void PooledPacketFactory::registerCreator(int pcode, PacketCreator creator) {
+    if (pcode >= 0 && pcode < TBNET_POOLED_PCODE_DIRECT) {
+        if (static_cast<int>(_direct.size()) <= pcode) {
+            _direct.resize(pcode + 1, NULL);
+        }
+        _direct[pcode] = creator;
+    } else {
+        _others[pcode] = creator;
+    }
+}
+
+/*
+ * build a packet of pcode
+ */
+Packet *PooledPacketFactory::createPacket(int pcode) {
+    PacketCreator creator = NULL;
+    if (pcode >= 0 && pcode < static_cast<int>(_direct.size())) {
+        creator = _direct[pcode];
+    } else if (!_others.empty()) {
+        __gnu_cxx::hash_map<int, PacketCreator>::iterator it = _others.find(pcode);
+        if (it != _others.end()) {
+            creator = it->second;
+        }
+    }
+    if (creator == NULL) {
+        return createUnregistered(pcode);
+    }
+    Packet *packet = creator();
+    packet->setPCode(pcode);
+    return packet;
+}
+
+/*
+ * pcode has nothing registered
+ */
+Packet *PooledPacketFactory::createUnregistered(int pcode) {
+    TBSYS_LOG(WARN, "no packet registered for pcode: %d", pcode);
+    return NULL;
+}
+
+}
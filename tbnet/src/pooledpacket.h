@@ -0,0 +1,101 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_POOLEDPACKET_H_
+#define TBNET_POOLEDPACKET_H_
+
+namespace tbnet {
+
+#define TBNET_POOLED_PCODE_DIRECT 4096  // pcodes below are looked up by index
+
+/*
+ * packet whose memory comes from the buffer pool: new and delete (and so
+ * the default free()) take and give a block of the size class of the
+ * derived type from the thread cache, no malloc on the decode and dispatch
+ * path. derive from it instead of Packet, nothing else changes.
+ */
+class PooledPacket : public Packet {
+
+public:
+    static void *operator new(size_t size) {
+        int capacity;
+        return TBNET_BUFFER_POOL.allocate(static_cast<int>(size), &capacity);
+    }
+
+    /*
+     * size is that of the dynamic type, Packet has a virtual destructor
+     */
+    static void operator delete(void *ptr, size_t size) {
+        TBNET_BUFFER_POOL.deallocate(ptr, BufferPool::getCapacity(static_cast<int>(size)));
+    }
+};
+
+/*
+ * factory building packets from the constructors registered per pcode
+ *
+ *   factory.registerPacket<GetRequest>(GET_REQUEST);
+ *   factory.registerPacket<GetResponse>(GET_RESPONSE);
+ *
+ * the types are usually PooledPackets. unknown pcodes go to
+ * createUnregistered.
+ */
+class PooledPacketFactory : public IPacketFactory {
+
+public:
+    typedef Packet *(*PacketCreator)();
+
+    PooledPacketFactory();
+    virtual ~PooledPacketFactory();
+
+    /*
+     * packets of pcode are built with new T()
+     */
+    template <class T>
+    void registerPacket(int pcode) {
+        registerCreator(pcode, &PooledPacketFactory::create<T>);
+    }
+
+    /*
+     * packets of pcode are built by creator
+     */
+    void registerCreator(int pcode, PacketCreator creator);
+
+    /*
+     * IPacketFactory
+     */
+    Packet *createPacket(int pcode);
+
+protected:
+    /*
+     * pcode has nothing registered
+     *
+     * @return NULL (default)
+     */
+    virtual Packet *createUnregistered(int pcode);
+
+private:
+    template <class T>
+    static Packet *create() {
+        return new T();
+    }
+
+private:
+    std::vector<PacketCreator> _direct;     // pcodes [0, TBNET_POOLED_PCODE_DIRECT)
+    __gnu_cxx::hash_map<int, PacketCreator> _others;
+};
+
+}
+
+#endif /*TBNET_POOLEDPACKET_H_*/
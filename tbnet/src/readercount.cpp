@@ -0,0 +1,36 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+/*
+ * flip and drain the old phase, twice. the readers hold a phase for a
+ * lookup only, yielding is enough.
+ */
+void ReaderCount::synchronize() {
+    for (int i = 0; i < 2; i++) {
+        int old = _phase;
+        __sync_synchronize();   // the unlink is seen before the flip
+        _phase = 1 - old;
+        __sync_synchronize();
+        while (_count[old] != 0) {
+            sched_yield();
+        }
+    }
+}
+
+}
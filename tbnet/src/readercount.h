@@ -0,0 +1,67 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_READERCOUNT_H_
+#define TBNET_READERCOUNT_H_
+
+namespace tbnet {
+
+/*
+ * reader counts in two phases, for what is read without locking.
+ *
+ * a reader enters the current phase before it loads the shared pointer and
+ * leaves the phase it entered once it is done with the object, or took a
+ * reference of its own. a writer unlinks the object, then synchronize()
+ * flips the phase and waits for the readers of the old one, twice: a reader
+ * that loaded the phase just before a flip is caught by the second round.
+ * readers coming later go to the new phase, so a steady stream of them does
+ * not hold the writer up. readers never wait, writers are serialized by the
+ * caller.
+ */
+class ReaderCount {
+
+public:
+    ReaderCount() {
+        _phase = 0;
+        _count[0] = 0;
+        _count[1] = 0;
+    }
+
+    /*
+     * @return the phase to pass to leave
+     */
+    int enter() {
+        int phase = _phase;
+        __sync_add_and_fetch(&_count[phase], 1);    // a full barrier, before the load
+        return phase;
+    }
+
+    void leave(int phase) {
+        __sync_sub_and_fetch(&_count[phase], 1);
+    }
+
+    /*
+     * wait for the readers that may still see what was unlinked before
+     */
+    void synchronize();
+
+private:
+    volatile int _phase;
+    volatile int _count[2];
+};
+
+}
+
+#endif /*TBNET_READERCOUNT_H_*/
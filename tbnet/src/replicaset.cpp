@@ -0,0 +1,276 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+/*
+ * the replicas and the ejection policy. the set holds a reference, and so
+ * does each call on its way until it has been recorded, so a call
+ * outliving the set records into the replicas still.
+ */
+class ReplicaSet::State : public IFutureHandler {
+
+public:
+    State() {
+        atomic_set(&_ref, 1);
+        _maxFailures = TBNET_REPLICA_MAX_FAILURES;
+        _ejectTime = static_cast<int64_t>(TBNET_REPLICA_EJECT_TIME) * 1000;
+    }
+
+    ~State() {
+        for (size_t i = 0; i < _replicas.size(); i++) {
+            delete _replicas[i];
+        }
+    }
+
+    void addRef() {
+        atomic_inc(&_ref);
+    }
+
+    void release() {
+        if (atomic_dec_return(&_ref) == 0) {
+            delete this;
+        }
+    }
+
+    /*
+     * a call is done: a timeout or a failed post counts as a failure
+     */
+    void handleFuture(PacketFuture *future, void *args) {
+        Sample *sample = static_cast<Sample*>(args);
+        Packet *packet = future->getPacket();
+        bool timedOut = false;
+        if (packet != NULL && !packet->isRegularPacket()) {
+            int command = static_cast<ControlPacket*>(packet)->getCommand();
+            timedOut = (command == ControlPacket::CMD_TIMEOUT_PACKET ||
+                        command == ControlPacket::CMD_DISCONN_PACKET);
+        }
+        record(sample->_replica, tbsys::CTimeUtil::getTime() - sample->_startTime, timedOut);
+        delete sample;
+        release();
+    }
+
+    void record(Replica *replica, int64_t latency, bool timedOut);
+
+public:
+    atomic_t _ref;
+    std::vector<Replica*> _replicas;
+    int _maxFailures;
+    int64_t _ejectTime;                 // us
+};
+
+/*
+ * constructor
+ */
+ReplicaSet::ReplicaSet(ConnectionManager *manager, const std::vector<uint64_t> &serverIds) {
+    assert(manager != NULL);
+    _manager = manager;
+    _state = new State();
+    _seed = 0x853C49E6748FEA9BULL;
+    for (size_t i = 0; i < serverIds.size(); i++) {
+        Replica *replica = new Replica();
+        replica->_serverId = serverIds[i];
+        replica->_latency = TBNET_REPLICA_INIT_LATENCY;
+        atomic_set(&replica->_failures, 0);
+        replica->_ejectUntil = 0;
+        _state->_replicas.push_back(replica);
+    }
+}
+
+/*
+ * destructor, the replicas go with the last call on its way
+ */
+ReplicaSet::~ReplicaSet() {
+    _state->release();
+}
+
+/*
+ * ejection policy
+ */
+void ReplicaSet::setEjection(int maxFailures, int ejectTime) {
+    _state->_maxFailures = maxFailures;
+    _state->_ejectTime = static_cast<int64_t>(ejectTime) * 1000;
+}
+
+/*
+ * replicas in the set
+ */
+int ReplicaSet::getReplicaCount() {
+    return static_cast<int>(_state->_replicas.size());
+}
+
+/*
+ * the replica for the next request
+ */
+uint64_t ReplicaSet::pick() {
+    Replica *replica = pickReplica();
+    return (replica == NULL ? 0 : replica->_serverId);
+}
+
+/*
+ * power of two choices among the replicas in use
+ */
+ReplicaSet::Replica *ReplicaSet::pickReplica() {
+    std::vector<Replica*> &replicas = _state->_replicas;
+    int n = static_cast<int>(replicas.size());
+    if (n == 0) {
+        return NULL;
+    }
+    if (n == 1) {
+        return replicas[0];
+    }
+
+    uint64_t r = random();
+    int a = static_cast<int>(r % n);
+    int b = static_cast<int>((r >> 32) % (n - 1));
+    if (b >= a) {
+        b ++;
+    }
+
+    int64_t now = tbsys::CTimeUtil::getTime();
+    bool outA = (replicas[a]->_ejectUntil > now);
+    bool outB = (replicas[b]->_ejectUntil > now);
+    if (outA && outB) { // both out, any replica in use will do
+        for (int i = 1; i < n; i++) {
+            int index = (a + i) % n;
+            if (replicas[index]->_ejectUntil <= now) {
+                return replicas[index];
+            }
+        }
+        outA = outB = false; // every replica is out, use them all
+    }
+    if (outA) {
+        return replicas[b];
+    }
+    if (outB) {
+        return replicas[a];
+    }
+    if (getCost(replicas[b]) < getCost(replicas[a])) {
+        a = b;
+    }
+    return replicas[a];
+}
+
+/*
+ * call a picked replica, measured. a replica with no connection yet, its
+ * pool still connecting, fails the call unmeasured: only what happened
+ * to a post counts
+ */
+PacketFuture ReplicaSet::call(Packet *packet, int timeout) {
+    Replica *replica = pickReplica();
+    Connection *conn = (replica == NULL ? NULL : _manager->acquire(replica->_serverId));
+    if (conn == NULL) {
+        packet->free();
+        return PacketFuture(&ControlPacket::DisconnPacket);
+    }
+    Sample *sample = new Sample();
+    sample->_replica = replica;
+    sample->_startTime = tbsys::CTimeUtil::getTime();
+    PacketFuture future = conn->call(packet, timeout);
+    ConnectionPool::release(conn);
+    _state->addRef();
+    future.onReady(_state, sample);
+    return future;
+}
+
+/*
+ * a request made by the caller
+ */
+void ReplicaSet::report(uint64_t serverId, int64_t latency, bool timedOut) {
+    Replica *replica = findReplica(serverId);
+    if (replica != NULL) {
+        _state->record(replica, latency, timedOut);
+    }
+}
+
+/*
+ * moving average of serverId
+ */
+int64_t ReplicaSet::getLatency(uint64_t serverId) {
+    Replica *replica = findReplica(serverId);
+    return (replica == NULL ? -1 : replica->_latency);
+}
+
+/*
+ * serverId left out
+ */
+bool ReplicaSet::isEjected(uint64_t serverId) {
+    Replica *replica = findReplica(serverId);
+    return (replica != NULL && replica->_ejectUntil > tbsys::CTimeUtil::getTime());
+}
+
+/*
+ * (latency) * (outstanding + 1), a replica stalling piles up requests
+ * long before its average catches up
+ */
+int64_t ReplicaSet::getCost(Replica *replica) {
+    int64_t outstanding = _manager->getOutstanding(replica->_serverId);
+    return replica->_latency * (outstanding + 1);
+}
+
+/*
+ * replica of serverId, sets are small
+ */
+ReplicaSet::Replica *ReplicaSet::findReplica(uint64_t serverId) {
+    std::vector<Replica*> &replicas = _state->_replicas;
+    for (size_t i = 0; i < replicas.size(); i++) {
+        if (replicas[i]->_serverId == serverId) {
+            return replicas[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * update the average, eject after too many timeouts in a row. the average
+ * is updated without locking, a sample lost to a race does not matter.
+ */
+void ReplicaSet::State::record(Replica *replica, int64_t latency, bool timedOut) {
+    if (timedOut) {
+        if (_maxFailures > 0 && atomic_add_return(1, &replica->_failures) >= _maxFailures) {
+            atomic_set(&replica->_failures, 0);
+            replica->_latency = TBNET_REPLICA_INIT_LATENCY; // probed afresh when back
+            replica->_ejectUntil = tbsys::CTimeUtil::getTime() + _ejectTime;
+            TBSYS_LOG(WARN, "replica %s ejected for %dms after %d timeouts",
+                      tbsys::CNetUtil::addrToString(replica->_serverId).c_str(),
+                      static_cast<int>(_ejectTime / 1000), _maxFailures);
+            return;
+        }
+    } else {
+        atomic_set(&replica->_failures, 0);
+    }
+    int64_t average = replica->_latency;
+    average += (latency - average) / (1 << TBNET_REPLICA_EWMA_SHIFT);
+    replica->_latency = (average > 0 ? average : 1);
+}
+
+/*
+ * xorshift of the last draw, the time and the thread. _seed is shared
+ * without locking, a draw lost to a race is as random.
+ */
+uint64_t ReplicaSet::random() {
+    uint64_t x = _seed;
+    x ^= static_cast<uint64_t>(tbsys::CTimeUtil::getTime());
+    x ^= static_cast<uint64_t>(pthread_self()) * 0x9E3779B97F4A7C15ULL;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    _seed = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+}
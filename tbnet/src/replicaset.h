@@ -0,0 +1,128 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_REPLICASET_H_
+#define TBNET_REPLICASET_H_
+
+namespace tbnet {
+
+#define TBNET_REPLICA_INIT_LATENCY  1000        // us, latency of a replica not measured yet
+#define TBNET_REPLICA_EWMA_SHIFT    3           // a sample weighs 1/8
+#define TBNET_REPLICA_MAX_FAILURES  3           // timeouts or failed posts in a row before ejection
+#define TBNET_REPLICA_EJECT_TIME    10000       // ms
+
+/*
+ * servers holding the same data, reached through a ConnectionManager.
+ *
+ * each request goes to the better of two replicas drawn at random (power
+ * of two choices). a replica costs its latency, a moving average of its
+ * response times, times the requests outstanding to it plus one. a
+ * replica timing out, or failing the post, several times in a row is left
+ * out for a while, if every replica is left out they are all used. a
+ * replica with no connection yet fails the call without counting.
+ *
+ *   ReplicaSet shard(&manager, serverIds);
+ *   PacketFuture f = shard.call(new GetRequest(key), 50);
+ *
+ * the manager must outlive the set. calls still on their way when the set
+ * goes report into the replicas they hold, freed with the last of them.
+ */
+class ReplicaSet {
+
+public:
+    ReplicaSet(ConnectionManager *manager, const std::vector<uint64_t> &serverIds);
+    ~ReplicaSet();
+
+    /*
+     * ejection after maxFailures timeouts or failed posts in a row, for ejectTime ms
+     */
+    void setEjection(int maxFailures, int ejectTime);
+
+    /*
+     * the replica the next request should go to
+     *
+     * @return serverId, 0 - the set is empty
+     */
+    uint64_t pick();
+
+    /*
+     * ConnectionManager::call on a picked replica, its reply or timeout
+     * goes into the latency of the replica. DisconnPacket right away if
+     * the replica has no connection
+     */
+    PacketFuture call(Packet *packet, int timeout = 0);
+
+    /*
+     * account for a request sent to serverId by the caller, for requests
+     * not made through call
+     *
+     * @param latency: us from post to reply, or to the timeout
+     * @param timedOut: no reply in time
+     */
+    void report(uint64_t serverId, int64_t latency, bool timedOut);
+
+    /*
+     * latency moving average of serverId (us), -1 - not in the set
+     */
+    int64_t getLatency(uint64_t serverId);
+
+    /*
+     * serverId is left out right now
+     */
+    bool isEjected(uint64_t serverId);
+
+    int getReplicaCount();
+
+private:
+    struct Replica {
+        uint64_t _serverId;
+        volatile int64_t _latency;      // moving average, us
+        atomic_t _failures;             // timeouts in a row
+        volatile int64_t _ejectUntil;   // us, 0 - in use
+    };
+
+    /*
+     * a call on its way
+     */
+    struct Sample {
+        Replica *_replica;
+        int64_t _startTime;
+    };
+
+    Replica *pickReplica();
+
+    /*
+     * latency times load
+     */
+    int64_t getCost(Replica *replica);
+
+    Replica *findReplica(uint64_t serverId);
+
+    /*
+     * a random number, drawn without locking
+     */
+    uint64_t random();
+
+private:
+    class State;
+
+    ConnectionManager *_manager;
+    State *_state;                      // replicas and policy, shared with the calls on their way
+    volatile uint64_t _seed;
+};
+
+}
+
+#endif /*TBNET_REPLICASET_H_*/
@@ -0,0 +1,198 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+Resolver Resolver::_gResolver;
+
+/*
+ * constructor
+ */
+Resolver::Resolver() : tbsys::CDefaultRunnable(1) {
+    _started = false;
+    _ttl = TBNET_DNS_TTL;
+    _negativeTTL = TBNET_DNS_NEGATIVE_TTL;
+}
+
+/*
+ * destructor, waits for the lookup of the helper thread
+ */
+Resolver::~Resolver() {
+    if (_started) {
+        _cond.lock();
+        _stop = true;
+        _cond.broadcast();
+        _cond.unlock();
+        wait();
+    }
+}
+
+/*
+ * cached, or looked up here
+ */
+bool Resolver::resolve(const char *host, struct in_addr *addr) {
+    std::string name(host);
+    _cond.lock();
+    while (true) {
+        Entry &entry = _entries[name];
+        if (entry._valid && tbsys::CTimeUtil::getTime() < entry._expireTime) {
+            bool found = entry._found;
+            if (found) {
+                *addr = entry._addr;
+            }
+            _cond.unlock();
+            return found;
+        }
+        if (!entry._resolving) {
+            entry._resolving = true;
+            break;
+        }
+        if (entry._valid && entry._found) { // being looked up again, the last address will do
+            *addr = entry._addr;
+            _cond.unlock();
+            return true;
+        }
+        _cond.wait();
+    }
+    _cond.unlock();
+    return update(name, addr);
+}
+
+/*
+ * cached, or queued for the helper thread
+ */
+void Resolver::resolveAsync(const char *host, IResolveHandler *handler, void *args) {
+    std::string name(host);
+    _cond.lock();
+    Entry &entry = _entries[name];
+    bool fresh = (entry._valid && tbsys::CTimeUtil::getTime() < entry._expireTime);
+    if (fresh || (entry._resolving && entry._valid && entry._found)) {
+        struct in_addr addr = entry._addr;
+        bool found = entry._found;
+        _cond.unlock();
+        handler->handleResolve(host, (found ? &addr : NULL), args);
+        return;
+    }
+    entry._waiters.push_back(std::make_pair(handler, args));
+    if (!entry._resolving) {
+        entry._resolving = true;
+        _queue.push_back(name);
+        if (!_started) {
+            _started = true;
+            start();
+        }
+        _cond.broadcast();
+    }
+    _cond.unlock();
+}
+
+/*
+ * TTLs in ms
+ */
+void Resolver::setTTL(int ttl, int negativeTTL) {
+    tbsys::CThreadGuard guard(&_cond);
+    _ttl = static_cast<int64_t>(ttl) * 1000;
+    _negativeTTL = static_cast<int64_t>(negativeTTL) * 1000;
+}
+
+/*
+ * drop the names not being looked up
+ */
+void Resolver::clear() {
+    tbsys::CThreadGuard guard(&_cond);
+    ENTRY_MAP::iterator it = _entries.begin();
+    while (it != _entries.end()) {
+        if (it->second._resolving) {
+            ++it;
+        } else {
+            _entries.erase(it++);
+        }
+    }
+}
+
+/*
+ * helper thread: look up the names queued
+ */
+void Resolver::run(tbsys::CThread *thread, void *arg) {
+    UNUSED(thread);
+    UNUSED(arg);
+    while (true) {
+        _cond.lock();
+        while (!_stop && _queue.empty()) {
+            _cond.wait();
+        }
+        if (_stop) {
+            _cond.unlock();
+            break;
+        }
+        std::string name = _queue.front();
+        _queue.pop_front();
+        _cond.unlock();
+        update(name, NULL);
+    }
+}
+
+/*
+ * IPv4 address of host
+ */
+bool Resolver::lookup(const char *host, struct in_addr *addr) {
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(host, NULL, &hints, &result);
+    if (rc != 0 || result == NULL) {
+        TBSYS_LOG(WARN, "resolve %s failed: %s", host, gai_strerror(rc));
+        return false;
+    }
+    *addr = reinterpret_cast<struct sockaddr_in*>(result->ai_addr)->sin_addr;
+    freeaddrinfo(result);
+    return true;
+}
+
+/*
+ * the lookup this thread took over
+ */
+bool Resolver::update(const std::string &host, struct in_addr *addr) {
+    struct in_addr result;
+    bool found = lookup(host.c_str(), &result);
+
+    WAITER_LIST waiters;
+    _cond.lock();
+    Entry &entry = _entries[host];
+    entry._resolving = false;
+    entry._valid = true;
+    entry._found = found;
+    if (found) {
+        entry._addr = result;
+    }
+    entry._expireTime = tbsys::CTimeUtil::getTime() + (found ? _ttl : _negativeTTL);
+    waiters.swap(entry._waiters);
+    _cond.broadcast();
+    _cond.unlock();
+
+    for (size_t i = 0; i < waiters.size(); i++) {
+        waiters[i].first->handleResolve(host.c_str(), (found ? &result : NULL), waiters[i].second);
+    }
+    if (found && addr != NULL) {
+        *addr = result;
+    }
+    return found;
+}
+
+}
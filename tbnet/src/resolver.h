@@ -0,0 +1,133 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_RESOLVER_H_
+#define TBNET_RESOLVER_H_
+
+namespace tbnet {
+
+#define TBNET_DNS_TTL           60000000    // us, a name found is kept that long
+#define TBNET_DNS_NEGATIVE_TTL  5000000     // us, a name not found is kept that long
+
+/*
+ * result of Resolver::resolveAsync
+ */
+class IResolveHandler {
+public:
+    virtual ~IResolveHandler() {}
+
+    /*
+     * @param host: the name asked for
+     * @param addr: its address, NULL - not found
+     * @param args: as passed to resolveAsync
+     */
+    virtual void handleResolve(const char *host, const struct in_addr *addr, void *args) = 0;
+};
+
+/*
+ * host name cache in front of getaddrinfo.
+ *
+ * names found are kept for the TTL, names not found for the negative TTL.
+ * a name is looked up by one thread at a time, others asking for it wait
+ * for that lookup, or take the address it had if it had one. resolveAsync
+ * leaves the lookup to a helper thread, started on first use. the lock is
+ * never held during a lookup.
+ */
+class Resolver : public tbsys::CDefaultRunnable {
+
+public:
+    Resolver();
+    ~Resolver();
+
+    /*
+     * address of host, looked up on the calling thread if it is not cached
+     *
+     * @return false - not found
+     */
+    bool resolve(const char *host, struct in_addr *addr);
+
+    /*
+     * address of host to handler: right away if it is cached, else from
+     * the helper thread once looked up, where the handler must not block
+     */
+    void resolveAsync(const char *host, IResolveHandler *handler, void *args);
+
+    /*
+     * TTLs (ms) of the names found and not found
+     */
+    void setTTL(int ttl, int negativeTTL);
+
+    /*
+     * forget every name
+     */
+    void clear();
+
+    /*
+     * Runnable, the helper thread
+     */
+    void run(tbsys::CThread *thread, void *arg);
+
+public:
+    static Resolver _gResolver;
+
+protected:
+    /*
+     * getaddrinfo, unlocked
+     */
+    virtual bool lookup(const char *host, struct in_addr *addr);
+
+private:
+    typedef std::vector<std::pair<IResolveHandler*, void*> > WAITER_LIST;
+
+    struct Entry {
+        Entry() : _expireTime(0), _found(false), _valid(false), _resolving(false) {
+            _addr.s_addr = INADDR_NONE;
+        }
+
+        struct in_addr _addr;
+        int64_t _expireTime;    // us
+        bool _found;
+        bool _valid;            // looked up once
+        bool _resolving;
+        WAITER_LIST _waiters;   // resolveAsync callers
+    };
+
+    struct NameHash {
+        size_t operator()(const std::string &name) const {
+            return __gnu_cxx::__stl_hash_string(name.c_str());
+        }
+    };
+
+    typedef __gnu_cxx::hash_map<std::string, Entry, NameHash> ENTRY_MAP;
+
+    /*
+     * look host up and store the result, then call the waiters
+     */
+    bool update(const std::string &host, struct in_addr *addr);
+
+private:
+    ENTRY_MAP _entries;
+    std::deque<std::string> _queue;     // names for the helper thread
+    bool _started;
+    int64_t _ttl;
+    int64_t _negativeTTL;
+    tbsys::CThreadCond _cond;           // guards the above, signaled on lookups done and queued
+};
+
+#define TBNET_RESOLVER tbnet::Resolver::_gResolver
+
+}
+
+#endif /*TBNET_RESOLVER_H_*/
@@ -22,6 +22,7 @@ namespace tbnet {
  */
 ServerSocket::ServerSocket() {
     _backLog = 256;
+    _reusePort = false;
 }
 
 /*
@@ -39,7 +40,8 @@ Socket *ServerSocket::accept() {
 
     if (fd >= 0) {
         handleSocket = new Socket();
-        handleSocket->setUp(fd, (struct sockaddr *)&addr);
+        // a unix peer is mostly unnamed, it goes by the path listened on
+        handleSocket->setUp(fd, (isUnix() ? (struct sockaddr *)&_unixAddress : (struct sockaddr *)&addr));
     } else {
         int error = getLastError();
         if (error != EAGAIN) {
@@ -67,8 +69,27 @@ bool ServerSocket::listen() {
     setIntOption(SO_SNDBUF, 640000);
     setIntOption(SO_RCVBUF, 640000);
     setTcpNoDelay(true);
+    if (isUnix() && !removeStalePath()) {
+        return false;
+    }
+    if (_reusePort) {
+#ifdef SO_REUSEPORT
+        if (!setIntOption(SO_REUSEPORT, 1)) {
+            TBSYS_LOG(ERROR, "SO_REUSEPORT: %s(%d)", strerror(errno), errno);
+            return false;
+        }
+#else
+        TBSYS_LOG(ERROR, "SO_REUSEPORT is not supported");
+        return false;
+#endif
+    }
 
-    if (::bind(_socketHandle, (struct sockaddr *)&_address,
+    if (isUnix()) {
+        if (::bind(_socketHandle, (struct sockaddr *)&_unixAddress, sizeof(_unixAddress)) < 0) {
+            TBSYS_LOG(ERROR, "bind %s: %s(%d)", _unixAddress.sun_path, strerror(errno), errno);
+            return false;
+        }
+    } else if (::bind(_socketHandle, (struct sockaddr *)&_address,
                sizeof(_address)) < 0) {
         return false;
     }
@@ -79,4 +100,37 @@ bool ServerSocket::listen() {
 
     return true;
 }
+
+/*
+ * unlink the socket file a dead server left at the path, bind fails on it.
+ * a file other than a socket, or a socket still accepting, is kept.
+ */
+bool ServerSocket::removeStalePath() {
+    struct stat st;
+    if (lstat(_unixAddress.sun_path, &st) != 0) {
+        return true;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        TBSYS_LOG(ERROR, "%s exists and is not a socket", _unixAddress.sun_path);
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0); // a full backlog counts as in use
+    if (fd == -1) {
+        return false;
+    }
+    bool stale = (::connect(fd, (struct sockaddr *)&_unixAddress, sizeof(_unixAddress)) != 0 &&
+                  errno == ECONNREFUSED);
+    ::close(fd);
+    if (!stale) {
+        TBSYS_LOG(ERROR, "%s is in use", _unixAddress.sun_path);
+        return false;
+    }
+    if (unlink(_unixAddress.sun_path) != 0 && errno != ENOENT) {
+        TBSYS_LOG(ERROR, "unlink %s: %s(%d)", _unixAddress.sun_path, strerror(errno), errno);
+        return false;
+    }
+    TBSYS_LOG(INFO, "removed stale socket %s", _unixAddress.sun_path);
+    return true;
+}
+
 }
@@ -39,8 +39,22 @@ public:
      */
     bool listen();
 
+    /*
+     * bind with SO_REUSEPORT, so several listeners can share one address
+     */
+    void setReusePort(bool on) {
+        _reusePort = on;
+    }
+
+private:
+    /*
+     * clear the path of a unix socket for bind
+     */
+    bool removeStalePath();
+
 private:
     int _backLog; // backlog
+    bool _reusePort; // SO_REUSEPORT before bind
 };
 
 }
@@ -18,13 +18,13 @@
 
 namespace tbnet {
 
-tbsys::CThreadMutex Socket::_dnsMutex;
 
 /*
  * 캯
  */
 Socket::Socket() {
     _socketHandle = -1;
+    memset(static_cast<void *>(&_unixAddress), 0, sizeof(_unixAddress));
 }
 
 /*
@@ -45,6 +45,7 @@ Socket::~Socket() {
 bool Socket::setAddress (const char *address, const int port) {
     // ʼ
     memset(static_cast<void *>(&_address), 0, sizeof(_address));
+    _unixAddress.sun_family = AF_UNSPEC;
 
     _address.sin_family = AF_INET;
     _address.sin_port = htons(static_cast<short>(port));
@@ -73,29 +74,31 @@ bool Socket::setAddress (const char *address, const int port) {
             _address.sin_addr.s_addr = inet_addr(address);
         } else {
             // һ
-            _dnsMutex.lock();
-
-            struct hostent *myHostEnt = gethostbyname(address);
-
-            if (myHostEnt != NULL) {
-                memcpy(&(_address.sin_addr), *(myHostEnt->h_addr_list),
-                       sizeof(struct in_addr));
-            } else {
-                rc = false;
-            }
-
-            _dnsMutex.unlock();
+            rc = TBNET_RESOLVER.resolve(address, &_address.sin_addr);
         }
     }
 
     return rc;
 }
 
+/*
+ * path of a unix domain socket
+ */
+bool Socket::setUnixAddress(const char *path) {
+    memset(static_cast<void *>(&_unixAddress), 0, sizeof(_unixAddress));
+    if (path == NULL || path[0] == '\0' || strlen(path) >= sizeof(_unixAddress.sun_path)) {
+        return false;
+    }
+    _unixAddress.sun_family = AF_UNIX;
+    strcpy(_unixAddress.sun_path, path);
+    return true;
+}
+
 /*
  * socket Ƿ񴴽
  */
 bool Socket::checkSocketHandle() {
-    if (_socketHandle == -1 && (_socketHandle = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+    if (_socketHandle == -1 && (_socketHandle = socket((isUnix() ? AF_UNIX : AF_INET), SOCK_STREAM, 0)) == -1) {
         return false;
     }
     return true;
@@ -111,6 +114,9 @@ bool Socket::connect() {
         return false;
     }
     TBSYS_LOG(DEBUG, ", fd=%d, addr=%s", _socketHandle, getAddr().c_str());
+    if (isUnix()) {
+        return (0 == ::connect(_socketHandle, (struct sockaddr *)&_unixAddress, sizeof(_unixAddress)));
+    }
     return (0 == ::connect(_socketHandle, (struct sockaddr *)&_address, sizeof(_address)));
 }
 
@@ -155,7 +161,12 @@ bool Socket::createUDP() {
 void Socket::setUp(int socketHandle, struct sockaddr *hostAddress) {
     close();
     _socketHandle = socketHandle;
-    memcpy(&_address, hostAddress, sizeof(_address));
+    if (hostAddress->sa_family == AF_UNIX) {
+        memcpy(&_unixAddress, hostAddress, sizeof(_unixAddress));
+    } else {
+        _unixAddress.sun_family = AF_UNSPEC;
+        memcpy(&_address, hostAddress, sizeof(_address));
+    }
 }
 
 /*
@@ -204,6 +215,95 @@ int Socket::write (const void *data, int len) {
     return res;
 }
 
+/*
+ * SO_ZEROCOPY
+ */
+bool Socket::setZeroCopy(bool on) {
+    if (isUnix()) {
+        return false;
+    }
+#ifdef SO_ZEROCOPY
+    return setIntOption(SO_ZEROCOPY, on ? 1 : 0);
+#else
+    return false;
+#endif
+}
+
+/*
+ * send with MSG_ZEROCOPY
+ */
+int Socket::sendZeroCopy(const void *data, int len) {
+    if (_socketHandle == -1) {
+        return -1;
+    }
+
+    int res;
+    do {
+#ifdef MSG_ZEROCOPY
+        res = ::send(_socketHandle, data, len, MSG_ZEROCOPY);
+#else
+        res = ::send(_socketHandle, data, len, 0);
+#endif
+        if (res > 0) {
+            TBNET_COUNT_DATA_WRITE(res);
+        }
+    } while (res < 0 && errno == EINTR);
+    return res;
+}
+
+/*
+ * read one message from the error queue
+ */
+int Socket::readZeroCopyCompletion(uint32_t *first, uint32_t *last) {
+    if (_socketHandle == -1) {
+        return -1;
+    }
+
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int res;
+    do {
+        res = ::recvmsg(_socketHandle, &msg, MSG_ERRQUEUE);
+    } while (res < 0 && errno == EINTR);
+    if (res < 0) {
+        return (errno == EAGAIN ? 0 : -1);
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+            struct sock_extended_err *err = (struct sock_extended_err*)CMSG_DATA(cmsg);
+            if (err->ee_errno == 0 && err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                *first = err->ee_info;
+                *last = err->ee_data;
+                return 1;
+            }
+        }
+    }
+    return 2;
+}
+
+/*
+ * gather write
+ */
+
+int Socket::writev(const struct iovec *iov, int cnt) {
+    if (_socketHandle == -1) {
+        return -1;
+    }
+
+    int res;
+    do {
+        res = ::writev(_socketHandle, iov, cnt);
+        if (res > 0) {
+            TBNET_COUNT_DATA_WRITE(res);
+        }
+    } while (res < 0 && errno == EINTR);
+    return res;
+}
+
 /*
  * 
  */
@@ -265,6 +365,9 @@ bool Socket::setSoLinger(bool doLinger, int seconds) {
 
 bool Socket::setTcpNoDelay(bool noDelay) {
     bool rc = false;
+    if (isUnix()) {
+        return rc;
+    }
     int noDelayInt = noDelay ? 1 : 0;
     if (checkSocketHandle()) {
         rc = (setsockopt(_socketHandle, IPPROTO_TCP, TCP_NODELAY,
@@ -275,6 +378,9 @@ bool Socket::setTcpNoDelay(bool noDelay) {
 
 bool Socket::setTcpQuickAck(bool quickAck) {
   bool rc = false;
+  if (isUnix()) {
+    return rc;
+  }
   int quickAckInt = quickAck ? 1 : 0;
   if (checkSocketHandle()) {
     rc = (setsockopt(_socketHandle, IPPROTO_TCP, TCP_QUICKACK,
@@ -311,6 +417,9 @@ bool Socket::setSoBlocking(bool blockingEnabled) {
  * õipַ, дtmp
  */
 std::string Socket::getAddr() {
+    if (isUnix()) {
+        return _unixAddress.sun_path;
+    }
     char dest[32];
     unsigned long ad = ntohl(_address.sin_addr.s_addr);
     sprintf(dest, "%d.%d.%d.%d:%d",
@@ -326,6 +435,9 @@ std::string Socket::getAddr() {
  * õ64λֵipַ
  */
 uint64_t Socket::getId() {
+    if (isUnix()) {
+        return 0;
+    }
     uint64_t ip = ntohs(_address.sin_port);
     ip <<= 32;
     ip |= _address.sin_addr.s_addr;
@@ -338,7 +450,7 @@ uint64_t Socket::getPeerId() {
 
     struct sockaddr_in peer;
     socklen_t length = sizeof(peer);
-    if (getpeername(_socketHandle,(struct sockaddr*)&peer, &length) == 0) {
+    if (getpeername(_socketHandle,(struct sockaddr*)&peer, &length) == 0 && peer.sin_family == AF_INET) {
         return tbsys::CNetUtil::ipToAddr(peer.sin_addr.s_addr, ntohs(peer.sin_port));
     }
     return 0;
@@ -355,7 +467,7 @@ int Socket::getLocalPort() {
     int result = -1;
     struct sockaddr_in addr;
     socklen_t len = sizeof(addr);
-    if (getsockname(_socketHandle, (struct sockaddr*)(&addr), &len) == 0) {
+    if (getsockname(_socketHandle, (struct sockaddr*)(&addr), &len) == 0 && addr.sin_family == AF_INET) {
         result = ntohs(addr.sin_port);
     }
     return result;
@@ -42,6 +42,17 @@ public:
 
     bool setAddress (const char *address, const int port);
 
+    /*
+     * AF_UNIX stream socket at path, in place of an ip address
+     *
+     * @return false - path too long
+     */
+    bool setUnixAddress(const char *path);
+
+    bool isUnix() {
+        return (_unixAddress.sun_family == AF_UNIX);
+    }
+
     /*
      * ӵ_address
      *
@@ -101,6 +112,40 @@ public:
      */
     int write(const void *data, int len);
 
+    /*
+     * gather write
+     *
+     * @param iov: segments
+     * @param cnt: number of segments
+     * @return bytes written, -1 - error
+     */
+    int writev(const struct iovec *iov, int cnt);
+
+    /*
+     * SO_ZEROCOPY, needed before sendZeroCopy
+     *
+     * @return false - not supported
+     */
+    bool setZeroCopy(bool on);
+
+    /*
+     * send with MSG_ZEROCOPY: the kernel sends from data itself, which has
+     * to stay untouched until readZeroCopyCompletion reports the send.
+     * every call returning > 0 takes the next send id, starting from 0.
+     *
+     * @return bytes sent, -1 - error
+     */
+    int sendZeroCopy(const void *data, int len);
+
+    /*
+     * read one message from the error queue
+     *
+     * @param first, last: range of send ids completed
+     * @return 1 - zero copy completion, 2 - another message, 0 - queue
+     *         empty, -1 - error
+     */
+    int readZeroCopyCompletion(uint32_t *first, uint32_t *last);
+
     /*
      * 
      */
@@ -186,9 +231,9 @@ public:
 
 protected:
     struct sockaddr_in  _address; // ַ
+    struct sockaddr_un _unixAddress; // sun_family AF_UNIX - used instead of _address
     int _socketHandle;    // socketļ
     IOComponent *_iocomponent;
-    static tbsys::CThreadMutex _dnsMutex; //ʵһdnsMutex
 };
 }
 
@@ -77,6 +77,34 @@ public:
     * @return ¼, 0Ϊʱ
      */
     virtual int getEvents(int timeout, IOEvent *events, int cnt) = 0;
+
+    /*
+     * sockets are registered edge-triggered: reads and writes have to go on
+     * until EAGAIN or come back through the loop's ready list
+     */
+    virtual bool isEdgeTriggered() {
+        return false;
+    }
+
+    /*
+     * register sockets edge-triggered from now on, set before any socket
+     * is added
+     *
+     * @return false - the mode is not supported, it stays level-triggered
+     */
+    virtual bool setEdgeTriggered(bool on) {
+        if (on) {
+            TBSYS_LOG(WARN, "edge-triggered not supported, staying level-triggered");
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * make a getEvents blocking in another thread return now, safe to call
+     * from any thread
+     */
+    virtual void wakeUp() {}
 };
 }
 
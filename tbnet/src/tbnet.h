@@ -18,11 +18,17 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <linux/errqueue.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/time.h>
@@ -44,6 +50,7 @@ class TimeUtil;
 class Thread;
 class Runnable;
 class DataBuffer;
+class BufferPool;
 
 class Packet;
 class ControlPacket;
@@ -53,12 +60,20 @@ class IPacketStreamer;
 class IServerAdapter;
 class DefaultPacketStreamer;
 class PacketQueue;
-
+class AtomicPacketQueue;
+class PooledPacket;
+class PooledPacketFactory;
+class PacketFuture;
+class IFutureHandler;
+
+class Resolver;
+class IResolveHandler;
 class Socket;
 class ServerSocket;
 class IOEvent;
 class SocketEvent;
 class EPollSocketEvent;
+class IOUringSocketEvent;
 class Channel;
 class ChannelPool;
 class Connection;
@@ -67,6 +82,13 @@ class TCPAcceptor;
 class TCPComponent;
 class TCPConnection;
 class Transport;
+class IConnectHandler;
+class EventLoop;
+class LoopTask;
+class TimerEntry;
+class ITimerHandler;
+class TimingWheel;
+class EpochManager;
 class UDPAcceptor;
 class UDPComponent;
 class UDPConnection;
@@ -76,10 +98,18 @@ class HttpResponsePacket;
 class HttpPacketStreamer;
 class DefaultHttpPacketFactory;
 class PacketQueueThread;
+class LatencyHistogram;
+class ConnectionPool;
 class ConnectionManager;
+class ReplicaSet;
 }
 
 #include "stats.h"
+#include "bufferpool.h"
+#include "timingwheel.h"
+#include "epochmanager.h"
+#include "readercount.h"
+#include "looptask.h"
 
 #include "packet.h"
 #include "controlpacket.h"
@@ -90,11 +120,16 @@ class ConnectionManager;
 #include "iserveradapter.h"
 #include "defaultpacketstreamer.h"
 #include "packetqueue.h"
+#include "atomicpacketqueue.h"
+#include "pooledpacket.h"
+#include "packetfuture.h"
 
+#include "resolver.h"
 #include "socket.h"
 #include "serversocket.h"
 #include "socketevent.h"
 #include "epollsocketevent.h"
+#include "iouringsocketevent.h"
 
 #include "channel.h"
 #include "channelpool.h"
@@ -113,7 +148,10 @@ class ConnectionManager;
 #include "httpresponsepacket.h"
 #include "httppacketstreamer.h"
 #include "packetqueuethread.h"
+#include "latencyhistogram.h"
+#include "connectionpool.h"
 #include "connectionmanager.h"
+#include "replicaset.h"
 
 #endif
 
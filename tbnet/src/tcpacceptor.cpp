@@ -29,6 +29,7 @@ TCPAcceptor::TCPAcceptor(Transport *owner, Socket *socket,
                          IPacketStreamer *streamer, IServerAdapter *serverAdapter) : IOComponent(owner, socket) {
     _streamer = streamer;
     _serverAdapter = serverAdapter;
+    _loopAffinity = false;
 }
 
 /*
@@ -55,6 +56,9 @@ bool TCPAcceptor::handleReadEvent() {
             delete component;
             return true;
         }
+        if (_loopAffinity) {
+            component->setLoop(getLoop());
+        }
 
         // 뵽iocomponentsУעɶsocketevent
         _owner->addComponent(component, true, false);
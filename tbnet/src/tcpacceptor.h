@@ -60,7 +60,15 @@ public:
      */
     void checkTimeout(int64_t now);
 
+    /*
+     * keep accepted connections on the event loop of this acceptor
+     */
+    void setLoopAffinity(bool on) {
+        _loopAffinity = on;
+    }
+
 private:
+    bool _loopAffinity;              // accepted connections stay on our loop
     IPacketStreamer *_streamer;      // ݰ
     IServerAdapter  *_serverAdapter; // 
 };
@@ -81,6 +81,7 @@ bool TCPComponent::socketConnect() {
     _socket->setSoBlocking(false);
     if (_socket->connect()) {
         if (_socketEvent) {
+            _writeOn = true;
             _socketEvent->addEvent(_socket, true, true);
         }
         _state = TBNET_CONNECTED; 
@@ -89,7 +90,10 @@ bool TCPComponent::socketConnect() {
         int error = Socket::getLastError();
         if (error == EINPROGRESS || error == EWOULDBLOCK) {
             _state = TBNET_CONNECTING;
+            _startConnectTime = tbsys::CTimeUtil::getTime();
+            _owner->scheduleTimeout(this, _startConnectTime + TBNET_CONNECT_TIMEOUT);
             if (_socketEvent) {
+                _writeOn = true;
                 _socketEvent->addEvent(_socket, true, true);
             }
         } else {
@@ -110,12 +114,16 @@ void TCPComponent::close() {
         if (_socketEvent) {
             _socketEvent->removeEvent(_socket);
         }
+        if (_connection) {
+            _connection->stopDirectWrite(); // nobody may write to the fd being closed
+            _connection->abortZeroCopy();
+        }
         if (_connection && isConnectState()) {
             _connection->setDisconnState();
         }
         _socket->close();
         if (_connection) {
-          _connection->clearInputBuffer(); // clear input buffer after socket closed
+          _connection->releaseBuffer(); // free the buffers after socket closed
         }
         _state = TBNET_CLOSED;
     }
@@ -134,9 +142,13 @@ bool TCPComponent::handleWriteEvent() {
     } else if (_state == TBNET_CONNECTING) {
         int error = _socket->getSoError();
         if (error == 0) {
-            enableWrite(true);
             _connection->clearOutputBuffer();
             _state = TBNET_CONNECTED;
+            if (isEdgeTriggered()) {
+                rc = _connection->writeData(); // the connect took the edge, write what was posted meanwhile
+            } else {
+                enableWrite(true);
+            }
         } else {
             TBSYS_LOG(ERROR, "ӵ %s ʧ: %s(%d)", _socket->getAddr().c_str(), strerror(error), error);
             if (_socketEvent) {
@@ -163,6 +175,17 @@ bool TCPComponent::handleReadEvent() {
     return rc;
 }
 
+/*
+ * an error was reported: zero copy completions are read, anything else
+ * (a pending socket error) closes the connection
+ */
+bool TCPComponent::handleErrorEvent() {
+    if (_state != TBNET_CONNECTED || !_connection->readZeroCopyCompletions()) {
+        return false;
+    }
+    return (_socket->getSoError() == 0);
+}
+
 /*
  * ʱ
  *
@@ -171,14 +194,14 @@ bool TCPComponent::handleReadEvent() {
 void TCPComponent::checkTimeout(int64_t now) {
     // Ƿӳʱ
     if (_state == TBNET_CONNECTING) {
-        if (_startConnectTime > 0 && _startConnectTime < (now - static_cast<int64_t>(2000000))) { // ӳʱ 2 
+        if (_startConnectTime > 0 && _startConnectTime < (now - static_cast<int64_t>(TBNET_CONNECT_TIMEOUT))) { // ӳʱ 2 
             _state = TBNET_CLOSED;
             TBSYS_LOG(ERROR, "ӵ %s ʱ.", _socket->getAddr().c_str());
             _socket->shutdown();
         }
     } else if (_state == TBNET_CONNECTED && _isServer == true && _autoReconn == false) { // ӵʱ, ֻڷ
         int64_t idle = now - _lastUseTime;
-        if (idle > static_cast<int64_t>(900000000)) { // 15minϿ
+        if (idle > static_cast<int64_t>(TBNET_IDLE_TIMEOUT)) { // 15minϿ
             _state = TBNET_CLOSED;
             TBSYS_LOG(INFO, "%s : %d (s) Ͽ.", _socket->getAddr().c_str(), (idle/static_cast<int64_t>(1000000)));
             _socket->shutdown();
@@ -188,4 +211,26 @@ void TCPComponent::checkTimeout(int64_t now) {
     _connection->checkTimeout(now);
 }
 
+/*
+ * when checkTimeout has to run next
+ *
+ * @param    now current time (us)
+ * @return   absolute time (us), TBNET_MAX_TIME - nothing to check
+ */
+int64_t TCPComponent::getNextTimeout(int64_t now) {
+    int64_t next = TBNET_MAX_TIME;
+    if (_state == TBNET_CONNECTING) {
+        if (_startConnectTime > 0) {
+            next = _startConnectTime + TBNET_CONNECT_TIMEOUT;
+        }
+    } else if (_state == TBNET_CONNECTED && _isServer == true && _autoReconn == false) {
+        next = _lastUseTime + TBNET_IDLE_TIMEOUT;
+    }
+    int64_t pending = _connection->getNextTimeout(now);
+    if (pending < next) {
+        next = pending;
+    }
+    return next;
+}
+
 }
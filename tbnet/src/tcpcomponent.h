@@ -18,6 +18,9 @@
 
 namespace tbnet {
 
+#define TBNET_CONNECT_TIMEOUT 2000000       // us, 2s
+#define TBNET_IDLE_TIMEOUT 900000000        // us, server side idle 15min
+
 class TCPComponent : public IOComponent {
 public:
     /**
@@ -63,6 +66,13 @@ public:
      */
     bool handleReadEvent();
 
+    /*
+     * read zero copy completions off the error queue
+     *
+     * @return true - nothing but completions, the socket is fine
+     */
+    bool handleErrorEvent();
+
     /*
      * õconnection
      *
@@ -79,6 +89,14 @@ public:
      */
     void checkTimeout(int64_t now);
 
+    /*
+     * connect deadline, server idle deadline, or the next check while the
+     * connection still has packets or channels waiting
+     *
+     * @param    now current time (us)
+     */
+    int64_t getNextTimeout(int64_t now);
+
     /*
      * ӵsocket
      */
@@ -24,11 +24,20 @@ TCPConnection::TCPConnection(Socket *socket, IPacketStreamer *streamer,
                              IServerAdapter *serverAdapter) : Connection(socket, streamer, serverAdapter) {
     _gotHeader = false;
     _writeFinishClose = false;
+    _writing = false;
+    _directWrite = true;
+    _directWriteStopped = false;
+    _segmentOutputLen = 0;
+    _payloadLen = 0;
+    _zeroCopyThreshold = 0;
+    _zeroCopyOn = false;
+    _zeroCopyNext = 0;
+    _zeroCopyDone = 0;
     memset(&_packetHeader, 0, sizeof(_packetHeader));
 }
 
 TCPConnection::~TCPConnection() {
-    ;
+    clearSegments();
 }
 
 /*
@@ -39,22 +48,72 @@ TCPConnection::~TCPConnection() {
 bool TCPConnection::writeData() {
     //  _outputQueue copy _myQueue
     _outputCond.lock();
-    _outputQueue.moveTo(&_myQueue);
-    if (_myQueue.size() == 0 && _output.getDataLen() == 0) { // 
+    if (_writing) { // a posting thread is writing, it arms EPOLLOUT again if it has to
         _iocomponent->enableWrite(false);
         _outputCond.unlock();
         return true;
     }
+    takeOutput(&_myQueue);
+    if (_myQueue.size() == 0 && !hasOutput()) { // 
+        _iocomponent->enableWrite(false);
+        _outputCond.unlock();
+        return true;
+    }
+    _writing = true;
+    bool edge = _iocomponent->isEdgeTriggered();
+    if (edge) {
+        _iocomponent->enableWrite(false);   // the write event is taken, a post from now on kicks again
+    }
     _outputCond.unlock();
 
+    // edge-triggered: write until EAGAIN, bounded by the byte budget
+    int ret = flush(edge);
+    _iocomponent->setWritePending(edge && ret > 0 && (hasOutput() || _myQueue.size() > 0));
+
+    // 
+    _output.shrink();
+
+    // a post landing after the check arms the write event again
+    std::vector<IPacketHandler*> writable;
+    _outputCond.lock();
+    _writing = false;
+    bool pending = (!_postQueue.empty() || _outputQueue.size() > 0 || _myQueue.size() > 0 || hasOutput());
+    if ((!pending || _writeFinishClose) && _iocomponent != NULL) {
+        _iocomponent->enableWrite(false);
+    }
+    if (atomic_read(&_queueWaiters) > 0) {
+        takeWritable(&writable);
+    }
+    _outputCond.unlock();
+    completeWritable(writable, NULL);
+    if (_writeFinishClose) {
+        TBSYS_LOG(ERROR, "Ͽ.");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * encode _myQueue into _output and write it out together with the packet
+ * payloads, the caller owns the output side (_writing). level-triggered it
+ * stops after 10 writes or a partial write, edge-triggered at EAGAIN or
+ * READ_WRITE_BUDGET bytes
+ *
+ * @return result of the last write, 0 - nothing was written
+ */
+int TCPConnection::flush(bool edge) {
     Packet *packet;
-    int ret;
+    int ret = 0;
     int writeCnt = 0;
+    int writeBytes = 0;
     int myQueueSize = _myQueue.size();
+    int64_t now = tbsys::CTimeUtil::getTime();
 
     do {
         // д
-        while (_output.getDataLen() < READ_WRITE_SIZE) {
+        while (_output.getDataLen() + _payloadLen < READ_WRITE_SIZE &&
+                _segments.size() < TBNET_MAX_IOV / 2) {
             // п˾˳
 
             if (myQueueSize == 0)
@@ -62,50 +121,361 @@ bool TCPConnection::writeData() {
 
             packet = _myQueue.pop();
             myQueueSize --;
-            _streamer->encode(packet, &_output);
-            _channelPool.setExpireTime(packet->getChannel(), packet->getExpireTime());
-            packet->free();
+            atomic_sub(packet->getQueueSize(), &_queueBytes);
+            if (isStale(packet, now)) { // a reply would find no channel
+                packet->free();
+                continue;
+            }
+            const char *payload = NULL;
+            int payloadLen = 0;
+            if (_streamer->encode(packet, &_output)) {
+                payloadLen = packet->getPayload(payload);
+            }
+            if (payloadLen > 0) { // freed once the payload is written
+                bool zeroCopy = (_zeroCopyThreshold > 0 && payloadLen >= _zeroCopyThreshold);
+                if (zeroCopy && !_zeroCopyOn) {
+                    _zeroCopyOn = _socket->setZeroCopy(true);
+                    if (!_zeroCopyOn) {
+                        TBSYS_LOG(WARN, "SO_ZEROCOPY not supported: %s", _socket->getAddr().c_str());
+                        _zeroCopyThreshold = 0;
+                        zeroCopy = false;
+                    }
+                }
+                OutputSegment segment;
+                segment._prefix = _output.getDataLen() - _segmentOutputLen;
+                segment._data = payload;
+                segment._len = payloadLen;
+                segment._offset = 0;
+                segment._packet = packet;
+                segment._zeroCopy = zeroCopy;
+                segment._zeroCopySent = false;
+                segment._zeroCopyId = 0;
+                _segments.push_back(segment);
+                _segmentOutputLen += segment._prefix;
+                _payloadLen += payloadLen;
+            } else {
+                packet->free();
+            }
             TBNET_COUNT_PACKET_WRITE(1);
         }
 
-        if (_output.getDataLen() == 0) {
+        if (!hasOutput()) {
             break;
         }
 
         // write data
-        ret = _socket->write(_output.getData(), _output.getDataLen());
+        ret = writeOutput();
         if (ret > 0) {
-            _output.drainData(ret);
+            writeBytes += ret;
         }
 
         writeCnt ++;
-    } while (ret > 0 && _output.getDataLen() == 0 && myQueueSize>0 && writeCnt < 10);
+    } while (ret > 0 && (edge ? writeBytes < READ_WRITE_BUDGET :
+                         (!hasOutput() && myQueueSize>0 && writeCnt < 10)));
 
-    // 
-    _output.shrink();
+    return ret;
+}
 
+/*
+ * write _output, with the pending payloads spliced in at their offsets,
+ * and drain what went out. a payload done frees its packet. a zero copy
+ * payload is sent on its own, the writev stops in front of it.
+ *
+ * @return result of write/writev
+ */
+int TCPConnection::writeOutput() {
+    if (_segments.empty()) {
+        int ret = _socket->write(_output.getData(), _output.getDataLen());
+        if (ret > 0) {
+            _output.drainData(ret);
+        }
+        return ret;
+    }
+
+    if (_segments.front()._zeroCopy && _segments.front()._prefix == 0) {
+        return writeZeroCopy();
+    }
+
+    struct iovec iov[TBNET_MAX_IOV];
+    int cnt = 0;
+    char *data = _output.getData();
+    std::deque<OutputSegment>::iterator it = _segments.begin();
+    for (; it != _segments.end() && cnt <= TBNET_MAX_IOV - 3; ++it) {
+        if (it->_prefix > 0) {
+            iov[cnt].iov_base = data;
+            iov[cnt].iov_len = it->_prefix;
+            data += it->_prefix;
+            cnt ++;
+        }
+        if (it->_zeroCopy) {
+            break;
+        }
+        iov[cnt].iov_base = const_cast<char*>(it->_data + it->_offset);
+        iov[cnt].iov_len = it->_len - it->_offset;
+        cnt ++;
+    }
+    int tail = _output.getDataLen() - _segmentOutputLen;
+    if (it == _segments.end() && tail > 0) {
+        iov[cnt].iov_base = data;
+        iov[cnt].iov_len = tail;
+        cnt ++;
+    }
+
+    int ret = _socket->writev(iov, cnt);
+    int left = ret;
+    while (left > 0 && !_segments.empty()) {
+        OutputSegment &segment = _segments.front();
+        int len = (left < segment._prefix ? left : segment._prefix);
+        _output.drainData(len);
+        segment._prefix -= len;
+        _segmentOutputLen -= len;
+        left -= len;
+        if (segment._prefix > 0) {
+            break;
+        }
+        len = segment._len - segment._offset;
+        if (left < len) {
+            len = left;
+        }
+        segment._offset += len;
+        _payloadLen -= len;
+        left -= len;
+        if (segment._offset < segment._len) {
+            break;
+        }
+        segment._packet->free();
+        _segments.pop_front();
+    }
+    if (left > 0) {
+        _output.drainData(left);
+    }
+    return ret;
+}
+
+/*
+ * free the packets whose payloads were not written or are still held for
+ * zero copy. the kernel may still send from a held payload until its
+ * completion, so a socket with sends held is closed by abortZeroCopy
+ * first; a held packet left here belongs to a socket closed that way.
+ */
+void TCPConnection::clearSegments() {
+    while (!_segments.empty()) {
+        _segments.front()._packet->free();
+        _segments.pop_front();
+    }
+    _segmentOutputLen = 0;
+    _payloadLen = 0;
+
+    std::vector<Packet*> held;
     _outputCond.lock();
-    int queueSize = _outputQueue.size() + _myQueue.size() + (_output.getDataLen() > 0 ? 1 : 0);
-    if ((queueSize == 0 || _writeFinishClose) && _iocomponent != NULL) {
-        _iocomponent->enableWrite(false);
+    for (size_t i = 0; i < _zeroCopyHeld.size(); i++) {
+        held.push_back(_zeroCopyHeld[i]._packet);
     }
+    _zeroCopyHeld.clear();
+    _zeroCopyRanges.clear();
+    _zeroCopyNext = _zeroCopyDone = 0;
+    _zeroCopyOn = false;    // a new socket comes with a new id sequence
     _outputCond.unlock();
-    if (_writeFinishClose) {
-        TBSYS_LOG(ERROR, "Ͽ.");
+    for (size_t i = 0; i < held.size(); i++) {
+        held[i]->free();
+    }
+}
+
+/*
+ * send the payload of the first segment with MSG_ZEROCOPY, once it is all
+ * sent the packet is held until its last send completes
+ *
+ * @return result of the send
+ */
+int TCPConnection::writeZeroCopy() {
+    OutputSegment &segment = _segments.front();
+    const char *data = segment._data + segment._offset;
+    int len = segment._len - segment._offset;
+    int ret = _socket->sendZeroCopy(data, len);
+    if (ret > 0) {
+        segment._zeroCopySent = true;
+        segment._zeroCopyId = _zeroCopyNext ++;
+    } else if (ret < 0 && errno == ENOBUFS) { // out of notification memory, copy
+        ret = _socket->write(data, len);
+    }
+    if (ret <= 0) {
+        return ret;
+    }
+
+    segment._offset += ret;
+    _payloadLen -= ret;
+    if (segment._offset < segment._len) {
+        return ret;
+    }
+    Packet *packet = segment._packet;
+    bool held = segment._zeroCopySent;
+    ZeroCopyHold hold;
+    hold._packet = packet;
+    hold._id = segment._zeroCopyId;
+    _segments.pop_front();
+    if (!held) {
+        packet->free();
+        return ret;
+    }
+
+    // the completion may have been read already
+    std::vector<Packet*> done;
+    _outputCond.lock();
+    _zeroCopyHeld.push_back(hold);
+    takeZeroCopyDone(done);
+    _outputCond.unlock();
+    for (size_t i = 0; i < done.size(); i++) {
+        done[i]->free();
+    }
+    return ret;
+}
+
+/*
+ * free the packets whose completions came in, then make the close abortive
+ * (SO_LINGER 0) if sends are still held: the kernel drops them from the
+ * send queue at close and lets go of the pages before clearSegments frees
+ * the packets. the peer gets a reset instead of the unacknowledged tail.
+ */
+void TCPConnection::abortZeroCopy() {
+    if (!_zeroCopyOn) {
+        return;
+    }
+    readZeroCopyCompletions();
+    _outputCond.lock();
+    bool held = !_zeroCopyHeld.empty();
+    _outputCond.unlock();
+    if (held) {
+        TBSYS_LOG(WARN, "%s closed with zero copy sends in flight, reset",
+                  _socket->getAddr().c_str());
+        _socket->setSoLinger(true, 0);
+    }
+}
+
+/*
+ * read the zero copy completions off the error queue
+ */
+bool TCPConnection::readZeroCopyCompletions() {
+    if (!_zeroCopyOn) {
         return false;
     }
+    bool clean = true;
+    uint32_t first, last;
+    int rc;
+    while ((rc = _socket->readZeroCopyCompletion(&first, &last)) > 0) {
+        if (rc == 1) {
+            _outputCond.lock();
+            completeZeroCopy(first, last);
+            _outputCond.unlock();
+        } else {
+            clean = false;
+        }
+    }
+
+    std::vector<Packet*> done;
+    _outputCond.lock();
+    takeZeroCopyDone(done);
+    _outputCond.unlock();
+    for (size_t i = 0; i < done.size(); i++) {
+        done[i]->free();
+    }
+    return (clean && rc == 0);
+}
 
-    // client, queueȵ
-    if (!_isServer && _queueLimit > 0 &&  _queueTotalSize > _queueLimit) {
-        _outputCond.lock();
-        _queueTotalSize = queueSize + _channelPool.getUseListCount();
-        if (_queueTotalSize <= _queueLimit) {
-            _outputCond.broadcast();
+/*
+ * sends first..last are complete, ranges ahead of _zeroCopyDone wait until
+ * the gap is closed (ids wrap, compared as differences)
+ */
+void TCPConnection::completeZeroCopy(uint32_t first, uint32_t last) {
+    if (static_cast<int32_t>(first - _zeroCopyDone) > 0) {
+        _zeroCopyRanges.push_back(std::make_pair(first, last));
+        return;
+    }
+    if (static_cast<int32_t>(last + 1 - _zeroCopyDone) > 0) {
+        _zeroCopyDone = last + 1;
+    }
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < _zeroCopyRanges.size(); i++) {
+            if (static_cast<int32_t>(_zeroCopyRanges[i].first - _zeroCopyDone) <= 0) {
+                if (static_cast<int32_t>(_zeroCopyRanges[i].second + 1 - _zeroCopyDone) > 0) {
+                    _zeroCopyDone = _zeroCopyRanges[i].second + 1;
+                }
+                _zeroCopyRanges.erase(_zeroCopyRanges.begin() + i);
+                merged = true;
+                break;
+            }
         }
-        _outputCond.unlock();
     }
+}
 
-    return true;
+/*
+ * move the held packets whose sends are complete to done
+ */
+void TCPConnection::takeZeroCopyDone(std::vector<Packet*> &done) {
+    while (!_zeroCopyHeld.empty() &&
+            static_cast<int32_t>(_zeroCopyHeld.front()._id - _zeroCopyDone) < 0) {
+        done.push_back(_zeroCopyHeld.front()._packet);
+        _zeroCopyHeld.pop_front();
+    }
+}
+
+/*
+ * the output queue became non-empty, called with _outputCond held. an idle
+ * socket is written by the posting thread itself, otherwise EPOLLOUT is armed
+ *
+ * @return true - the output side is claimed, call writeDirect()
+ */
+bool TCPConnection::armOutput() {
+    if (_directWrite && !_writing && !_directWriteStopped && !_writeFinishClose
+            && _myQueue.size() == 0 && !hasOutput()
+            && _iocomponent->getState() == IOComponent::TBNET_CONNECTED) {
+        _writing = true;
+        return true;
+    }
+    _iocomponent->enableWrite(true);
+    return false;
+}
+
+/*
+ * write from the posting thread, EPOLLOUT is only armed when something is
+ * left over
+ */
+void TCPConnection::writeDirect() {
+    _outputCond.lock();
+    takeOutput(&_myQueue);
+    _outputCond.unlock();
+
+    flush(false);
+    _output.shrink();
+
+    std::vector<IPacketHandler*> writable;
+    _outputCond.lock();
+    _writing = false;
+    if (!_postQueue.empty() || _outputQueue.size() > 0 || _myQueue.size() > 0 || hasOutput()) {
+        _iocomponent->enableWrite(true);
+    }
+    if (atomic_read(&_queueWaiters) > 0) {
+        takeWritable(&writable);
+    }
+    if (_directWriteStopped) {
+        _outputCond.broadcast();
+    }
+    _outputCond.unlock();
+    completeWritable(writable, NULL);
+}
+
+/*
+ * the socket is going to be closed: wait for a posting thread still writing
+ * to it, and write through the event loop until connected again
+ */
+void TCPConnection::stopDirectWrite() {
+    _outputCond.lock();
+    _directWriteStopped = true;
+    while (_writing) {
+        _outputCond.wait(10);
+    }
+    _outputCond.unlock();
 }
 
 /*
@@ -117,11 +487,15 @@ bool TCPConnection::readData() {
     _input.ensureFree(READ_WRITE_SIZE);
     int ret = _socket->read(_input.getFree(), _input.getFreeLen());
     int readCnt = 0;
+    int readBytes = 0;
     int freeLen = 0;
     bool broken = false;
+    // edge-triggered: read until EAGAIN, bounded by the byte budget
+    bool edge = (_iocomponent != NULL && _iocomponent->isEdgeTriggered());
 
     while (ret > 0) {
         _input.pourData(ret);
+        readBytes += ret;
         freeLen = _input.getFreeLen();
 
         while (1) {
@@ -141,7 +515,14 @@ bool TCPConnection::readData() {
             }
         }
 
-        if (broken || freeLen > 0 || readCnt >= 10) {
+        if (broken) {
+            break;
+        }
+        if (edge) {
+            if (readBytes >= READ_WRITE_BUDGET) {
+                break;
+            }
+        } else if (freeLen > 0 || readCnt >= 10) {
             break;
         }
 
@@ -173,6 +554,9 @@ bool TCPConnection::readData() {
     } else {
         _gotHeader = false;
     }
+    if (_iocomponent != NULL) {
+        _iocomponent->setReadPending(edge && ret > 0 && !broken);
+    }
     return !broken;
 }
 
@@ -18,6 +18,8 @@
 
 namespace tbnet {
 
+#define TBNET_MAX_IOV 64    // segments per writev
+
 class TCPConnection : public Connection {
 
 public:
@@ -52,11 +54,61 @@ public:
         _writeFinishClose = v;
     }
 
+    /*
+     * let a posting thread write an idle socket itself (default on)
+     */
+    void setDirectWrite(bool v) {
+        _directWrite = v;
+    }
+
+    /*
+     * MSG_ZEROCOPY for payloads of at least threshold bytes, 0 - off
+     */
+    void setZeroCopy(int threshold) {
+        _zeroCopyThreshold = (threshold > 0 ? threshold : 0);
+    }
+
+    /*
+     * read the zero copy completions off the socket error queue and free
+     * the packets whose sends are complete, called by the event loop
+     *
+     * a poll may report an error after the queue has been drained, so an
+     * empty queue is fine as long as zero copy is on
+     *
+     * @return true - zero copy is on and the queue held nothing else
+     */
+    bool readZeroCopyCompletions();
+
+    /*
+     * the output queue became non-empty, called with _outputCond held
+     *
+     * @return true - the caller writes directly with writeDirect()
+     */
+    bool armOutput();
+
+    /*
+     * write from the posting thread after armOutput() returned true
+     */
+    void writeDirect();
+
+    /*
+     * wait for a direct writer before the socket is closed
+     */
+    void stopDirectWrite();
+
+    /*
+     * the socket is about to be closed: zero copy sends not reported
+     * complete are dropped with it, see clearSegments
+     */
+    void abortZeroCopy();
+
     /*
      * outputbuffer
      */
     void clearOutputBuffer() {
         _output.clear();
+        clearSegments();
+        _directWriteStopped = false;    // connected (again)
     }
 
     /*
@@ -66,17 +118,102 @@ public:
         _input.clear();
     }
 
+    /*
+     * free both buffers once the socket is closed, a dead connection
+     * should not pin their memory until it is deleted
+     */
+    void releaseBuffer() {
+        _input.destroy();
+        _output.destroy();
+        clearSegments();
+        _gotHeader = false;
+    }
+
     /**
      * setDisconnState
      */
     void setDisconnState();
 
 private:
+    /*
+     * encode and write, the caller owns the output side
+     */
+    int flush(bool edge);
+
+    /*
+     * one write or writev of _output and the payloads in between
+     */
+    int writeOutput();
+
+    /*
+     * bytes left in _output or in a payload
+     */
+    bool hasOutput() {
+        return (_output.getDataLen() > 0 || !_segments.empty());
+    }
+
+    /*
+     * free the packets whose payloads were not written
+     */
+    void clearSegments();
+
+    /*
+     * send the payload of the first segment with MSG_ZEROCOPY
+     */
+    int writeZeroCopy();
+
+    /*
+     * sends first..last are complete, with _outputCond held
+     */
+    void completeZeroCopy(uint32_t first, uint32_t last);
+
+    /*
+     * move the held packets whose sends are complete to done, with
+     * _outputCond held
+     */
+    void takeZeroCopyDone(std::vector<Packet*> &done);
+
+private:
+    /*
+     * a payload (Packet::getPayload) to go out after _prefix more bytes of
+     * _output, its packet is held until it has been written
+     */
+    struct OutputSegment {
+        int _prefix;
+        const char *_data;
+        int _len;
+        int _offset;            // bytes written
+        Packet *_packet;
+        bool _zeroCopy;         // sent with MSG_ZEROCOPY
+        bool _zeroCopySent;     // a zero copy send went out, _zeroCopyId is its last
+        uint32_t _zeroCopyId;
+    };
+
+    /*
+     * a packet whose payload has been sent, held until send _id completes
+     */
+    struct ZeroCopyHold {
+        Packet *_packet;
+        uint32_t _id;
+    };
+
     DataBuffer _output;      // buffer
     DataBuffer _input;       // buffer
     PacketHeader _packetHeader; // packet header
     bool _gotHeader;            // packet headerѾȡ
     bool _writeFinishClose;     // дϿ
+    bool _writing;              // _myQueue/_output are being written, by the loop or a posting thread
+    bool _directWrite;          // posting threads may write an idle socket
+    bool _directWriteStopped;   // socket closing, write through the loop
+    std::deque<OutputSegment> _segments;    // payloads, in output order
+    int _segmentOutputLen;      // bytes of _output taken by the prefixes
+    int _payloadLen;            // payload bytes not written yet
+    int _zeroCopyThreshold;     // payload bytes for MSG_ZEROCOPY, 0 - off
+    bool _zeroCopyOn;           // SO_ZEROCOPY set on the socket
+    uint32_t _zeroCopyNext;     // id of the next zero copy send
+    uint32_t _zeroCopyDone;     // sends before this id are complete
+    std::deque<ZeroCopyHold> _zeroCopyHeld;     // by id, under _outputCond
+    std::vector<std::pair<uint32_t, uint32_t> > _zeroCopyRanges;    // completed out of order
 };
 
 }
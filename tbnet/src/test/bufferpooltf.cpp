@@ -0,0 +1,216 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "bufferpooltf.h"
+#include <vector>
+
+using namespace std;
+
+namespace tbnet {
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BufferPoolTF);
+
+#define BLOCK_SIZE      1024
+#define CACHE_BLOCKS    (TBNET_POOL_CACHE_BYTES / BLOCK_SIZE)
+#define DEPOT_BLOCKS    (TBNET_POOL_DEPOT_BYTES / BLOCK_SIZE)
+
+/*
+ * released by a static destructor at exit, the process pool must still be
+ * there whatever order the statics go in
+ */
+static DataBuffer gExitBuffer;
+
+class PoolUser : public tbsys::Runnable {
+public:
+    PoolUser(BufferPool *pool, int count) : _pool(pool), _count(count) {}
+
+    void run(tbsys::CThread *thread, void *arg) {
+        vector<void*> blocks;
+        int capacity;
+        for (int i = 0; i < _count; i++) {
+            blocks.push_back(_pool->allocate(BLOCK_SIZE, &capacity));
+        }
+        for (int i = 0; i < _count; i++) {
+            _pool->deallocate(blocks[i], capacity);
+        }
+    }
+
+private:
+    BufferPool *_pool;
+    int _count;
+};
+
+void BufferPoolTF::setUp() {
+}
+
+void BufferPoolTF::tearDown() {
+}
+
+void BufferPoolTF::testCapacity() {
+    CPPUNIT_ASSERT_EQUAL(32, BufferPool::getCapacity(0));
+    CPPUNIT_ASSERT_EQUAL(32, BufferPool::getCapacity(1));
+    CPPUNIT_ASSERT_EQUAL(32, BufferPool::getCapacity(32));
+    CPPUNIT_ASSERT_EQUAL(64, BufferPool::getCapacity(33));
+    CPPUNIT_ASSERT_EQUAL(1024, BufferPool::getCapacity(1000));
+    CPPUNIT_ASSERT_EQUAL(1024, BufferPool::getCapacity(1024));
+    CPPUNIT_ASSERT_EQUAL(2048, BufferPool::getCapacity(1025));
+    CPPUNIT_ASSERT_EQUAL(262144, BufferPool::getCapacity(262144));
+    CPPUNIT_ASSERT_EQUAL(524288, BufferPool::getCapacity(262145));
+
+    BufferPool pool;
+    int capacity = 0;
+    void *ptr = pool.allocate(100, &capacity);
+    CPPUNIT_ASSERT(ptr != NULL);
+    CPPUNIT_ASSERT_EQUAL(128, capacity);
+    memset(ptr, 0, capacity);
+    pool.deallocate(ptr, capacity);
+}
+
+void BufferPoolTF::testThreadCache() {
+    BufferPool pool;
+    vector<void*> blocks;
+    int capacity;
+    for (int i = 0; i <= CACHE_BLOCKS; i++) {
+        blocks.push_back(pool.allocate(BLOCK_SIZE, &capacity));
+    }
+    CPPUNIT_ASSERT_EQUAL(BLOCK_SIZE, capacity);
+
+    // the cache holds CACHE_BLOCKS, the one more sends half to the depot
+    for (int i = 0; i < CACHE_BLOCKS; i++) {
+        pool.deallocate(blocks[i], capacity);
+    }
+    CPPUNIT_ASSERT_EQUAL((int64_t)0, pool.getDepotBytes());
+    pool.deallocate(blocks[CACHE_BLOCKS], capacity);
+    int moved = (CACHE_BLOCKS + 1) / 2;
+    CPPUNIT_ASSERT_EQUAL((int64_t)moved * BLOCK_SIZE, pool.getDepotBytes());
+
+    // the newest half went, the newest block left is the first taken
+    void *ptr = pool.allocate(BLOCK_SIZE, &capacity);
+    CPPUNIT_ASSERT(ptr == blocks[CACHE_BLOCKS - moved]);
+    pool.deallocate(ptr, capacity);
+
+    // an empty cache refills half of itself from the depot
+    blocks.clear();
+    for (int i = 0; i < CACHE_BLOCKS + 1 - moved; i++) {
+        blocks.push_back(pool.allocate(BLOCK_SIZE, &capacity));
+    }
+    CPPUNIT_ASSERT_EQUAL((int64_t)moved * BLOCK_SIZE, pool.getDepotBytes());
+    blocks.push_back(pool.allocate(BLOCK_SIZE, &capacity));
+    int refill = CACHE_BLOCKS / 2;
+    CPPUNIT_ASSERT_EQUAL((int64_t)(moved - refill) * BLOCK_SIZE, pool.getDepotBytes());
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        pool.deallocate(blocks[i], capacity);
+    }
+    pool.flushThreadCache();
+    CPPUNIT_ASSERT_EQUAL((int64_t)(CACHE_BLOCKS + 1) * BLOCK_SIZE, pool.getDepotBytes());
+}
+
+void BufferPoolTF::testDepotOverflow() {
+    BufferPool pool;
+    vector<void*> blocks;
+    int capacity;
+    int count = DEPOT_BLOCKS + CACHE_BLOCKS * 2;
+    for (int i = 0; i < count; i++) {
+        blocks.push_back(pool.allocate(BLOCK_SIZE, &capacity));
+    }
+    for (int i = 0; i < count; i++) {
+        pool.deallocate(blocks[i], capacity);
+        CPPUNIT_ASSERT(pool.getDepotBytes() <= TBNET_POOL_DEPOT_BYTES);
+    }
+
+    // the rest of the cache fills the depot up, what does not fit is freed
+    pool.flushThreadCache();
+    CPPUNIT_ASSERT_EQUAL((int64_t)TBNET_POOL_DEPOT_BYTES, pool.getDepotBytes());
+    pool.flushThreadCache();
+    CPPUNIT_ASSERT_EQUAL((int64_t)TBNET_POOL_DEPOT_BYTES, pool.getDepotBytes());
+
+    // other classes have depots of their own
+    void *ptr = pool.allocate(BLOCK_SIZE * 2, &capacity);
+    pool.deallocate(ptr, capacity);
+    pool.flushThreadCache();
+    CPPUNIT_ASSERT_EQUAL((int64_t)TBNET_POOL_DEPOT_BYTES + BLOCK_SIZE * 2,
+                         pool.getDepotBytes());
+}
+
+void BufferPoolTF::testThreadExit() {
+    BufferPool pool;
+    PoolUser user(&pool, 10);
+    tbsys::CThread thread;
+    thread.start(&user, NULL);
+    thread.join();
+
+    // the exiting thread gave its cache back
+    CPPUNIT_ASSERT_EQUAL((int64_t)10 * BLOCK_SIZE, pool.getDepotBytes());
+
+    // and the next thread takes from there
+    PoolUser other(&pool, 1);
+    tbsys::CThread thread2;
+    thread2.start(&other, NULL);
+    thread2.join();
+    CPPUNIT_ASSERT_EQUAL((int64_t)10 * BLOCK_SIZE, pool.getDepotBytes());
+}
+
+void BufferPoolTF::testLarge() {
+    BufferPool pool;
+    int capacity;
+    void *ptr = pool.allocate(300000, &capacity);
+    CPPUNIT_ASSERT(ptr != NULL);
+    CPPUNIT_ASSERT_EQUAL(524288, capacity);
+    memset(ptr, 0, capacity);
+    pool.deallocate(ptr, capacity);
+
+    // a size not from allocate is freed, not cached
+    ptr = malloc(1000);
+    pool.deallocate(ptr, 1000);
+    pool.flushThreadCache();
+    CPPUNIT_ASSERT_EQUAL((int64_t)0, pool.getDepotBytes());
+}
+
+void BufferPoolTF::testShrink() {
+    char data[8192];
+    for (int i = 0; i < (int)sizeof(data); i++) {
+        data[i] = (char)i;
+    }
+
+    DataBuffer buffer;
+    buffer.shrink();
+    CPPUNIT_ASSERT(buffer.getData() == NULL);
+
+    // a large buffer holding little is moved to a MAX_BUFFER_SIZE block
+    buffer.writeBytes(data, sizeof(data));
+    CPPUNIT_ASSERT(buffer.getDataLen() + buffer.getFreeLen() >= (int)sizeof(data));
+    buffer.drainData(sizeof(data) - 100);
+    buffer.shrink();
+    CPPUNIT_ASSERT_EQUAL(100, buffer.getDataLen());
+    CPPUNIT_ASSERT_EQUAL(MAX_BUFFER_SIZE, buffer.getDataLen() + buffer.getFreeLen());
+    CPPUNIT_ASSERT(memcmp(buffer.getData(), data + sizeof(data) - 100, 100) == 0);
+
+    // holding more than MAX_BUFFER_SIZE, it stays
+    buffer.writeBytes(data, sizeof(data));
+    int size = buffer.getDataLen() + buffer.getFreeLen();
+    buffer.shrink();
+    CPPUNIT_ASSERT_EQUAL(size, buffer.getDataLen() + buffer.getFreeLen());
+
+    // an empty one goes back to the pool
+    buffer.drainData(buffer.getDataLen());
+    buffer.shrink();
+    CPPUNIT_ASSERT(buffer.getData() == NULL);
+    CPPUNIT_ASSERT_EQUAL(0, buffer.getFreeLen());
+
+    gExitBuffer.writeBytes(data, sizeof(data));
+}
+
+}
@@ -0,0 +1,43 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef BUFFERPOOLTF_H_
+#define BUFFERPOOLTF_H_
+#include <cppunit/extensions/HelperMacros.h>
+#include <tbnet.h>
+
+namespace tbnet {
+class BufferPoolTF : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(BufferPoolTF);
+    CPPUNIT_TEST(testCapacity);
+    CPPUNIT_TEST(testThreadCache);
+    CPPUNIT_TEST(testDepotOverflow);
+    CPPUNIT_TEST(testThreadExit);
+    CPPUNIT_TEST(testLarge);
+    CPPUNIT_TEST(testShrink);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void setUp();
+    void tearDown();
+    void testCapacity();
+    void testThreadCache();
+    void testDepotOverflow();
+    void testThreadExit();
+    void testLarge();
+    void testShrink();
+};
+}
+
+#endif /*BUFFERPOOLTF_H_*/
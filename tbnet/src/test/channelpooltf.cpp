@@ -0,0 +1,180 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "channelpooltf.h"
+#include <set>
+
+using namespace std;
+
+namespace tbnet {
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ChannelPoolTF);
+
+#define SLOT_MASK (CHANNEL_MAX_SLOTS - 1)
+
+static uint32_t getGeneration(uint32_t id) {
+    return (id >> CHANNEL_SLOT_BITS);
+}
+
+void ChannelPoolTF::setUp() {
+}
+
+void ChannelPoolTF::tearDown() {
+}
+
+void ChannelPoolTF::testEncoding() {
+    ChannelPool pool;
+    Channel *channel = pool.allocChannel();
+    CPPUNIT_ASSERT(channel != NULL);
+    uint32_t id = channel->getId();
+    CPPUNIT_ASSERT(id != 0);
+    CPPUNIT_ASSERT_EQUAL(0U, (id & 0xF0000000U));   // 28 bits on the wire
+    CPPUNIT_ASSERT(getGeneration(id) >= 1);
+    CPPUNIT_ASSERT(getGeneration(id) <= CHANNEL_MAX_GENERATION);
+    CPPUNIT_ASSERT_EQUAL(1, pool.getUseListCount());
+
+    // the id finds its channel once
+    CPPUNIT_ASSERT(pool.offerChannel(id ^ (1 << CHANNEL_SLOT_BITS)) == NULL);
+    CPPUNIT_ASSERT(pool.offerChannel(id) == channel);
+    CPPUNIT_ASSERT_EQUAL(0, pool.getUseListCount());
+    CPPUNIT_ASSERT(pool.offerChannel(id) == NULL);
+    pool.appendChannel(channel);
+
+    CPPUNIT_ASSERT(pool.offerChannel(0) == NULL);
+    CPPUNIT_ASSERT(pool.offerChannel(CHANNEL_MAX_SLOTS - 1) == NULL);   // slot never grown
+}
+
+void ChannelPoolTF::testStaleId() {
+    ChannelPool pool;
+    Channel *channel = pool.allocChannel();
+    uint32_t oldId = channel->getId();
+    CPPUNIT_ASSERT(pool.freeChannel(channel));
+    CPPUNIT_ASSERT(!pool.freeChannel(channel));
+
+    // round-robin: the slot comes back after the others were used once
+    Channel *again = NULL;
+    for (int i = 0; i < CHANNEL_CLUSTER_SIZE * 2 && again == NULL; i++) {
+        Channel *c = pool.allocChannel();
+        CPPUNIT_ASSERT(c != NULL);
+        if ((c->getId() & SLOT_MASK) == (oldId & SLOT_MASK)) {
+            again = c;
+        } else {
+            pool.freeChannel(c);
+        }
+    }
+    CPPUNIT_ASSERT(again == channel);
+    uint32_t newId = again->getId();
+    CPPUNIT_ASSERT(newId != oldId);
+    CPPUNIT_ASSERT_EQUAL(getGeneration(oldId) + 1, getGeneration(newId));
+
+    // a late reply to the first use does not match the second
+    CPPUNIT_ASSERT(pool.offerChannel(oldId) == NULL);
+    CPPUNIT_ASSERT(pool.offerChannel(newId) == again);
+    pool.appendChannel(again);
+}
+
+void ChannelPoolTF::testGenerationWrap() {
+    ChannelPool pool;
+    Channel *first = pool.allocChannel();
+    uint32_t slot = (first->getId() & SLOT_MASK);
+    uint32_t last = getGeneration(first->getId());
+    pool.freeChannel(first);
+
+    // 12 bits of generation: past 0xFFF it starts over at 1, never 0
+    int uses = 1;
+    bool wrapped = false;
+    while (uses < CHANNEL_MAX_GENERATION + 10) {
+        Channel *c = pool.allocChannel();
+        uint32_t id = c->getId();
+        pool.freeChannel(c);
+        if ((id & SLOT_MASK) != slot) {
+            continue;
+        }
+        uint32_t generation = getGeneration(id);
+        CPPUNIT_ASSERT(generation != 0);
+        if (last == CHANNEL_MAX_GENERATION) {
+            CPPUNIT_ASSERT_EQUAL(1U, generation);
+            wrapped = true;
+        } else {
+            CPPUNIT_ASSERT_EQUAL(last + 1, generation);
+        }
+        last = generation;
+        uses ++;
+    }
+    CPPUNIT_ASSERT(wrapped);
+    CPPUNIT_ASSERT_EQUAL(0, pool.getUseListCount());
+}
+
+void ChannelPoolTF::testGrow() {
+    ChannelPool pool;
+    int cnt = CHANNEL_CLUSTER_SIZE * 4 + 10;
+    std::vector<Channel*> channels;
+    std::set<uint32_t> slots;
+    for (int i = 0; i < cnt; i++) {
+        Channel *channel = pool.allocChannel();
+        CPPUNIT_ASSERT(channel != NULL);
+        channels.push_back(channel);
+        slots.insert(channel->getId() & SLOT_MASK);
+    }
+    CPPUNIT_ASSERT_EQUAL(cnt, static_cast<int>(slots.size()));
+    CPPUNIT_ASSERT_EQUAL(cnt, pool.getUseListCount());
+    CPPUNIT_ASSERT(*slots.rbegin() >= static_cast<uint32_t>(CHANNEL_CLUSTER_SIZE));
+
+    // the channels of the first segment stay where they were
+    for (int i = 0; i < cnt; i++) {
+        CPPUNIT_ASSERT(pool.offerChannel(channels[i]->getId()) == channels[i]);
+        pool.appendChannel(channels[i]);
+    }
+    CPPUNIT_ASSERT_EQUAL(0, pool.getUseListCount());
+}
+
+void ChannelPoolTF::testTimeout() {
+    ChannelPool pool;
+    int64_t tick = CHANNEL_DEADLINE_TICK;
+    int64_t base = (tbsys::CTimeUtil::getTime() / tick + 1) * tick;
+    Channel *due = pool.allocChannel();
+    Channel *later = pool.allocChannel();
+    Channel *answered = pool.allocChannel();
+    pool.setExpireTime(due, base + 5 * tick);
+    pool.setExpireTime(later, base + 50 * tick);
+    pool.setExpireTime(answered, base + 5 * tick);
+    CPPUNIT_ASSERT(pool.offerChannel(answered->getId()) == answered);
+    pool.appendChannel(answered);
+
+    CPPUNIT_ASSERT(pool.getTimeoutList(base + 4 * tick) == NULL);
+    Channel *list = pool.getTimeoutList(base + 5 * tick);
+    CPPUNIT_ASSERT(list == due);
+    CPPUNIT_ASSERT(list->getNext() == NULL);
+    CPPUNIT_ASSERT(pool.offerChannel(due->getId()) == NULL);   // timed out, a reply finds nothing
+    pool.appendFreeList(list);
+    CPPUNIT_ASSERT(pool.getNextExpireTime() <= base + 50 * tick);
+
+    // a later deadline set again before the check counts
+    pool.setExpireTime(later, base + 80 * tick);
+    CPPUNIT_ASSERT(pool.getTimeoutList(base + 60 * tick) == NULL);
+    list = pool.getTimeoutList(base + 80 * tick);
+    CPPUNIT_ASSERT(list == later);
+    pool.appendFreeList(list);
+    CPPUNIT_ASSERT_EQUAL(0, pool.getUseListCount());
+
+    // everything goes on close
+    Channel *open = pool.allocChannel();
+    pool.setExpireTime(open, base + 1000 * tick);
+    list = pool.getTimeoutList(TBNET_MAX_TIME);
+    CPPUNIT_ASSERT(list == open);
+    pool.appendFreeList(list);
+}
+
+}
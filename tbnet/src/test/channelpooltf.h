@@ -0,0 +1,41 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef CHANNELPOOLTF_H_
+#define CHANNELPOOLTF_H_
+#include <cppunit/extensions/HelperMacros.h>
+#include <tbnet.h>
+
+namespace tbnet {
+class ChannelPoolTF : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(ChannelPoolTF);
+    CPPUNIT_TEST(testEncoding);
+    CPPUNIT_TEST(testStaleId);
+    CPPUNIT_TEST(testGenerationWrap);
+    CPPUNIT_TEST(testGrow);
+    CPPUNIT_TEST(testTimeout);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void setUp();
+    void tearDown();
+    void testEncoding();
+    void testStaleId();
+    void testGenerationWrap();
+    void testGrow();
+    void testTimeout();
+};
+}
+
+#endif /*CHANNELPOOLTF_H_*/
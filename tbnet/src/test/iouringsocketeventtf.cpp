@@ -0,0 +1,149 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "iouringsocketeventtf.h"
+
+using namespace std;
+
+namespace tbnet {
+
+CPPUNIT_TEST_SUITE_REGISTRATION(IOUringSocketEventTF);
+
+#define URING_TEST_PORT 17391
+
+/*
+ * a 4 byte value
+ */
+class ValuePacket : public Packet {
+public:
+    ValuePacket() : _value(0) {}
+
+    bool encode(DataBuffer *output) {
+        output->writeInt32(_value);
+        return true;
+    }
+
+    bool decode(DataBuffer *input, PacketHeader *header) {
+        UNUSED(header);
+        _value = input->readInt32();
+        return true;
+    }
+
+    int _value;
+};
+
+class ValuePacketFactory : public IPacketFactory {
+public:
+    Packet *createPacket(int pcode) {
+        UNUSED(pcode);
+        return new ValuePacket();
+    }
+};
+
+/*
+ * replies with the value it got
+ */
+class EchoServerAdapter : public IServerAdapter {
+public:
+    IPacketHandler::HPRetCode handlePacket(Connection *connection, Packet *packet) {
+        ValuePacket *reply = new ValuePacket();
+        reply->_value = static_cast<ValuePacket*>(packet)->_value;
+        reply->setChannelId(packet->getChannelId());
+        if (!connection->postPacket(reply)) {
+            reply->free();
+        }
+        packet->free();
+        return IPacketHandler::FREE_CHANNEL;
+    }
+};
+
+/*
+ * the kernel has the io_uring features the backend needs
+ */
+static bool hasIOUring() {
+    IOUringSocketEvent socketEvent;
+    return socketEvent.init();
+}
+
+/*
+ * ping-pong calls between an io_uring client and server, the replies
+ * that came back in time
+ */
+static int pingPong(bool edgeTriggered, bool directWrite, int port, int calls) {
+    ValuePacketFactory factory;
+    DefaultPacketStreamer streamer(&factory);
+    EchoServerAdapter adapter;
+    Transport server(1, TBNET_EVENT_IO_URING);
+    Transport client(1, TBNET_EVENT_IO_URING);
+    server.setEdgeTriggered(edgeTriggered);
+    client.setEdgeTriggered(edgeTriggered);
+    server.start();
+    client.start();
+
+    char spec[32];
+    snprintf(spec, sizeof(spec), "tcp::%d", port);
+    int ok = 0;
+    if (server.listen(spec, &streamer, &adapter) != NULL) {
+        snprintf(spec, sizeof(spec), "tcp:127.0.0.1:%d", port);
+        Connection *conn = client.connect(spec, &streamer, false);
+        if (conn != NULL) {
+            conn->setDirectWrite(directWrite);
+            for (int i = 0; i < calls; i++) {
+                ValuePacket *packet = new ValuePacket();
+                packet->_value = i;
+                PacketFuture future = conn->call(packet, 1000);
+                Packet *reply = future.get(2000);
+                if (reply != NULL && reply->isRegularPacket() &&
+                        static_cast<ValuePacket*>(reply)->_value == i) {
+                    ok ++;
+                }
+            }
+        }
+    }
+
+    client.stop();
+    server.stop();
+    client.wait();
+    server.wait();
+    return ok;
+}
+
+void IOUringSocketEventTF::setUp() {
+}
+
+void IOUringSocketEventTF::tearDown() {
+}
+
+/*
+ * edge-triggered, packets queued for the loop to write: enableWrite has
+ * to kick a write event out of a poll whose mask did not change
+ */
+void IOUringSocketEventTF::testEdgeTriggeredQueued() {
+    if (!hasIOUring()) {
+        return;
+    }
+    CPPUNIT_ASSERT_EQUAL(20, pingPong(true, false, URING_TEST_PORT, 20));
+    CPPUNIT_ASSERT_EQUAL(20, pingPong(true, true, URING_TEST_PORT + 1, 20));
+}
+
+void IOUringSocketEventTF::testLevelTriggered() {
+    if (!hasIOUring()) {
+        return;
+    }
+    CPPUNIT_ASSERT_EQUAL(20, pingPong(false, false, URING_TEST_PORT + 2, 20));
+    CPPUNIT_ASSERT_EQUAL(20, pingPong(false, true, URING_TEST_PORT + 3, 20));
+}
+
+}
@@ -0,0 +1,35 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef IOURINGSOCKETEVENTTF_H_
+#define IOURINGSOCKETEVENTTF_H_
+#include <cppunit/extensions/HelperMacros.h>
+#include <tbnet.h>
+
+namespace tbnet {
+class IOUringSocketEventTF : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(IOUringSocketEventTF);
+    CPPUNIT_TEST(testEdgeTriggeredQueued);
+    CPPUNIT_TEST(testLevelTriggered);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void setUp();
+    void tearDown();
+    void testEdgeTriggeredQueued();
+    void testLevelTriggered();
+};
+}
+
+#endif /*IOURINGSOCKETEVENTTF_H_*/
@@ -0,0 +1,347 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "packetfuturetf.h"
+
+using namespace std;
+
+namespace tbnet {
+
+CPPUNIT_TEST_SUITE_REGISTRATION(PacketFutureTF);
+
+/*
+ * counts the packets freed
+ */
+class CountingPacket : public Packet {
+public:
+    CountingPacket(atomic_t *freed) : _freed(freed) {}
+
+    void free() {
+        atomic_inc(_freed);
+        delete this;
+    }
+
+    bool encode(DataBuffer *output) {
+        UNUSED(output);
+        return false;
+    }
+
+    bool decode(DataBuffer *input, PacketHeader *header) {
+        UNUSED(input);
+        UNUSED(header);
+        return false;
+    }
+
+private:
+    atomic_t *_freed;
+};
+
+/*
+ * records the args of the calls and the packet they found
+ */
+class RecordingHandler : public IFutureHandler {
+public:
+    RecordingHandler() {
+        _packet = NULL;
+    }
+
+    void handleFuture(PacketFuture *future, void *args) {
+        _packet = future->getPacket();
+        _calls.push_back(reinterpret_cast<long>(args));
+    }
+
+    Packet *_packet;
+    vector<long> _calls;
+};
+
+/*
+ * a CountingPacket for each result that is not an error, counts the calls
+ */
+class CountingContinuation : public IContinuationHandler {
+public:
+    CountingContinuation(atomic_t *freed, Packet *error = NULL) : _freed(freed), _error(error) {
+        _calls = 0;
+    }
+
+    Packet *handleContinuation(PacketFuture *future, void *args) {
+        UNUSED(future);
+        UNUSED(args);
+        _calls ++;
+        if (_error != NULL) {
+            return _error;
+        }
+        return new CountingPacket(_freed);
+    }
+
+    atomic_t *_freed;
+    Packet *_error;
+    int _calls;
+};
+
+/*
+ * completes the channel handler of a future after a while
+ */
+class LateCompleter : public tbsys::Runnable {
+public:
+    LateCompleter(IPacketHandler *handler, Packet *packet) : _handler(handler), _packet(packet) {}
+
+    void run(tbsys::CThread *thread, void *arg) {
+        UNUSED(thread);
+        UNUSED(arg);
+        usleep(50000);
+        _handler->handlePacket(_packet, NULL);
+    }
+
+private:
+    IPacketHandler *_handler;
+    Packet *_packet;
+};
+
+void PacketFutureTF::setUp() {
+}
+
+void PacketFutureTF::tearDown() {
+}
+
+void PacketFutureTF::testReady() {
+    atomic_t freed;
+    atomic_set(&freed, 0);
+    {
+        PacketFuture empty;
+        CPPUNIT_ASSERT(!empty.isValid());
+        CPPUNIT_ASSERT(!empty.isReady());
+        CPPUNIT_ASSERT(!empty.wait(10));
+        RecordingHandler handler;
+        empty.onReady(&handler);
+        CPPUNIT_ASSERT(handler._calls.empty());
+
+        Packet *packet = new CountingPacket(&freed);
+        PacketFuture future(packet);
+        CPPUNIT_ASSERT(future.isValid());
+        CPPUNIT_ASSERT(future.isReady());
+        CPPUNIT_ASSERT(future.get(10) == packet);
+
+        // copies share the result, the last one frees it
+        PacketFuture copy = future;
+        future = PacketFuture();
+        CPPUNIT_ASSERT_EQUAL(0, atomic_read(&freed));
+        CPPUNIT_ASSERT(copy.getPacket() == packet);
+    }
+    CPPUNIT_ASSERT_EQUAL(1, atomic_read(&freed));
+}
+
+void PacketFutureTF::testCompleteOnce() {
+    atomic_t freed;
+    atomic_set(&freed, 0);
+    {
+        PacketFuture future = PacketFuture::create();
+        CPPUNIT_ASSERT(future.isValid());
+        CPPUNIT_ASSERT(!future.isReady());
+        CPPUNIT_ASSERT(future.getPacket() == NULL);
+        RecordingHandler handler;
+        future.onReady(&handler, reinterpret_cast<void*>(1));
+
+        IPacketHandler *first = future.retainHandler();
+        IPacketHandler *second = future.retainHandler();
+        Packet *reply = new CountingPacket(&freed);
+        CPPUNIT_ASSERT_EQUAL(IPacketHandler::FREE_CHANNEL, first->handlePacket(reply, NULL));
+        CPPUNIT_ASSERT(future.isReady());
+        CPPUNIT_ASSERT(future.getPacket() == reply);
+        CPPUNIT_ASSERT(handler._packet == reply);
+        CPPUNIT_ASSERT_EQUAL(1, (int)handler._calls.size());
+
+        // the late result is freed, the callbacks ran already
+        second->handlePacket(new CountingPacket(&freed), NULL);
+        CPPUNIT_ASSERT_EQUAL(1, atomic_read(&freed));
+        CPPUNIT_ASSERT(future.getPacket() == reply);
+        CPPUNIT_ASSERT_EQUAL(1, (int)handler._calls.size());
+
+        // a control packet is not freed
+        future.retainHandler();
+        future.failHandler(&ControlPacket::DisconnPacket);
+        CPPUNIT_ASSERT(future.getPacket() == reply);
+    }
+    CPPUNIT_ASSERT_EQUAL(2, atomic_read(&freed));
+
+    // a post that failed completes with what it was given
+    PacketFuture failed = PacketFuture::create();
+    failed.retainHandler();
+    failed.failHandler(&ControlPacket::DisconnPacket);
+    CPPUNIT_ASSERT(failed.isReady());
+    CPPUNIT_ASSERT(failed.getPacket() == &ControlPacket::DisconnPacket);
+}
+
+void PacketFutureTF::testOnReady() {
+    PacketFuture future = PacketFuture::create();
+    IPacketHandler *channelHandler = future.retainHandler();
+    RecordingHandler handler;
+    future.onReady(&handler, reinterpret_cast<void*>(1));
+    future.onReady(NULL);
+    PacketFuture copy = future;
+    copy.onReady(&handler, reinterpret_cast<void*>(2));
+    future.onReady(&handler, reinterpret_cast<void*>(3));
+    CPPUNIT_ASSERT(handler._calls.empty());
+
+    // registered before: in order, on the completing thread
+    channelHandler->handlePacket(&ControlPacket::TimeoutPacket, NULL);
+    CPPUNIT_ASSERT_EQUAL(3, (int)handler._calls.size());
+    CPPUNIT_ASSERT_EQUAL(1L, handler._calls[0]);
+    CPPUNIT_ASSERT_EQUAL(2L, handler._calls[1]);
+    CPPUNIT_ASSERT_EQUAL(3L, handler._calls[2]);
+    CPPUNIT_ASSERT(handler._packet == &ControlPacket::TimeoutPacket);
+
+    // registered after: right away, once
+    handler._packet = NULL;
+    future.onReady(&handler, reinterpret_cast<void*>(4));
+    CPPUNIT_ASSERT_EQUAL(4, (int)handler._calls.size());
+    CPPUNIT_ASSERT_EQUAL(4L, handler._calls[3]);
+    CPPUNIT_ASSERT(handler._packet == &ControlPacket::TimeoutPacket);
+}
+
+void PacketFutureTF::testWait() {
+    PacketFuture future = PacketFuture::create();
+    CPPUNIT_ASSERT(!future.wait(20));
+    CPPUNIT_ASSERT(future.get(20) == NULL);
+
+    LateCompleter completer(future.retainHandler(), &ControlPacket::TimeoutPacket);
+    tbsys::CThread thread;
+    thread.start(&completer, NULL);
+    CPPUNIT_ASSERT(future.get() == &ControlPacket::TimeoutPacket);
+    CPPUNIT_ASSERT(future.wait(1));
+    thread.join();
+}
+
+void PacketFutureTF::testWhenAll() {
+    // nothing to wait for
+    vector<PacketFuture> futures;
+    PacketFuture all = PacketFuture::whenAll(futures);
+    CPPUNIT_ASSERT(all.isValid());
+    CPPUNIT_ASSERT(all.isReady());
+    CPPUNIT_ASSERT(all.getPacket() == NULL);
+
+    // parts ready already, empty parts skipped
+    futures.push_back(PacketFuture(&ControlPacket::TimeoutPacket));
+    futures.push_back(PacketFuture());
+    CPPUNIT_ASSERT(PacketFuture::whenAll(futures).isReady());
+
+    // ready with the last part
+    IPacketHandler *handlers[3];
+    for (int i = 0; i < 3; i++) {
+        futures.push_back(PacketFuture::create());
+        handlers[i] = futures.back().retainHandler();
+    }
+    all = PacketFuture::whenAll(futures);
+    RecordingHandler handler;
+    all.onReady(&handler);
+    handlers[2]->handlePacket(&ControlPacket::TimeoutPacket, NULL);
+    handlers[0]->handlePacket(&ControlPacket::DisconnPacket, NULL);
+    CPPUNIT_ASSERT(!all.isReady());
+    CPPUNIT_ASSERT(!all.wait(10));
+    CPPUNIT_ASSERT(handler._calls.empty());
+    handlers[1]->handlePacket(&ControlPacket::TimeoutPacket, NULL);
+    CPPUNIT_ASSERT(all.isReady());
+    CPPUNIT_ASSERT_EQUAL(1, (int)handler._calls.size());
+    CPPUNIT_ASSERT(all.getPacket() == NULL);
+
+    // the parts keep their own results
+    CPPUNIT_ASSERT(futures[2].getPacket() == &ControlPacket::DisconnPacket);
+    CPPUNIT_ASSERT(futures[4].getPacket() == &ControlPacket::TimeoutPacket);
+
+    // the whenAll future outlives the parts
+    PacketFuture part = PacketFuture::create();
+    IPacketHandler *partHandler = part.retainHandler();
+    vector<PacketFuture> one(1, part);
+    all = PacketFuture::whenAll(one);
+    one.clear();
+    part = PacketFuture();
+    partHandler->handlePacket(&ControlPacket::TimeoutPacket, NULL);
+    CPPUNIT_ASSERT(all.isReady());
+}
+
+void PacketFutureTF::testThen() {
+    atomic_t freed;
+    atomic_set(&freed, 0);
+    CountingContinuation first(&freed);
+    CountingContinuation second(&freed);
+    {
+        PacketFuture empty;
+        CPPUNIT_ASSERT(!empty.then(&first).isValid());
+
+        PacketFuture future = PacketFuture::create();
+        IPacketHandler *channelHandler = future.retainHandler();
+        PacketFuture chained = future.then(&first).then(&second);
+        CPPUNIT_ASSERT(chained.isValid());
+        CPPUNIT_ASSERT(!chained.isReady());
+        CPPUNIT_ASSERT_EQUAL(0, first._calls);
+
+        // each link runs once, on the completing thread, with a future of its own
+        Packet *reply = new CountingPacket(&freed);
+        channelHandler->handlePacket(reply, NULL);
+        CPPUNIT_ASSERT_EQUAL(1, first._calls);
+        CPPUNIT_ASSERT_EQUAL(1, second._calls);
+        CPPUNIT_ASSERT(chained.isReady());
+        CPPUNIT_ASSERT(chained.getPacket() != NULL);
+        CPPUNIT_ASSERT(chained.getPacket() != reply);
+        CPPUNIT_ASSERT(future.getPacket() == reply);
+
+        // on a ready future right away
+        PacketFuture late = future.then(&second);
+        CPPUNIT_ASSERT(late.isReady());
+        CPPUNIT_ASSERT_EQUAL(2, second._calls);
+
+        // a whenAll has no packet, not an error
+        vector<PacketFuture> parts(1, future);
+        CPPUNIT_ASSERT(PacketFuture::whenAll(parts).then(&first).getPacket() != NULL);
+        CPPUNIT_ASSERT_EQUAL(2, first._calls);
+
+        // the result of a link nobody holds goes with it: the middle one
+        // of the chain and the one after whenAll
+        CPPUNIT_ASSERT_EQUAL(2, atomic_read(&freed));
+    }
+    // and the reply, the end of the chain and the late one
+    CPPUNIT_ASSERT_EQUAL(5, atomic_read(&freed));
+}
+
+void PacketFutureTF::testThenError() {
+    atomic_t freed;
+    atomic_set(&freed, 0);
+    CountingContinuation first(&freed);
+    CountingContinuation second(&freed);
+
+    // an error skips every link
+    PacketFuture future = PacketFuture::create();
+    IPacketHandler *channelHandler = future.retainHandler();
+    PacketFuture chained = future.then(&first).then(&second);
+    channelHandler->handlePacket(&ControlPacket::TimeoutPacket, NULL);
+    CPPUNIT_ASSERT(chained.isReady());
+    CPPUNIT_ASSERT(chained.getPacket() == &ControlPacket::TimeoutPacket);
+    CPPUNIT_ASSERT_EQUAL(0, first._calls);
+    CPPUNIT_ASSERT_EQUAL(0, second._calls);
+    CPPUNIT_ASSERT(PacketFuture(&ControlPacket::DisconnPacket).then(&first).getPacket() ==
+                   &ControlPacket::DisconnPacket);
+    CPPUNIT_ASSERT_EQUAL(0, first._calls);
+
+    // a link failing ends the chain there
+    CountingContinuation failing(&freed, &ControlPacket::BadPacket);
+    PacketFuture ok(new CountingPacket(&freed));
+    chained = ok.then(&failing).then(&second);
+    CPPUNIT_ASSERT_EQUAL(1, failing._calls);
+    CPPUNIT_ASSERT_EQUAL(0, second._calls);
+    CPPUNIT_ASSERT(chained.getPacket() == &ControlPacket::BadPacket);
+    ok = PacketFuture();
+    CPPUNIT_ASSERT_EQUAL(1, atomic_read(&freed));
+}
+
+}
@@ -0,0 +1,45 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef PACKETFUTURETF_H_
+#define PACKETFUTURETF_H_
+#include <cppunit/extensions/HelperMacros.h>
+#include <tbnet.h>
+
+namespace tbnet {
+class PacketFutureTF : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(PacketFutureTF);
+    CPPUNIT_TEST(testReady);
+    CPPUNIT_TEST(testCompleteOnce);
+    CPPUNIT_TEST(testOnReady);
+    CPPUNIT_TEST(testWait);
+    CPPUNIT_TEST(testWhenAll);
+    CPPUNIT_TEST(testThen);
+    CPPUNIT_TEST(testThenError);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void setUp();
+    void tearDown();
+    void testReady();
+    void testCompleteOnce();
+    void testOnReady();
+    void testWait();
+    void testWhenAll();
+    void testThen();
+    void testThenError();
+};
+}
+
+#endif /*PACKETFUTURETF_H_*/
@@ -18,7 +18,7 @@
 
 using namespace std;
 
-namespace anet {
+namespace tbnet {
     
 CPPUNIT_TEST_SUITE_REGISTRATION(PacketQueueTF);
 
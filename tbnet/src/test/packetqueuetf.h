@@ -20,10 +20,10 @@
 #ifndef ANET__H_
 #define PACKETQUEUETF_H_
 #include <cppunit/extensions/HelperMacros.h>
-#include <anet.h>
+#include <tbnet.h>
 #include <socket.h>
 
-namespace anet {
+namespace tbnet {
 class PacketQueueTF : public CppUnit::TestFixture {
     CPPUNIT_TEST_SUITE(PacketQueueTF);
     CPPUNIT_TEST(testPush);
@@ -0,0 +1,251 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "resolvertf.h"
+
+using namespace std;
+
+namespace tbnet {
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ResolverTF);
+
+#define MISSING_HOST "missing.invalid"
+
+/*
+ * counts the lookups, which take delay us. MISSING_HOST is not found,
+ * other names go to getaddrinfo, so only numeric names and localhost
+ * are used
+ */
+class CountingResolver : public Resolver {
+public:
+    CountingResolver(int delay = 0) : _delay(delay) {
+        atomic_set(&_lookups, 0);
+    }
+
+    int getLookups() {
+        return atomic_read(&_lookups);
+    }
+
+protected:
+    bool lookup(const char *host, struct in_addr *addr) {
+        atomic_inc(&_lookups);
+        if (_delay > 0) {
+            usleep(_delay);
+        }
+        if (strcmp(host, MISSING_HOST) == 0) {
+            return false;
+        }
+        return Resolver::lookup(host, addr);
+    }
+
+private:
+    atomic_t _lookups;
+    int _delay;
+};
+
+/*
+ * resolves one name on a thread of its own
+ */
+class ResolveRunnable : public tbsys::Runnable {
+public:
+    ResolveRunnable() : _resolver(NULL), _host(NULL), _found(false) {
+        _addr.s_addr = INADDR_NONE;
+    }
+
+    void run(tbsys::CThread *thread, void *arg) {
+        UNUSED(thread);
+        UNUSED(arg);
+        _found = _resolver->resolve(_host, &_addr);
+    }
+
+    Resolver *_resolver;
+    const char *_host;
+    struct in_addr _addr;
+    bool _found;
+};
+
+/*
+ * records the results of resolveAsync
+ */
+class RecordingResolveHandler : public IResolveHandler {
+public:
+    RecordingResolveHandler() {
+        atomic_set(&_called, 0);
+        atomic_set(&_found, 0);
+        _thread = 0;
+    }
+
+    void handleResolve(const char *host, const struct in_addr *addr, void *args) {
+        UNUSED(host);
+        UNUSED(args);
+        if (addr != NULL && addr->s_addr == htonl(INADDR_LOOPBACK)) {
+            atomic_inc(&_found);
+        }
+        _thread = pthread_self();
+        atomic_inc(&_called);
+    }
+
+    /*
+     * wait up to 2s for count calls
+     */
+    bool waitCalled(int count) {
+        for (int i = 0; i < 2000 && atomic_read(&_called) < count; i++) {
+            usleep(1000);
+        }
+        return (atomic_read(&_called) == count);
+    }
+
+    atomic_t _called;
+    atomic_t _found;
+    pthread_t _thread;
+};
+
+void ResolverTF::setUp() {
+}
+
+void ResolverTF::tearDown() {
+}
+
+void ResolverTF::testCache() {
+    CountingResolver resolver;
+    struct in_addr addr;
+    addr.s_addr = INADDR_NONE;
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT_EQUAL(htonl(INADDR_LOOPBACK), addr.s_addr);
+    CPPUNIT_ASSERT_EQUAL(1, resolver.getLookups());
+
+    addr.s_addr = INADDR_NONE;
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT_EQUAL(htonl(INADDR_LOOPBACK), addr.s_addr);
+    CPPUNIT_ASSERT_EQUAL(1, resolver.getLookups());
+
+    // names are cached apart
+    CPPUNIT_ASSERT(resolver.resolve("localhost", &addr));
+    CPPUNIT_ASSERT_EQUAL(2, resolver.getLookups());
+
+    resolver.clear();
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT_EQUAL(3, resolver.getLookups());
+}
+
+void ResolverTF::testTTL() {
+    CountingResolver resolver;
+    resolver.setTTL(100, 10000);
+    struct in_addr addr;
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT_EQUAL(1, resolver.getLookups());
+
+    usleep(150000);
+    addr.s_addr = INADDR_NONE;
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT_EQUAL(htonl(INADDR_LOOPBACK), addr.s_addr);
+    CPPUNIT_ASSERT_EQUAL(2, resolver.getLookups());
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT_EQUAL(2, resolver.getLookups());
+}
+
+void ResolverTF::testNegativeTTL() {
+    CountingResolver resolver;
+    resolver.setTTL(10000, 100);
+    struct in_addr addr;
+    CPPUNIT_ASSERT(!resolver.resolve(MISSING_HOST, &addr));
+    CPPUNIT_ASSERT(!resolver.resolve(MISSING_HOST, &addr));
+    CPPUNIT_ASSERT_EQUAL(1, resolver.getLookups());
+
+    // the name found is kept for the longer TTL
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT_EQUAL(2, resolver.getLookups());
+
+    usleep(150000);
+    CPPUNIT_ASSERT(!resolver.resolve(MISSING_HOST, &addr));
+    CPPUNIT_ASSERT_EQUAL(3, resolver.getLookups());
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT_EQUAL(3, resolver.getLookups());
+}
+
+void ResolverTF::testConcurrent() {
+    const int THREADS = 8;
+    CountingResolver resolver(100000);
+    resolver.setTTL(200, 10000);
+    ResolveRunnable runnables[THREADS];
+    tbsys::CThread threads[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        runnables[i]._resolver = &resolver;
+        runnables[i]._host = "127.0.0.1";
+        threads[i].start(&runnables[i], NULL);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        threads[i].join();
+    }
+    // one lookup, the others waited for it
+    CPPUNIT_ASSERT_EQUAL(1, resolver.getLookups());
+    for (int i = 0; i < THREADS; i++) {
+        CPPUNIT_ASSERT(runnables[i]._found);
+        CPPUNIT_ASSERT_EQUAL(htonl(INADDR_LOOPBACK), runnables[i]._addr.s_addr);
+    }
+
+    // expired: one thread looks it up again, the others take the last address
+    usleep(250000);
+    for (int i = 0; i < THREADS; i++) {
+        runnables[i]._found = false;
+        threads[i].start(&runnables[i], NULL);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        threads[i].join();
+        CPPUNIT_ASSERT(runnables[i]._found);
+        CPPUNIT_ASSERT_EQUAL(htonl(INADDR_LOOPBACK), runnables[i]._addr.s_addr);
+    }
+    CPPUNIT_ASSERT_EQUAL(2, resolver.getLookups());
+}
+
+void ResolverTF::testAsync() {
+    CountingResolver resolver(50000);
+    RecordingResolveHandler handler;
+    for (int i = 0; i < 3; i++) {
+        resolver.resolveAsync("127.0.0.1", &handler, NULL);
+    }
+    // every waiter is called from the helper thread, after one lookup
+    CPPUNIT_ASSERT(handler.waitCalled(3));
+    CPPUNIT_ASSERT_EQUAL(3, atomic_read(&handler._found));
+    CPPUNIT_ASSERT_EQUAL(1, resolver.getLookups());
+    CPPUNIT_ASSERT(!pthread_equal(handler._thread, pthread_self()));
+
+    // cached: right away on this thread
+    resolver.resolveAsync("127.0.0.1", &handler, NULL);
+    CPPUNIT_ASSERT_EQUAL(4, atomic_read(&handler._called));
+    CPPUNIT_ASSERT(pthread_equal(handler._thread, pthread_self()));
+    CPPUNIT_ASSERT_EQUAL(1, resolver.getLookups());
+
+    // not found, also cached
+    RecordingResolveHandler missing;
+    resolver.resolveAsync(MISSING_HOST, &missing, NULL);
+    resolver.resolveAsync(MISSING_HOST, &missing, NULL);
+    CPPUNIT_ASSERT(missing.waitCalled(2));
+    CPPUNIT_ASSERT_EQUAL(0, atomic_read(&missing._found));
+    resolver.resolveAsync(MISSING_HOST, &missing, NULL);
+    CPPUNIT_ASSERT_EQUAL(3, atomic_read(&missing._called));
+    CPPUNIT_ASSERT_EQUAL(2, resolver.getLookups());
+
+    // a blocking caller waits for the lookup in flight
+    resolver.clear();
+    resolver.resolveAsync("127.0.0.1", &handler, NULL);
+    struct in_addr addr;
+    CPPUNIT_ASSERT(resolver.resolve("127.0.0.1", &addr));
+    CPPUNIT_ASSERT_EQUAL(3, resolver.getLookups());
+    CPPUNIT_ASSERT(handler.waitCalled(5));
+}
+
+}
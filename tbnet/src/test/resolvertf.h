@@ -0,0 +1,41 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef RESOLVERTF_H_
+#define RESOLVERTF_H_
+#include <cppunit/extensions/HelperMacros.h>
+#include <tbnet.h>
+
+namespace tbnet {
+class ResolverTF : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(ResolverTF);
+    CPPUNIT_TEST(testCache);
+    CPPUNIT_TEST(testTTL);
+    CPPUNIT_TEST(testNegativeTTL);
+    CPPUNIT_TEST(testConcurrent);
+    CPPUNIT_TEST(testAsync);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void setUp();
+    void tearDown();
+    void testCache();
+    void testTTL();
+    void testNegativeTTL();
+    void testConcurrent();
+    void testAsync();
+};
+}
+
+#endif /*RESOLVERTF_H_*/
@@ -0,0 +1,254 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "timingwheeltf.h"
+
+using namespace std;
+
+namespace tbnet {
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TimingWheelTF);
+
+#define TICK 1000
+
+/*
+ * counts the entries fired and when
+ */
+class CountingHandler : public ITimerHandler {
+public:
+    CountingHandler() {
+        atomic_set(&_fired, 0);
+        _lastTime = 0;
+    }
+
+    void handleTimer(TimerEntry *entry, int64_t now) {
+        UNUSED(entry);
+        atomic_inc(&_fired);
+        _lastTime = now;
+    }
+
+    atomic_t _fired;
+    int64_t _lastTime;
+};
+
+/*
+ * a tick boundary after the current tick of a new wheel, expire times are
+ * rounded up to a tick
+ */
+static int64_t getBase() {
+    return (tbsys::CTimeUtil::getTime() / TICK + 1) * TICK;
+}
+
+void TimingWheelTF::setUp() {
+}
+
+void TimingWheelTF::tearDown() {
+}
+
+void TimingWheelTF::testExpire() {
+    TimingWheel wheel(TICK);
+    int64_t base = getBase();
+    CountingHandler handler;
+    TimerEntry entry;
+    entry.setHandler(&handler, NULL);
+
+    CPPUNIT_ASSERT_EQUAL(TBNET_MAX_TIME, wheel.getNextExpireTime());
+    wheel.schedule(&entry, base + 5 * TICK);
+    CPPUNIT_ASSERT(entry.isScheduled());
+    CPPUNIT_ASSERT_EQUAL(1, wheel.size());
+    CPPUNIT_ASSERT(wheel.getNextExpireTime() <= base + 5 * TICK);
+
+    // never early
+    CPPUNIT_ASSERT_EQUAL(0, wheel.expire(base + 4 * TICK));
+    CPPUNIT_ASSERT_EQUAL(0, atomic_read(&handler._fired));
+    CPPUNIT_ASSERT_EQUAL(1, wheel.expire(base + 6 * TICK));
+    CPPUNIT_ASSERT_EQUAL(1, atomic_read(&handler._fired));
+    CPPUNIT_ASSERT(!entry.isScheduled());
+    CPPUNIT_ASSERT_EQUAL(0, wheel.size());
+
+    // cancelled, never fires
+    wheel.schedule(&entry, base + 10 * TICK);
+    CPPUNIT_ASSERT(wheel.cancel(&entry));
+    CPPUNIT_ASSERT(!wheel.cancel(&entry));
+    CPPUNIT_ASSERT_EQUAL(0, wheel.expire(base + 20 * TICK));
+    CPPUNIT_ASSERT_EQUAL(1, atomic_read(&handler._fired));
+
+    // due in the past, fires on the next expire
+    wheel.schedule(&entry, base);
+    CPPUNIT_ASSERT_EQUAL(1, wheel.expire(base + 21 * TICK));
+    CPPUNIT_ASSERT_EQUAL(2, atomic_read(&handler._fired));
+}
+
+void TimingWheelTF::testReschedule() {
+    TimingWheel wheel(TICK);
+    int64_t base = getBase();
+    CountingHandler handler;
+    TimerEntry entry;
+    entry.setHandler(&handler, NULL);
+
+    wheel.schedule(&entry, base + 10 * TICK);
+    CPPUNIT_ASSERT(!wheel.scheduleEarlier(&entry, base + 20 * TICK));
+    CPPUNIT_ASSERT_EQUAL(base + 10 * TICK, entry.getExpireTime());
+    CPPUNIT_ASSERT(wheel.scheduleEarlier(&entry, base + 5 * TICK));
+    CPPUNIT_ASSERT_EQUAL(1, wheel.size());
+    CPPUNIT_ASSERT_EQUAL(1, wheel.expire(base + 5 * TICK));
+
+    // moved later, not fired at the first time
+    wheel.schedule(&entry, base + 30 * TICK);
+    wheel.schedule(&entry, base + 300 * TICK);
+    CPPUNIT_ASSERT_EQUAL(1, wheel.size());
+    CPPUNIT_ASSERT_EQUAL(0, wheel.expire(base + 299 * TICK));
+    CPPUNIT_ASSERT_EQUAL(1, wheel.expire(base + 300 * TICK));
+    CPPUNIT_ASSERT_EQUAL(2, atomic_read(&handler._fired));
+}
+
+void TimingWheelTF::testCascade() {
+    TimingWheel wheel(TICK);
+    int64_t base = getBase();
+
+    // both sides of every level boundary: root 256 ticks, then 64 slots
+    // of 256, 256*64 and 256*64*64 ticks
+    int64_t deltas[] = {
+        1, 255, 256, 257, 300, 256 * 64 - 1, 256 * 64, 256 * 64 + 1, 100000,
+        256 * 64 * 64 - 1, 256 * 64 * 64, 256 * 64 * 64 + 1, 256 * 64 * 64 * 64 - 2
+    };
+    int cnt = sizeof(deltas) / sizeof(deltas[0]);
+    std::vector<CountingHandler> handlers(cnt);
+    std::vector<TimerEntry> entries(cnt);
+    for (int i = 0; i < cnt; i++) {
+        entries[i].setHandler(&handlers[i], NULL);
+        wheel.schedule(&entries[i], base + deltas[i] * TICK);
+    }
+    CPPUNIT_ASSERT_EQUAL(cnt, wheel.size());
+
+    // each entry fires at its own tick, not one tick earlier
+    for (int i = 0; i < cnt; i++) {
+        int64_t expireTime = base + deltas[i] * TICK;
+        wheel.expire(expireTime - TICK);
+        CPPUNIT_ASSERT_EQUAL(0, atomic_read(&handlers[i]._fired));
+        CPPUNIT_ASSERT(wheel.getNextExpireTime() <= expireTime);
+        wheel.expire(expireTime);
+        CPPUNIT_ASSERT_EQUAL(1, atomic_read(&handlers[i]._fired));
+        CPPUNIT_ASSERT_EQUAL(cnt - i - 1, wheel.size());
+    }
+    for (int i = 0; i < cnt; i++) {
+        CPPUNIT_ASSERT_EQUAL(1, atomic_read(&handlers[i]._fired));
+    }
+}
+
+void TimingWheelTF::testFarFuture() {
+    TimingWheel wheel(TICK);
+    int64_t base = getBase();
+    int64_t span = static_cast<int64_t>(256) * 64 * 64 * 64;   // ticks the wheel covers
+    CountingHandler handler;
+    TimerEntry entry;
+    entry.setHandler(&handler, NULL);
+    CountingHandler nearHandler;
+    TimerEntry nearEntry;
+    nearEntry.setHandler(&nearHandler, NULL);
+
+    // parked in the top level and cascaded down again until due
+    int64_t expireTime = base + (span + span / 2 + 7) * TICK;
+    wheel.schedule(&entry, expireTime);
+    wheel.schedule(&nearEntry, base + 3 * TICK);
+    CPPUNIT_ASSERT(wheel.getNextExpireTime() <= base + 3 * TICK);
+    CPPUNIT_ASSERT_EQUAL(1, wheel.expire(base + 3 * TICK));
+    CPPUNIT_ASSERT_EQUAL(1, atomic_read(&nearHandler._fired));
+
+    wheel.expire(base + span * TICK);
+    CPPUNIT_ASSERT_EQUAL(0, atomic_read(&handler._fired));
+    CPPUNIT_ASSERT(wheel.getNextExpireTime() <= expireTime);
+    wheel.expire(expireTime - TICK);
+    CPPUNIT_ASSERT_EQUAL(0, atomic_read(&handler._fired));
+    CPPUNIT_ASSERT(entry.isScheduled());
+    wheel.expire(expireTime);
+    CPPUNIT_ASSERT_EQUAL(1, atomic_read(&handler._fired));
+    CPPUNIT_ASSERT_EQUAL(expireTime, handler._lastTime);
+    CPPUNIT_ASSERT_EQUAL(0, wheel.size());
+}
+
+#define RACE_ENTRIES 2000
+#define RACE_ROUNDS 50
+
+/*
+ * cancels the entries while the test thread expires them
+ */
+class CancelRunnable : public tbsys::Runnable {
+public:
+    void run(tbsys::CThread *thread, void *arg) {
+        UNUSED(thread);
+        UNUSED(arg);
+        for (int i = 0; i < RACE_ENTRIES; i++) {
+            _cancelled[i] = _wheel->cancel(&_entries[i]);
+        }
+    }
+
+    TimingWheel *_wheel;
+    TimerEntry *_entries;
+    bool *_cancelled;
+};
+
+/*
+ * fired once per entry, whichever wins
+ */
+class RaceHandler : public ITimerHandler {
+public:
+    void handleTimer(TimerEntry *entry, int64_t now) {
+        UNUSED(now);
+        int index = static_cast<int>(reinterpret_cast<long>(entry->getArgs()));
+        __sync_fetch_and_add(&_fired[index], 1);
+    }
+
+    int *_fired;
+};
+
+void TimingWheelTF::testCancelRace() {
+    std::vector<TimerEntry> entries(RACE_ENTRIES);
+    std::vector<int> fired(RACE_ENTRIES);
+    bool cancelled[RACE_ENTRIES];
+    RaceHandler handler;
+    handler._fired = &fired[0];
+
+    for (int round = 0; round < RACE_ROUNDS; round++) {
+        TimingWheel wheel(TICK);
+        int64_t base = getBase();
+        for (int i = 0; i < RACE_ENTRIES; i++) {
+            fired[i] = 0;
+            cancelled[i] = false;
+            entries[i].setHandler(&handler, reinterpret_cast<void*>(static_cast<long>(i)));
+            wheel.schedule(&entries[i], base + (i % 300) * TICK);
+        }
+
+        CancelRunnable canceller;
+        canceller._wheel = &wheel;
+        canceller._entries = &entries[0];
+        canceller._cancelled = cancelled;
+        tbsys::CThread thread;
+        thread.start(&canceller, NULL);
+        for (int tick = 0; tick < 300; tick++) {
+            wheel.expire(base + tick * TICK);
+        }
+        thread.join();
+        wheel.expire(base + 300 * TICK);
+
+        // either cancelled or fired, exactly once
+        for (int i = 0; i < RACE_ENTRIES; i++) {
+            CPPUNIT_ASSERT_EQUAL(1, fired[i] + (cancelled[i] ? 1 : 0));
+        }
+        CPPUNIT_ASSERT_EQUAL(0, wheel.size());
+    }
+}
+
+}
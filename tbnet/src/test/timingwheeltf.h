@@ -0,0 +1,41 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TIMINGWHEELTF_H_
+#define TIMINGWHEELTF_H_
+#include <cppunit/extensions/HelperMacros.h>
+#include <tbnet.h>
+
+namespace tbnet {
+class TimingWheelTF : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE(TimingWheelTF);
+    CPPUNIT_TEST(testExpire);
+    CPPUNIT_TEST(testReschedule);
+    CPPUNIT_TEST(testCascade);
+    CPPUNIT_TEST(testFarFuture);
+    CPPUNIT_TEST(testCancelRace);
+    CPPUNIT_TEST_SUITE_END();
+public:
+    void setUp();
+    void tearDown();
+    void testExpire();
+    void testReschedule();
+    void testCascade();
+    void testFarFuture();
+    void testCancelRace();
+};
+}
+
+#endif /*TIMINGWHEELTF_H_*/
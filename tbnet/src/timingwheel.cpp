@@ -0,0 +1,249 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#include "tbnet.h"
+
+namespace tbnet {
+
+/*
+ * constructor
+ */
+TimingWheel::TimingWheel(int64_t tickTime) {
+    _tickTime = (tickTime > 0 ? tickTime : 1);
+    _currentTick = tbsys::CTimeUtil::getTime() / _tickTime;
+    _count = 0;
+    memset(_root, 0, sizeof(_root));
+    memset(_levels, 0, sizeof(_levels));
+}
+
+/*
+ * destructor
+ */
+TimingWheel::~TimingWheel() {
+}
+
+/*
+ * (re)schedule entry at expireTime
+ */
+void TimingWheel::schedule(TimerEntry *entry, int64_t expireTime) {
+    tbsys::CThreadGuard guard(&_mutex);
+    if (entry->_scheduled) {
+        unlink(entry);
+    }
+    entry->_expireTime = expireTime;
+    link(entry);
+}
+
+/*
+ * schedule entry at expireTime unless it is already due earlier, the
+ * unlocked test keeps the common case (already due earlier) lock free
+ */
+bool TimingWheel::scheduleEarlier(TimerEntry *entry, int64_t expireTime) {
+    if (entry->_scheduled && entry->_expireTime <= expireTime) {
+        return false;
+    }
+    tbsys::CThreadGuard guard(&_mutex);
+    if (entry->_scheduled) {
+        if (entry->_expireTime <= expireTime) {
+            return false;
+        }
+        unlink(entry);
+    }
+    entry->_expireTime = expireTime;
+    link(entry);
+    return true;
+}
+
+/*
+ * take entry off the wheel
+ */
+bool TimingWheel::cancel(TimerEntry *entry) {
+    tbsys::CThreadGuard guard(&_mutex);
+    if (!entry->_scheduled) {
+        return false;
+    }
+    unlink(entry);
+    return true;
+}
+
+/*
+ * fire every entry due at now
+ */
+int TimingWheel::expire(int64_t now) {
+    int64_t nowTick = now / _tickTime;
+
+    _mutex.lock();
+    while (_currentTick <= nowTick) {
+        if (_count == 0) { // nothing to walk over
+            _currentTick = nowTick + 1;
+            break;
+        }
+        int index = static_cast<int>(_currentTick & (TBNET_WHEEL_ROOT_SIZE - 1));
+        if (index == 0) {
+            for (int level = 0; level < TBNET_WHEEL_LEVELS; level++) {
+                if (!cascade(level, _currentTick)) {
+                    break;
+                }
+            }
+        }
+        TimerEntry *entry = _root[index];
+        _root[index] = NULL;
+        while (entry != NULL) {
+            TimerEntry *next = entry->_next;
+            entry->_prev = entry->_next = NULL;
+            entry->_slot = NULL;
+            entry->_scheduled = false;
+            _count --;
+            _expired.push_back(entry);
+            entry = next;
+        }
+        _currentTick ++;
+    }
+    _mutex.unlock();
+
+    // entries scheduled again in the meantime are not due any more
+    int cnt = static_cast<int>(_expired.size());
+    for (int i = 0; i < cnt; i++) {
+        TimerEntry *entry = _expired[i];
+        if (!entry->_scheduled && entry->_handler != NULL) {
+            entry->_handler->handleTimer(entry, now);
+        }
+    }
+    _expired.clear();
+    return cnt;
+}
+
+/*
+ * unschedule everything
+ */
+void TimingWheel::clear(std::vector<TimerEntry*> *entries) {
+    tbsys::CThreadGuard guard(&_mutex);
+    for (int i = 0; i < TBNET_WHEEL_ROOT_SIZE; i++) {
+        while (_root[i] != NULL) {
+            if (entries != NULL) {
+                entries->push_back(_root[i]);
+            }
+            unlink(_root[i]);
+        }
+    }
+    for (int level = 0; level < TBNET_WHEEL_LEVELS; level++) {
+        for (int i = 0; i < TBNET_WHEEL_LEVEL_SIZE; i++) {
+            while (_levels[level][i] != NULL) {
+                if (entries != NULL) {
+                    entries->push_back(_levels[level][i]);
+                }
+                unlink(_levels[level][i]);
+            }
+        }
+    }
+}
+
+/*
+ * earliest time an entry can be due
+ */
+int64_t TimingWheel::getNextExpireTime() {
+    tbsys::CThreadGuard guard(&_mutex);
+    if (_count == 0) {
+        return TBNET_MAX_TIME;
+    }
+    for (int i = 0; i < TBNET_WHEEL_ROOT_SIZE; i++) {
+        int64_t tick = _currentTick + i;
+        if (_root[tick & (TBNET_WHEEL_ROOT_SIZE - 1)] != NULL) {
+            return tick * _tickTime;
+        }
+    }
+    // the root wheel is empty, nothing is due before the next cascade
+    int64_t tick = (_currentTick + TBNET_WHEEL_ROOT_SIZE - 1) & ~static_cast<int64_t>(TBNET_WHEEL_ROOT_SIZE - 1);
+    return tick * _tickTime;
+}
+
+/*
+ * put entry into the slot of its tick, expire times are rounded up to a
+ * tick so an entry never fires early
+ */
+void TimingWheel::link(TimerEntry *entry) {
+    int64_t tick = (entry->_expireTime + _tickTime - 1) / _tickTime;
+    if (tick < _currentTick) {
+        tick = _currentTick;
+    }
+    int64_t delta = tick - _currentTick;
+
+    TimerEntry **slot = NULL;
+    if (delta < TBNET_WHEEL_ROOT_SIZE) {
+        slot = &_root[tick & (TBNET_WHEEL_ROOT_SIZE - 1)];
+    } else {
+        int shift = TBNET_WHEEL_ROOT_BITS;
+        for (int level = 0; level < TBNET_WHEEL_LEVELS; level++) {
+            int64_t span = (static_cast<int64_t>(1) << (shift + TBNET_WHEEL_LEVEL_BITS));
+            if (delta < span || level == TBNET_WHEEL_LEVELS - 1) {
+                if (delta >= span) { // beyond the wheel, park in the top level
+                    tick = _currentTick + span - 1;
+                }
+                slot = &_levels[level][(tick >> shift) & (TBNET_WHEEL_LEVEL_SIZE - 1)];
+                break;
+            }
+            shift += TBNET_WHEEL_LEVEL_BITS;
+        }
+    }
+
+    entry->_prev = NULL;
+    entry->_next = *slot;
+    if (*slot != NULL) {
+        (*slot)->_prev = entry;
+    }
+    *slot = entry;
+    entry->_slot = slot;
+    entry->_scheduled = true;
+    _count ++;
+}
+
+/*
+ * take entry out of its slot
+ */
+void TimingWheel::unlink(TimerEntry *entry) {
+    if (entry->_prev != NULL) {
+        entry->_prev->_next = entry->_next;
+    } else {
+        *entry->_slot = entry->_next;
+    }
+    if (entry->_next != NULL) {
+        entry->_next->_prev = entry->_prev;
+    }
+    entry->_prev = entry->_next = NULL;
+    entry->_slot = NULL;
+    entry->_scheduled = false;
+    _count --;
+}
+
+/*
+ * move the entries of the current slot of level one level down
+ *
+ * @return true - the level wrapped, the level above has to cascade too
+ */
+bool TimingWheel::cascade(int level, int64_t tick) {
+    int shift = TBNET_WHEEL_ROOT_BITS + level * TBNET_WHEEL_LEVEL_BITS;
+    int index = static_cast<int>((tick >> shift) & (TBNET_WHEEL_LEVEL_SIZE - 1));
+    TimerEntry *entry = _levels[level][index];
+    _levels[level][index] = NULL;
+    while (entry != NULL) {
+        TimerEntry *next = entry->_next;
+        _count --;
+        link(entry);
+        entry = next;
+    }
+    return (index == 0);
+}
+
+}
@@ -0,0 +1,179 @@
+/*
+ * (C) 2007-2010 Taobao Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *
+ * Version: $Id$
+ *
+ * Authors:
+ *   duolong <duolong@taobao.com>
+ *
+ */
+
+#ifndef TBNET_TIMINGWHEEL_H_
+#define TBNET_TIMINGWHEEL_H_
+
+namespace tbnet {
+
+#define TBNET_WHEEL_ROOT_BITS   8
+#define TBNET_WHEEL_ROOT_SIZE   (1 << TBNET_WHEEL_ROOT_BITS)
+#define TBNET_WHEEL_LEVEL_BITS  6
+#define TBNET_WHEEL_LEVEL_SIZE  (1 << TBNET_WHEEL_LEVEL_BITS)
+#define TBNET_WHEEL_LEVELS      3
+
+/*
+ * called by TimingWheel::expire when an entry is due
+ */
+class ITimerHandler {
+public:
+    virtual ~ITimerHandler() {}
+
+    /*
+     * the entry is due, it is no longer scheduled when this is called
+     *
+     * @param entry: the entry
+     * @param now: current time (us)
+     */
+    virtual void handleTimer(TimerEntry *entry, int64_t now) = 0;
+};
+
+/*
+ * one timer, embedded in the object it times out
+ */
+class TimerEntry {
+    friend class TimingWheel;
+
+public:
+    TimerEntry() {
+        _expireTime = 0;
+        _handler = NULL;
+        _args = NULL;
+        _prev = _next = NULL;
+        _slot = NULL;
+        _scheduled = false;
+    }
+
+    /*
+     * handler and argument passed back when the entry is due
+     */
+    void setHandler(ITimerHandler *handler, void *args) {
+        _handler = handler;
+        _args = args;
+    }
+
+    void *getArgs() {
+        return _args;
+    }
+
+    /*
+     * absolute expire time (us) of the last schedule
+     */
+    int64_t getExpireTime() {
+        return _expireTime;
+    }
+
+    bool isScheduled() {
+        return _scheduled;
+    }
+
+private:
+    int64_t _expireTime;        // absolute expire time (us)
+    ITimerHandler *_handler;
+    void *_args;
+    TimerEntry *_prev;          // slot list
+    TimerEntry *_next;
+    TimerEntry **_slot;         // slot the entry is linked in
+    volatile bool _scheduled;
+};
+
+/*
+ * hierarchical timing wheel: a 256 slot root wheel plus three 64 slot
+ * levels above it, so schedule, cancel and expire cost O(1) per entry
+ * whatever the number of timers. entries further away than the top
+ * level are parked in it and cascaded down again.
+ */
+class TimingWheel {
+
+public:
+    /*
+     * @param tickTime: resolution of the wheel (us)
+     */
+    TimingWheel(int64_t tickTime);
+
+    /*
+     * entries still scheduled are left alone, they are owned by the caller
+     */
+    ~TimingWheel();
+
+    /*
+     * (re)schedule entry at expireTime
+     *
+     * @param entry: the entry
+     * @param expireTime: absolute time (us)
+     */
+    void schedule(TimerEntry *entry, int64_t expireTime);
+
+    /*
+     * schedule entry at expireTime unless it is already due earlier
+     *
+     * @return true - the entry was (re)scheduled
+     */
+    bool scheduleEarlier(TimerEntry *entry, int64_t expireTime);
+
+    /*
+     * take entry off the wheel
+     *
+     * @return true - the entry was scheduled
+     */
+    bool cancel(TimerEntry *entry);
+
+    /*
+     * fire every entry due at now, the handlers run outside the lock
+     *
+     * @param now: current time (us)
+     * @return number of entries fired
+     */
+    int expire(int64_t now);
+
+    /*
+     * unschedule everything
+     *
+     * @param entries: if not NULL, gets the entries that were scheduled
+     */
+    void clear(std::vector<TimerEntry*> *entries = NULL);
+
+    /*
+     * earliest time an entry can be due, exact for the next 256 ticks and
+     * a lower bound beyond them
+     *
+     * @return absolute time (us), TBNET_MAX_TIME - nothing scheduled
+     */
+    int64_t getNextExpireTime();
+
+    /*
+     * number of scheduled entries
+     */
+    int size() {
+        return _count;
+    }
+
+private:
+    void link(TimerEntry *entry);
+    void unlink(TimerEntry *entry);
+    bool cascade(int level, int64_t tick);
+
+private:
+    TimerEntry *_root[TBNET_WHEEL_ROOT_SIZE];
+    TimerEntry *_levels[TBNET_WHEEL_LEVELS][TBNET_WHEEL_LEVEL_SIZE];
+    int64_t _tickTime;          // us per tick
+    int64_t _currentTick;       // next tick to be expired
+    int _count;
+    std::vector<TimerEntry*> _expired;   // used by expire
+    tbsys::CThreadMutex _mutex;
+};
+}
+
+#endif /*TBNET_TIMINGWHEEL_H_*/
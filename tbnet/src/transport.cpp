@@ -20,11 +20,21 @@ namespace tbnet {
 /*
  * 캯
  */
-Transport::Transport() {
+Transport::Transport(int ioThreadCount, int eventBackend) : _timeoutWheel(TBNET_TIMEOUT_WHEEL_TICK),
+    _epochs(ioThreadCount < 1 ? 1 : ioThreadCount) {
+    if (ioThreadCount < 1) {
+        ioThreadCount = 1;
+    }
+    _loopCount = ioThreadCount;
+    _loops = new EventLoop[_loopCount];
+    for (int i = 0; i < _loopCount; i++) {
+        _loops[i].createSocketEvent(eventBackend);
+    }
+    atomic_set(&_nextLoop, 0);
     _stop = false;
+    _timeoutWakeTime = 0;
     _iocListHead = _iocListTail = NULL;
     _delListHead = _delListTail = NULL;
-    _iocListChanged = false;
     _iocListCount = 0;
 }
 
@@ -33,6 +43,8 @@ Transport::Transport() {
  */
 Transport::~Transport() {
     destroy();
+    delete[] _loops;
+    _loops = NULL;
 }
 
 /*
@@ -42,7 +54,9 @@ Transport::~Transport() {
  */
 bool Transport::start() {
     signal(SIGPIPE, SIG_IGN);
-    _readWriteThread.start(this, &_socketEvent);
+    for (int i = 0; i < _loopCount; i++) {
+        _loops[i]._thread.start(this, &_loops[i]);
+    }
     _timeoutThread.start(this, NULL);
     return true;
 }
@@ -54,6 +68,12 @@ bool Transport::start() {
  */
 bool Transport::stop() {
     _stop = true;
+    for (int i = 0; i < _loopCount; i++) {
+        _loops[i]._socketEvent->wakeUp();
+    }
+    _timeoutCond.lock();
+    _timeoutCond.signal();
+    _timeoutCond.unlock();
     return true;
 }
 
@@ -63,7 +83,9 @@ bool Transport::stop() {
  * @return Ƿɹ, true - ɹ, false - ʧܡ
  */
 bool Transport::wait() {
-    _readWriteThread.join();
+    for (int i = 0; i < _loopCount; i++) {
+        _loops[i]._thread.join();
+    }
     _timeoutThread.join();
     destroy();
     return true;
@@ -72,12 +94,25 @@ bool Transport::wait() {
 /*
  * socket event ļ, run
  */
-void Transport::eventLoop(SocketEvent *socketEvent) {
+void Transport::eventLoop(EventLoop *loop) {
     IOEvent events[MAX_SOCKET_EVENTS];
+    SocketEvent *socketEvent = loop->_socketEvent;
+    int slot = static_cast<int>(loop - _loops);
+    std::vector<IOComponent*> ready;
 
     while (!_stop) {
+        // quiescent point: nothing of the previous batch is held any more,
+        // the ready list keeps its components by reference
+        _epochs.quiescent(slot);
+
+        // components that stopped at their byte budget go on without waiting
+        ready.swap(loop->_readyList);
+
         // Ƿ¼
-        int cnt = socketEvent->getEvents(1000, events, MAX_SOCKET_EVENTS);
+        int cnt = socketEvent->getEvents(loop->getWaitTime(!ready.empty()), events, MAX_SOCKET_EVENTS);
+        if (cnt > 0 && loop->_busyPoll > 0) {
+            loop->markActive(tbsys::CTimeUtil::getTime());
+        }
         if (cnt < 0) {
             TBSYS_LOG(INFO, "õevents: %s(%d)\n", strerror(errno), errno);
         }
@@ -87,26 +122,66 @@ void Transport::eventLoop(SocketEvent *socketEvent) {
             if (ioc == NULL) {
                 continue;
             }
-            if (events[i]._errorOccurred) { // 
+            if (events[i]._errorOccurred && !ioc->handleErrorEvent()) { // 
                 removeComponent(ioc);
                 continue;
             }
 
-            ioc->addRef();
-            // д
-            bool rc = true;
-            if (events[i]._readOccurred) {
-                rc = ioc->handleReadEvent();
-            }
-            if (rc && events[i]._writeOccurred) {
-                rc = ioc->handleWriteEvent();
-            }
-            ioc->subRef();
+            handleEvent(loop, ioc, events[i]._readOccurred, events[i]._writeOccurred);
+        }
 
-            if (!rc) {
-                removeComponent(ioc);
+        for (size_t i = 0; i < ready.size(); i++) {
+            IOComponent *ioc = ready[i];
+            ioc->_readyQueued = false;
+            if (ioc->isUsed() && ioc->getState() == IOComponent::TBNET_CONNECTED) {
+                handleEvent(loop, ioc, ioc->_readPending, ioc->_writePending);
             }
+            ioc->subRef();
         }
+        ready.clear();
+
+        // loop timers, then the tasks other threads handed over
+        loop->_timerWheel.expire(tbsys::CTimeUtil::getTime());
+        loop->runTasks();
+    }
+
+    // tasks queued before the stop still run, timers are dropped by destroy
+    loop->runTasks();
+    ready.swap(loop->_readyList);
+    for (size_t i = 0; i < ready.size(); i++) {
+        ready[i]->_readyQueued = false;
+        ready[i]->subRef();
+    }
+    _epochs.offline(slot);
+}
+
+/*
+ * read and write one component, queue it on the ready list of its loop
+ * when it stopped at its byte budget
+ *
+ * @param loop: event loop of the component
+ * @param ioc: IO component
+ * @param readOn: read
+ * @param writeOn: write
+ */
+void Transport::handleEvent(EventLoop *loop, IOComponent *ioc, bool readOn, bool writeOn) {
+    ioc->addRef();
+    bool rc = true;
+    if (readOn) {
+        rc = ioc->handleReadEvent();
+    }
+    if (rc && writeOn) {
+        rc = ioc->handleWriteEvent();
+    }
+    if (rc && (ioc->_readPending || ioc->_writePending) && !ioc->_readyQueued) {
+        ioc->_readyQueued = true;
+        ioc->addRef();
+        loop->_readyList.push_back(ioc);
+    }
+    ioc->subRef();
+
+    if (!rc) {
+        removeComponent(ioc);
     }
 }
 
@@ -114,86 +189,89 @@ void Transport::eventLoop(SocketEvent *socketEvent) {
  * ʱ, run
  */
 void Transport::timeoutLoop() {
-    IOComponent *mydelHead = NULL;
-    IOComponent *mydelTail = NULL;
-    std::vector<IOComponent*> mylist;
     while (!_stop) {
-        // дƵlist
-        _iocsMutex.lock();
-        if (_iocListChanged) {
-            mylist.clear();
-            IOComponent *iocList = _iocListHead;
-            while (iocList) {
-                mylist.push_back(iocList);
-                iocList = iocList->_next;
-            }
-            _iocListChanged = false;
+        // only the components that are due are touched
+        _timeoutWakeTime = 0;
+        int64_t now = tbsys::CTimeUtil::getTime();
+        _timeoutWheel.expire(now);
+
+        // sleep until the next timer is due. the wake time is published
+        // before the wheel is read, so a timer scheduled after the read sees
+        // it and signals, see scheduleTimeout
+        _timeoutCond.lock();
+        _timeoutWakeTime = now + TBNET_TIMEOUT_MAX_WAIT;
+        __sync_synchronize();
+        int64_t next = _timeoutWheel.getNextExpireTime();
+        if (next < _timeoutWakeTime) {
+            _timeoutWakeTime = next;
         }
-        // 뵽mydel
-        if (_delListHead != NULL && _delListTail != NULL) {
-            if (mydelTail == NULL) {
-                mydelHead = _delListHead;
-            } else {
-                mydelTail->_next = _delListHead;
-                _delListHead->_prev = mydelTail;
-            }
-            mydelTail = _delListTail;
-            // delList
-            _delListHead = _delListTail = NULL;
+        int64_t wait = _timeoutWakeTime - tbsys::CTimeUtil::getTime();
+        if (!_stop && wait > 0) {
+            _timeoutCond.wait(static_cast<int>((wait + 999) / 1000));
         }
-        _iocsMutex.unlock();
+        _timeoutCond.unlock();
+    }
+}
 
-        // ÿiocomponentм
-        for (int i=0; i<(int)mylist.size(); i++) {
-            IOComponent *ioc = mylist[i];
-            ioc->checkTimeout(tbsys::CTimeUtil::getTime());
+/*
+ * a component timer is due
+ *
+ * @param entry: timer entry of the component
+ * @param now: current time (us)
+ */
+void Transport::handleTimer(TimerEntry *entry, int64_t now) {
+    IOComponent *ioc = static_cast<IOComponent*>(entry->getArgs());
+
+    if (ioc->isUsed()) {
+        ioc->checkTimeout(now);
+        int64_t next = ioc->getNextTimeout(now);
+        if (next < TBNET_MAX_TIME) {
+            _timeoutWheel.scheduleEarlier(entry, next);
         }
+        return;
+    }
 
-        // ɾ
-        IOComponent *tmpList = mydelHead;
-        int64_t nowTime = tbsys::CTimeUtil::getTime() - static_cast<int64_t>(900000000); // 15min
-        while (tmpList) {
-            if (tmpList->getRef() <= 0) {
-                tmpList->subRef();
-            }
-            if (tmpList->getRef() <= -10 || tmpList->getLastUseTime() < nowTime) {
-                // ɾ
-                if (tmpList == mydelHead) { // head
-                    mydelHead = tmpList->_next;
-                }
-                if (tmpList == mydelTail) { // tail
-                    mydelTail = tmpList->_prev;
-                }
-                if (tmpList->_prev != NULL)
-                    tmpList->_prev->_next = tmpList->_next;
-                if (tmpList->_next != NULL)
-                    tmpList->_next->_prev = tmpList->_prev;
-
-                IOComponent *ioc = tmpList;
-                tmpList = tmpList->_next;
-                TBSYS_LOG(INFO, "DELIOC, %s, IOCount:%d, IOC:%p\n",
-                          ioc->getSocket()->getAddr().c_str(), _iocListCount, ioc);
-                delete ioc;
-            } else {
-                tmpList = tmpList->_next;
+    // removed: free it once no event loop can still see it and nobody holds
+    // a reference, a reference left over for 15min does not count. one
+    // handed out without a reference gets its grace time first.
+    if (ioc->_handedOut && now < ioc->_retireTime + TBNET_DELETE_GRACE) {
+        _timeoutWheel.schedule(entry, ioc->_retireTime + TBNET_DELETE_GRACE);
+        return;
+    }
+    if (!_epochs.isSafe(ioc->_retireEpoch)) {
+        // an idle loop sits in getEvents at the epoch it went in with, it is
+        // not taken offline there since the events it gets back were read
+        // offline. wake the loops still behind up to pass a quiescent point.
+        for (int i = 0; i < _loopCount; i++) {
+            if (_epochs.isBehind(i, ioc->_retireEpoch)) {
+                _loops[i]._socketEvent->wakeUp();
             }
         }
-
-        usleep(500000);  // С100ms
+        _timeoutWheel.schedule(entry, now + TBNET_DELETE_RETRY);
+        return;
+    }
+    if (ioc->getRef() > 0 && ioc->getLastUseTime() >= now - static_cast<int64_t>(TBNET_IDLE_TIMEOUT)) {
+        _timeoutWheel.schedule(entry, now + TBNET_DELETE_RETRY);
+        return;
     }
 
-    // дص_delList,destroy
     _iocsMutex.lock();
-    if (mydelHead != NULL) {
-        if (_delListTail == NULL) {
-            _delListHead = mydelHead;
-        } else {
-            _delListTail->_next = mydelHead;
-            mydelHead->_prev = _delListTail;
-        }
-        _delListTail = mydelTail;
+    if (ioc == _delListHead) { // head
+        _delListHead = ioc->_next;
     }
+    if (ioc == _delListTail) { // tail
+        _delListTail = ioc->_prev;
+    }
+    if (ioc->_prev != NULL)
+        ioc->_prev->_next = ioc->_next;
+    if (ioc->_next != NULL)
+        ioc->_next->_prev = ioc->_prev;
     _iocsMutex.unlock();
+
+    _timeoutWheel.cancel(entry);
+    TBSYS_LOG(INFO, "DELIOC, %s, IOCount:%d, IOC:%p\n",
+              ioc->getSocket()->getAddr().c_str(), _iocListCount, ioc);
+    delete ioc;
 }
 
 /*
@@ -205,12 +283,12 @@ void Transport::run(tbsys::CThread *thread, void *arg) {
     if (thread == &_timeoutThread) {
         timeoutLoop();
     } else {
-        eventLoop((SocketEvent*)arg);
+        eventLoop((EventLoop*)arg);
     }
 }
 
 /*
- * [upd|tcp]:ip:portֿargs
+ * [upd|tcp]:ip:port, unix:pathֿargs
  *
  * @param src: Դʽ
  * @param args: Ŀ
@@ -231,6 +309,10 @@ int Transport::parseAddr(char *src, char **args, int cnt) {
             }
 
             prev = src + 1;
+
+            if (index == 1 && strcasecmp(args[0], "unix") == 0) { // a path may hold ':'
+                break;
+            }
         }
 
         src ++;
@@ -244,7 +326,7 @@ int Transport::parseAddr(char *src, char **args, int cnt) {
 /*
  * һ˿ڡ
  *
- * @param spec: ʽ [upd|tcp]:ip:port
+ * @param spec: ʽ [upd|tcp]:ip:port, unix:path
  * @param streamer: ݰ˫packet
  * @param serverAdapter: ڷˣConnectionʼChannelʱصʱ
  * @return IOһָ
@@ -255,18 +337,17 @@ IOComponent *Transport::listen(const char *spec, IPacketStreamer *streamer, ISer
     strncpy(tmp, spec, 1024);
     tmp[1023] = '\0';
 
-    if (parseAddr(tmp, args, 32) != 3) {
+    int cnt = parseAddr(tmp, args, 32);
+    bool isUnix = (cnt == 2 && strcasecmp(args[0], "unix") == 0);
+    if (cnt != 3 && !isUnix) {
         return NULL;
     }
 
-    if (strcasecmp(args[0], "tcp") == 0) {
-        char *host = args[1];
-        int port = atoi(args[2]);
-
+    if (isUnix || strcasecmp(args[0], "tcp") == 0) {
         // Server Socket
         ServerSocket *socket = new ServerSocket();
 
-        if (!socket->setAddress(host, port)) {
+        if (!(isUnix ? socket->setUnixAddress(args[1]) : socket->setAddress(args[1], atoi(args[2])))) {
             delete socket;
             return NULL;
         }
@@ -289,10 +370,68 @@ IOComponent *Transport::listen(const char *spec, IPacketStreamer *streamer, ISer
     return NULL;
 }
 
+/*
+ * one SO_REUSEPORT listener per event loop, each accepting onto its own loop
+ *
+ * @param spec: tcp:ip:port
+ * @param streamer: packet streamer
+ * @param serverAdapter: server adapter
+ * @return the acceptor of the first event loop
+ */
+IOComponent *Transport::listenReusePort(const char *spec, IPacketStreamer *streamer, IServerAdapter *serverAdapter) {
+    if (_loopCount == 1) {
+        return listen(spec, streamer, serverAdapter);
+    }
+
+    char tmp[1024];
+    char *args[32];
+    strncpy(tmp, spec, 1024);
+    tmp[1023] = '\0';
+
+    if (parseAddr(tmp, args, 32) != 3 || strcasecmp(args[0], "tcp") != 0) {
+        TBSYS_LOG(ERROR, "reuseport listen needs tcp:ip:port, %s", spec);
+        return NULL;
+    }
+    char *host = args[1];
+    int port = atoi(args[2]);
+
+    // open every listener first, so a failure leaves nothing half registered
+    std::vector<TCPAcceptor*> acceptors;
+    for (int i = 0; i < _loopCount; i++) {
+        ServerSocket *socket = new ServerSocket();
+        if (!socket->setAddress(host, port)) {
+            delete socket;
+            break;
+        }
+        socket->setReusePort(true);
+
+        TCPAcceptor *acceptor = new TCPAcceptor(this, socket, streamer, serverAdapter);
+        if (!acceptor->init()) {
+            TBSYS_LOG(ERROR, "reuseport listen failed: %s, listener %d", spec, i);
+            delete acceptor;
+            break;
+        }
+        acceptor->setLoop(&_loops[i]);
+        acceptor->setLoopAffinity(true);
+        acceptors.push_back(acceptor);
+    }
+    if (static_cast<int>(acceptors.size()) != _loopCount) {
+        for (size_t i = 0; i < acceptors.size(); i++) {
+            delete acceptors[i];
+        }
+        return NULL;
+    }
+
+    for (size_t i = 0; i < acceptors.size(); i++) {
+        addComponent(acceptors[i], true, false);
+    }
+    return acceptors[0];
+}
+
 /*
  * һConnectionӵָĵַ뵽Socketļ¼С
  *
- * @param spec: ʽ [upd|tcp]:ip:port
+ * @param spec: ʽ [upd|tcp]:ip:port, unix:path
  * @param streamer: ݰ˫packet
  * @return  һConnectoionָ
  */
@@ -302,20 +441,19 @@ Connection *Transport::connect(const char *spec, IPacketStreamer *streamer, bool
     strncpy(tmp, spec, 1024);
     tmp[1023] = '\0';
 
-    if (parseAddr(tmp, args, 32) != 3) {
+    int cnt = parseAddr(tmp, args, 32);
+    bool isUnix = (cnt == 2 && strcasecmp(args[0], "unix") == 0);
+    if (cnt != 3 && !isUnix) {
         return NULL;
     }
 
-    if (strcasecmp(args[0], "tcp") == 0) {
-        char *host = args[1];
-        int port = atoi(args[2]);
-
+    if (isUnix || strcasecmp(args[0], "tcp") == 0) {
         // Socket
         Socket *socket = new Socket();
 
-        if (!socket->setAddress(host, port)) {
+        if (!(isUnix ? socket->setUnixAddress(args[1]) : socket->setAddress(args[1], atoi(args[2])))) {
             delete socket;
-            TBSYS_LOG(ERROR, "setAddress: %s:%d, %s", host, port, spec);
+            TBSYS_LOG(ERROR, "setAddress: %s", spec);
             return NULL;
         }
 
@@ -325,7 +463,7 @@ Connection *Transport::connect(const char *spec, IPacketStreamer *streamer, bool
         component->setAutoReconn(autoReconn);
         if (!component->init()) {
             delete component;
-            TBSYS_LOG(ERROR, "ʼʧTCPComponent: %s:%d", host, port);
+            TBSYS_LOG(ERROR, "ʼʧTCPComponent: %s", spec);
             return NULL;
         }
 
@@ -339,6 +477,65 @@ Connection *Transport::connect(const char *spec, IPacketStreamer *streamer, bool
     return NULL;
 }
 
+/*
+ * an asyncConnect waiting for its host name
+ */
+class Transport::ConnectRequest : public IResolveHandler {
+
+public:
+    ConnectRequest(Transport *transport, int port, IPacketStreamer *streamer, bool autoReconn,
+                   IConnectHandler *handler, void *args)
+        : _transport(transport), _port(port), _streamer(streamer), _autoReconn(autoReconn),
+          _handler(handler), _args(args) {}
+
+    /*
+     * connect to the address found, then done
+     */
+    void handleResolve(const char *host, const struct in_addr *addr, void *args) {
+        UNUSED(args);
+        Connection *conn = NULL;
+        if (addr != NULL) {
+            char ip[INET_ADDRSTRLEN];
+            char spec[64];
+            inet_ntop(AF_INET, addr, ip, sizeof(ip));
+            snprintf(spec, sizeof(spec), "tcp:%s:%d", ip, _port);
+            conn = _transport->connect(spec, _streamer, _autoReconn);
+        } else {
+            TBSYS_LOG(ERROR, "host not found: %s", host);
+        }
+        _handler->handleConnect(conn, _args);
+        delete this;
+    }
+
+private:
+    Transport *_transport;
+    int _port;
+    IPacketStreamer *_streamer;
+    bool _autoReconn;
+    IConnectHandler *_handler;
+    void *_args;
+};
+
+/*
+ * connect once the host name is resolved, off the calling thread
+ */
+void Transport::asyncConnect(const char *spec, IPacketStreamer *streamer, bool autoReconn,
+                             IConnectHandler *handler, void *args) {
+    char tmp[1024];
+    char *parts[32];
+    strncpy(tmp, spec, 1024);
+    tmp[1023] = '\0';
+
+    struct in_addr addr;
+    if (parseAddr(tmp, parts, 32) != 3 || strcasecmp(parts[0], "tcp") != 0 ||
+            parts[1][0] == '\0' || inet_aton(parts[1], &addr) != 0) { // nothing to look up
+        handler->handleConnect(connect(spec, streamer, autoReconn), args);
+        return;
+    }
+    ConnectRequest *request = new ConnectRequest(this, atoi(parts[2]), streamer, autoReconn, handler, args);
+    TBNET_RESOLVER.resolveAsync(parts[1], request, NULL);
+}
+
 /**
  * Ͽ
  */
@@ -380,18 +577,50 @@ void Transport::addComponent(IOComponent *ioc, bool readOn, bool writeOn) {
     }
     _iocListTail = ioc;
     // 
+    ioc->_timeoutEntry.setHandler(this, ioc);
     ioc->setUsed(true);
-    _iocListChanged = true;
     _iocListCount ++;
     _iocsMutex.unlock();
 
     // socketevent
     Socket *socket = ioc->getSocket();
-    ioc->setSocketEvent(&_socketEvent);
-    _socketEvent.addEvent(socket, readOn, writeOn);
-    TBSYS_LOG(INFO, "ADDIOC, SOCK: %d, %s, RON: %d, WON: %d, IOCount:%d, IOC:%p\n",
+    EventLoop *loop = ioc->_loop;
+    if (loop == NULL) {
+        loop = selectLoop();
+        ioc->_loop = loop;
+    }
+    atomic_inc(&loop->_iocCount);
+    ioc->setSocketEvent(loop->_socketEvent);
+    ioc->_writeOn = writeOn;
+    loop->_socketEvent->addEvent(socket, readOn, writeOn);
+    TBSYS_LOG(INFO, "ADDIOC, SOCK: %d, %s, RON: %d, WON: %d, IOCount:%d, IOC:%p, LOOP:%d\n",
               socket->getSocketHandle(), ioc->getSocket()->getAddr().c_str(),
-              readOn, writeOn, _iocListCount, ioc);
+              readOn, writeOn, _iocListCount, ioc, (int)(loop - _loops));
+
+    // connect deadline, server idle deadline
+    scheduleTimeout(ioc, ioc->getNextTimeout(tbsys::CTimeUtil::getTime()));
+}
+
+/*
+ * pick the least loaded event loop, starting from a round-robin cursor so
+ * that ties are spread evenly
+ */
+EventLoop *Transport::selectLoop() {
+    if (_loopCount == 1) {
+        return &_loops[0];
+    }
+    int start = (atomic_add_return(1, &_nextLoop) & 0x7fffffff) % _loopCount;
+    EventLoop *best = &_loops[start];
+    int bestCount = atomic_read(&best->_iocCount);
+    for (int i = 1; i < _loopCount && bestCount > 0; i++) {
+        EventLoop *loop = &_loops[(start + i) % _loopCount];
+        int count = atomic_read(&loop->_iocCount);
+        if (count < bestCount) {
+            best = loop;
+            bestCount = count;
+        }
+    }
+    return best;
 }
 
 /*
@@ -433,21 +662,270 @@ void Transport::removeComponent(IOComponent *ioc) {
     }
     _delListTail = ioc;
 
+    if (ioc->_loop != NULL) {
+        atomic_dec(&ioc->_loop->_iocCount);
+    }
+
     // üһ
     ioc->setUsed(false);
-    _iocListChanged = true;
     _iocListCount --;
+    // closed above, so no event loop can pick it up after this epoch
+    ioc->_retireEpoch = _epochs.retire();
+    ioc->_retireTime = tbsys::CTimeUtil::getTime();
+    _timeoutWheel.schedule(&ioc->_timeoutEntry, ioc->_retireTime + TBNET_DELETE_RETRY);
 
     TBSYS_LOG(INFO, "RMIOC, %s IOCount:%d, IOC:%p\n",
               ioc->getSocket()->getAddr().c_str(),
               _iocListCount, ioc);
 }
 
+/*
+ * make sure the timeout check of ioc runs no later than expireTime
+ *
+ * @param ioc: IO component
+ * @param expireTime: absolute time (us)
+ */
+void Transport::scheduleTimeout(IOComponent *ioc, int64_t expireTime) {
+    if (expireTime >= TBNET_MAX_TIME || !ioc->isUsed()) {
+        return;
+    }
+    if (!_timeoutWheel.scheduleEarlier(&ioc->_timeoutEntry, expireTime)) {
+        return;
+    }
+    // the timeout thread sleeps past it, wake it up
+    __sync_synchronize();
+    if (expireTime < _timeoutWakeTime) {
+        _timeoutCond.lock();
+        _timeoutCond.signal();
+        _timeoutCond.unlock();
+    }
+}
+
+/*
+ * a timer of the caller on the timeout wheel
+ */
+void Transport::scheduleTimer(TimerEntry *entry, int64_t expireTime) {
+    _timeoutWheel.schedule(entry, expireTime);
+    __sync_synchronize();
+    if (expireTime < _timeoutWakeTime) {
+        _timeoutCond.lock();
+        _timeoutCond.signal();
+        _timeoutCond.unlock();
+    }
+}
+
+/*
+ * take a timer of the caller off the wheel
+ */
+bool Transport::cancelTimer(TimerEntry *entry) {
+    return _timeoutWheel.cancel(entry);
+}
+
+/*
+ * run task on an I/O thread
+ *
+ * @param task: the task
+ * @param ioc: run on the event loop of ioc, NULL - any loop
+ */
+void Transport::runInLoop(LoopTask *task, IOComponent *ioc) {
+    assert(task != NULL);
+    EventLoop *loop = (ioc != NULL && ioc->_loop != NULL ? ioc->_loop : selectLoop());
+    loop->pushTask(task);
+}
+
+/*
+ * run task on an I/O thread once delay ms have passed
+ *
+ * @param delay: ms
+ * @param task: the task
+ * @param ioc: run on the event loop of ioc, NULL - any loop
+ */
+void Transport::runAfter(int delay, LoopTask *task, IOComponent *ioc) {
+    assert(task != NULL);
+    EventLoop *loop = (ioc != NULL && ioc->_loop != NULL ? ioc->_loop : selectLoop());
+    int64_t expireTime = tbsys::CTimeUtil::getTime() + static_cast<int64_t>(delay > 0 ? delay : 0) * 1000;
+    task->_timerEntry.setHandler(loop, task);
+    loop->_timerWheel.schedule(&task->_timerEntry, expireTime);
+    // the loop only wakes up by itself at _wakeTime
+    __sync_synchronize();
+    if (expireTime < loop->_wakeTime) {
+        loop->_socketEvent->wakeUp();
+    }
+}
+
+/*
+ * create the socket event set of the loop
+ *
+ * @param backend: TBNET_EVENT_EPOLL, TBNET_EVENT_IO_URING
+ */
+void EventLoop::createSocketEvent(int backend) {
+    if (backend == TBNET_EVENT_IO_URING) {
+        IOUringSocketEvent *socketEvent = new IOUringSocketEvent();
+        if (socketEvent->init()) {
+            _socketEvent = socketEvent;
+            return;
+        }
+        delete socketEvent;
+        TBSYS_LOG(WARN, "io_uring not available, using epoll");
+    }
+    _socketEvent = new EPollSocketEvent();
+}
+
+/*
+ * queue task, wake the loop up when the queue was empty: a non empty
+ * queue has been signalled already and is taken before the next wait
+ */
+void EventLoop::pushTask(LoopTask *task) {
+    LoopTask *head;
+    do {
+        head = _taskHead;
+        task->_next = head;
+    } while (!__sync_bool_compare_and_swap(&_taskHead, head, task));
+    // a polling loop sees the task without being woken up
+    if (head == NULL && _wakeTime != 0) {
+        _socketEvent->wakeUp();
+    }
+}
+
+/*
+ * run the queued tasks, oldest first
+ */
+void EventLoop::runTasks() {
+    if (_taskHead == NULL) {
+        return;
+    }
+    LoopTask *list = __sync_lock_test_and_set(&_taskHead, static_cast<LoopTask*>(NULL));
+    LoopTask *task = NULL;
+    while (list != NULL) {
+        LoopTask *next = list->_next;
+        list->_next = task;
+        task = list;
+        list = next;
+    }
+    while (task != NULL) {
+        LoopTask *next = task->_next;
+        task->_next = NULL;
+        task->runTask();
+        task->free();
+        task = next;
+    }
+}
+
+/*
+ * free the queued and scheduled tasks without running them
+ */
+void EventLoop::clearTasks() {
+    LoopTask *task = __sync_lock_test_and_set(&_taskHead, static_cast<LoopTask*>(NULL));
+    while (task != NULL) {
+        LoopTask *next = task->_next;
+        task->_next = NULL;
+        task->free();
+        task = next;
+    }
+    std::vector<TimerEntry*> entries;
+    _timerWheel.clear(&entries);
+    for (size_t i = 0; i < entries.size(); i++) {
+        static_cast<LoopTask*>(entries[i]->getArgs())->free();
+    }
+}
+
+/*
+ * how long getEvents may block
+ *
+ * @param busy: the ready list is not empty
+ * @return ms
+ */
+int EventLoop::getWaitTime(bool busy) {
+    // until the final value is stored every runAfter wakes the loop up
+    _wakeTime = TBNET_MAX_TIME;
+    __sync_synchronize();
+    if (busy || _taskHead != NULL) {
+        return 0;
+    }
+    int64_t now = tbsys::CTimeUtil::getTime();
+    int busyPoll = _busyPoll;
+    if (busyPoll > 0 && _avgGap < busyPoll && now - _lastActive < busyPoll) {
+        // spin: the next event is likely to come before the budget runs out
+        _wakeTime = 0;
+        __sync_synchronize();
+        return 0;
+    }
+    int64_t wait = static_cast<int64_t>(TBNET_LOOP_MAX_WAIT) * 1000;
+    int64_t next = _timerWheel.getNextExpireTime();
+    if (next - now < wait) {
+        wait = (next > now ? next - now : 0);
+    }
+    _wakeTime = now + wait;
+    __sync_synchronize();
+    return static_cast<int>((wait + 999) / 1000);
+}
+
+/*
+ * events came in at now: keep a moving average (1/8) of the gaps, a long
+ * idle time counts as a few spin budgets so one burst turns spinning on
+ * again
+ *
+ * @param now: current time (us)
+ */
+void EventLoop::markActive(int64_t now) {
+    int64_t gap = now - _lastActive;
+    int64_t maxGap = static_cast<int64_t>(_busyPoll) * 4;
+    if (gap > maxGap) {
+        gap = maxGap;
+    }
+    _avgGap += (gap - _avgGap) / 8;
+    _lastActive = now;
+}
+
+/*
+ * a runAfter task is due
+ *
+ * @param entry: timer entry of the task
+ * @param now: current time (us)
+ */
+void EventLoop::handleTimer(TimerEntry *entry, int64_t now) {
+    LoopTask *task = static_cast<LoopTask*>(entry->getArgs());
+    task->runTask();
+    task->free();
+}
+
+/*
+ * busy-poll the event loops for up to spinTime us after activity
+ */
+void Transport::setBusyPoll(int spinTime) {
+    // spinning on a single cpu only takes it away from whoever would
+    // produce the next event
+    if (spinTime > 0 && sysconf(_SC_NPROCESSORS_ONLN) <= 1) {
+        TBSYS_LOG(WARN, "busy-poll ignored, only one cpu online");
+        spinTime = 0;
+    }
+    for (int i = 0; i < _loopCount; i++) {
+        _loops[i]._busyPoll = (spinTime > 0 ? spinTime : 0);
+    }
+}
+
+/*
+ * register sockets edge-triggered
+ */
+bool Transport::setEdgeTriggered(bool on) {
+    bool ok = true;
+    for (int i = 0; i < _loopCount; i++) {
+        if (!_loops[i]._socketEvent->setEdgeTriggered(on)) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
 /*
  * ͷű
  */
 void Transport::destroy() {
     tbsys::CThreadGuard guard(&_iocsMutex);
+    _timeoutWheel.clear();
+    for (int i = 0; i < _loopCount; i++) {
+        _loops[i].clearTasks();
+    }
 
     IOComponent *list, *ioc;
     // ɾiocList
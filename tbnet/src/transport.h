@@ -20,13 +20,121 @@
 
 namespace tbnet {
 
-class Transport : public tbsys::Runnable {
+#define TBNET_TIMEOUT_WHEEL_TICK 1000       // us, resolution of the timeout wheel
+#define TBNET_TIMEOUT_MAX_WAIT 100000       // us, longest sleep of the timeout thread
+#define TBNET_DELETE_RETRY 100000           // us, recheck of a component not safe to free
+#define TBNET_DELETE_GRACE 5000000          // us, a removed component handed out without a reference is kept
+#define TBNET_LOOP_WHEEL_TICK 1000          // us, resolution of the loop timers
+#define TBNET_LOOP_MAX_WAIT 1000            // ms, longest getEvents wait
+
+// SocketEvent backend of the event loops
+#define TBNET_EVENT_EPOLL 0
+#define TBNET_EVENT_IO_URING 1              // falls back to epoll when unsupported
+
+/*
+ * result of Transport::asyncConnect
+ */
+class IConnectHandler {
+public:
+    virtual ~IConnectHandler() {}
+
+    /*
+     * @param conn: the connection, NULL - the name was not found or the
+     *              connect failed
+     * @param args: as passed to asyncConnect
+     */
+    virtual void handleConnect(Connection *conn, void *args) = 0;
+};
+
+/*
+ * one I/O event loop: its own socket event set driven by its own thread,
+ * plus the tasks and timers handed to that thread
+ */
+class EventLoop : public ITimerHandler {
+public:
+    EventLoop() : _timerWheel(TBNET_LOOP_WHEEL_TICK) {
+        _socketEvent = NULL;
+        atomic_set(&_iocCount, 0);
+        _taskHead = NULL;
+        _wakeTime = TBNET_MAX_TIME;
+        _busyPoll = 0;
+        _lastActive = 0;
+        _avgGap = 0;
+    }
+
+    ~EventLoop() {
+        delete _socketEvent;
+        _socketEvent = NULL;
+    }
+
+    /*
+     * create the socket event set of the loop
+     *
+     * @param backend: TBNET_EVENT_EPOLL, TBNET_EVENT_IO_URING
+     */
+    void createSocketEvent(int backend);
+
+    /*
+     * queue task, lock free, wakes the loop up when the queue was empty
+     */
+    void pushTask(LoopTask *task);
+
+    /*
+     * run the queued tasks in the order they were pushed
+     */
+    void runTasks();
+
+    /*
+     * free the queued and scheduled tasks without running them
+     */
+    void clearTasks();
+
+    /*
+     * how long getEvents may block: until the next loop timer, 0 when
+     * there is work left
+     *
+     * @param busy: the ready list is not empty
+     * @return ms
+     */
+    int getWaitTime(bool busy);
+
+    /*
+     * events or tasks came in at now, feeds the busy-poll rate estimate
+     */
+    void markActive(int64_t now);
+
+    /*
+     * a runAfter task is due, implements ITimerHandler
+     */
+    void handleTimer(TimerEntry *entry, int64_t now);
+
+    SocketEvent *_socketEvent;          // socket events of this loop
+    tbsys::CThread _thread;             // I/O thread of this loop
+    atomic_t _iocCount;                 // components bound to this loop
+    std::vector<IOComponent*> _readyList;   // edge-triggered: budget ran out
+    TimingWheel _timerWheel;            // runAfter
+    LoopTask * volatile _taskHead;      // runInLoop, newest first
+    volatile int64_t _wakeTime;         // the loop wakes up by itself by then (us), 0 - polling
+    volatile int _busyPoll;             // us to spin after activity, 0 - off
+    int64_t _lastActive;                // last time events came in (us)
+    int64_t _avgGap;                    // moving average of the gaps between them (us)
+};
+
+class Transport : public tbsys::Runnable, public ITimerHandler {
 
 public:
     /*
      * 캯
+     *
+     * @param ioThreadCount: number of I/O event loops, each with its own
+     *                       thread and socket event set (default 1)
+     * @param eventBackend: TBNET_EVENT_EPOLL (default) or TBNET_EVENT_IO_URING,
+     *                      io_uring batches the interest changes of a loop
+     *                      into its wait and falls back to epoll when the
+     *                      kernel lacks it. it polls for readiness only,
+     *                      reads and writes are still a syscall each
      */
-    Transport();
+    Transport(int ioThreadCount = 1, int eventBackend = TBNET_EVENT_EPOLL);
 
     /*
      * 캯
@@ -61,6 +169,15 @@ public:
      */
     void run(tbsys::CThread *thread, void *arg);
 
+    /*
+     * a component timer is due: run its timeout check, or try to delete it
+     * once it has been removed, implements ITimerHandler
+     *
+     * @param entry: timer entry of the component
+     * @param now: current time (us)
+     */
+    void handleTimer(TimerEntry *entry, int64_t now);
+
     /*
      * һ˿ڡ
      *
@@ -71,6 +188,19 @@ public:
      */
     IOComponent *listen(const char *spec, IPacketStreamer *streamer, IServerAdapter *serverAdapter);
 
+    /*
+     * listen with one SO_REUSEPORT listener per event loop, so the kernel
+     * spreads new connections over the loops; every accepted connection
+     * stays on the loop of the listener that accepted it.
+     * falls back to a single listener when there is only one loop.
+     *
+     * @param spec: tcp:ip:port
+     * @param streamer: packet streamer
+     * @param serverAdapter: server adapter
+     * @return the acceptor of the first event loop
+     */
+    IOComponent *listenReusePort(const char *spec, IPacketStreamer *streamer, IServerAdapter *serverAdapter);
+
     /*
      * һConnectionӵָĵַ뵽Socketļ¼С
      *
@@ -81,6 +211,18 @@ public:
      */
     Connection *connect(const char *spec, IPacketStreamer *streamer, bool autoReconn = false);
 
+    /*
+     * connect without looking a host name up on the calling thread: the
+     * name is resolved by the Resolver helper thread, then connected
+     * there. handler gets the connection right away when the address is
+     * numeric or cached, else on the helper thread, where it must not
+     * block.
+     *
+     * @param spec: tcp:host:port
+     */
+    void asyncConnect(const char *spec, IPacketStreamer *streamer, bool autoReconn,
+                      IConnectHandler *handler, void *args = NULL);
+
     /*
      * Ͽ
      */
@@ -101,13 +243,106 @@ public:
      * @param ioc: IO
      */
     void removeComponent(IOComponent *ioc);
+
+    /*
+     * make sure the timeout check of ioc runs no later than expireTime,
+     * cheap when it is already due earlier
+     *
+     * @param ioc: IO component, ignored unless it has been added
+     * @param expireTime: absolute time (us)
+     */
+    void scheduleTimeout(IOComponent *ioc, int64_t expireTime);
+
+    /*
+     * run the handler of entry at expireTime on the timeout thread, where
+     * it must not block. the entry belongs to the caller, it has to stay
+     * until its handler ran or cancelTimer returned true.
+     *
+     * @param entry: the entry, its handler set
+     * @param expireTime: absolute time (us)
+     */
+    void scheduleTimer(TimerEntry *entry, int64_t expireTime);
+
+    /*
+     * @return true - entry will not run, false - it ran or is running
+     */
+    bool cancelTimer(TimerEntry *entry);
     
     /**
      * ǷΪstop
      */
     bool* getStop();
 
+    /*
+     * number of I/O event loops
+     */
+    int getIOThreadCount() {
+        return _loopCount;
+    }
+
+    /*
+     * epoch reclamation of removed components. the event loops take part
+     * on their own, a PacketQueueThread once given the manager with
+     * setEpochManager. any other thread that uses an IOComponent or
+     * Connection without holding a reference registers, calls quiescent()
+     * between requests and offline() before blocking. a Connection from
+     * ConnectionManager::getConnection is kept TBNET_DELETE_GRACE after its
+     * removal for callers that do not.
+     */
+    EpochManager *getEpochManager() {
+        return &_epochs;
+    }
+
+    /*
+     * register sockets edge-triggered (EPOLLET): reads and writes go on
+     * until EAGAIN, bounded by READ_WRITE_BUDGET bytes per event, and a
+     * component whose budget ran out is served again from the ready list
+     * of its loop. set before start(), listen() and connect().
+     *
+     * @return false - a loop does not support it and stays level-triggered
+     */
+    bool setEdgeTriggered(bool on);
+
+    /*
+     * busy-poll: after activity the event loops poll without blocking for
+     * up to spinTime us before they block again, which saves the wakeup of
+     * a blocking wait on every request at the price of CPU. a loop only
+     * spins while events recently came in less than spinTime apart, so
+     * sparse traffic still blocks. ignored on a single cpu.
+     *
+     * @param spinTime: us, 0 - off (default)
+     */
+    void setBusyPoll(int spinTime);
+
+    /*
+     * run task on an I/O thread, soon and in order with the other tasks
+     * of that thread. the thread is woken up, so this is the way to hand
+     * work to the I/O thread without locking.
+     *
+     * @param task: the task, owned by the transport from now on
+     * @param ioc: run on the event loop of ioc, NULL - any loop
+     */
+    void runInLoop(LoopTask *task, IOComponent *ioc = NULL);
+
+    /*
+     * run task on an I/O thread once delay ms have passed, the timers of
+     * a loop are served by the loop itself at 1ms resolution
+     *
+     * @param delay: ms
+     * @param task: the task, owned by the transport from now on
+     * @param ioc: run on the event loop of ioc, NULL - any loop
+     */
+    void runAfter(int delay, LoopTask *task, IOComponent *ioc = NULL);
+
 private:
+    class ConnectRequest;
+
+    /*
+     * pick the event loop a new component is bound to: the least loaded
+     * one, ties broken round-robin
+     */
+    EventLoop *selectLoop();
+
     /*
      * [upd|tcp]:ip:portֿargs
      *
@@ -121,7 +356,12 @@ private:
     /*
      * socket event ļ
      */
-    void eventLoop(SocketEvent *socketEvent);
+    void eventLoop(EventLoop *loop);
+
+    /*
+     * read and write one component, requeue it when its budget ran out
+     */
+    void handleEvent(EventLoop *loop, IOComponent *ioc, bool readOn, bool writeOn);
 
     /*
      * ʱ
@@ -135,16 +375,20 @@ private:
 
 private:
 
-    EPollSocketEvent _socketEvent;      // дsocket¼
-    tbsys::CThread _readWriteThread;    // д߳
+    EventLoop *_loops;                  // I/O event loops
+    int _loopCount;                     // number of event loops
+    atomic_t _nextLoop;                 // round-robin cursor over _loops
     tbsys::CThread _timeoutThread;      // ʱ߳
     bool _stop;                         // Ƿֹͣ
+    tbsys::CThreadCond _timeoutCond;    // wakes the timeout thread up on stop or an earlier timer
+    volatile int64_t _timeoutWakeTime;  // when the timeout thread wakes up, 0 - it is awake
 
     IOComponent *_delListHead, *_delListTail;  // ȴɾIOComponent
     IOComponent *_iocListHead, *_iocListTail;   // IOComponent
-    bool _iocListChanged;                       // IOComponentϱĹ
     int _iocListCount;
     tbsys::CThreadMutex _iocsMutex;
+    TimingWheel _timeoutWheel;                  // connect/idle/delete checks
+    EpochManager _epochs;                       // reclamation of removed components
 };
 }
 
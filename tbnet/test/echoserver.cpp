@@ -96,7 +96,8 @@ public:
 
 class EchoServer {
 public:
-    EchoServer(char *spec);
+    EchoServer(char *spec, int ioThreadCount = 1, bool edgeTriggered = false,
+               int eventBackend = TBNET_EVENT_EPOLL);
     ~EchoServer();
     void start();
     void stop();
@@ -105,9 +106,11 @@ private:
     Transport _transport;
 };
 
-EchoServer::EchoServer(char *spec)
+EchoServer::EchoServer(char *spec, int ioThreadCount, bool edgeTriggered, int eventBackend)
+    : _transport(ioThreadCount, eventBackend)
 {
     _spec = strdup(spec);
+    _transport.setEdgeTriggered(edgeTriggered);
 }
 
 EchoServer::~EchoServer()
@@ -152,11 +155,14 @@ void singalHandler(int sig)
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2) {
-        printf("%s [tcp|udp]:ip:port\n", argv[0]);
+    if (argc < 2 || argc > 4) {
+        printf("%s [tcp|udp]:ip:port [iothreads] [et|uring|et,uring]\n", argv[0]);
         return EXIT_FAILURE;
     }
-    EchoServer echoServer(argv[1]);
+    const char *mode = (argc == 4 ? argv[3] : "");
+    EchoServer echoServer(argv[1], (argc >= 3 ? atoi(argv[2]) : 1),
+                          (strstr(mode, "et") != NULL),
+                          (strstr(mode, "uring") != NULL ? TBNET_EVENT_IO_URING : TBNET_EVENT_EPOLL));
     signal(SIGTERM, singalHandler);
     signal(3, singalHandler);
     signal(4, singalHandler);
@@ -174,7 +174,7 @@ void ByteBuffer::reset(uint32_t size)
  * @param p new position
  * @return old position
  */
-uint32_t ByteBuffer::position(uint32_t p) throw (ByteBuffer::out_of_range)
+uint32_t ByteBuffer::position(uint32_t p) BYTEBUFFER_THROW(ByteBuffer::out_of_range)
 {
     if (p > size_) throw out_of_range(position_, p, size_);
     uint32_t oldp = position_;
@@ -189,7 +189,7 @@ uint32_t ByteBuffer::position(uint32_t p) throw (ByteBuffer::out_of_range)
  * @size #see wrap
  */
 ByteBuffer & ByteBuffer::put(const char* src, 
-        uint32_t offset, uint32_t size) throw (ByteBuffer::out_of_range)
+        uint32_t offset, uint32_t size) BYTEBUFFER_THROW(ByteBuffer::out_of_range)
 {
     if (position_ + size  > size_) throw out_of_range(position_, size, size_);
     memcpy(data_ + position_, src + offset, size);
@@ -197,7 +197,7 @@ ByteBuffer & ByteBuffer::put(const char* src,
     return *this;
 }
 
-ByteBuffer & ByteBuffer::putString(const std::string & v) throw (ByteBuffer::out_of_range)
+ByteBuffer & ByteBuffer::putString(const std::string & v) BYTEBUFFER_THROW(ByteBuffer::out_of_range)
 {
     //return putString(v.c_str(), 0U, v.size());
     put(v.size() + 1);
@@ -205,7 +205,7 @@ ByteBuffer & ByteBuffer::putString(const std::string & v) throw (ByteBuffer::out
     return *this;
 }
 
-ByteBuffer & ByteBuffer::getString(std::string & v) throw (ByteBuffer::out_of_range)
+ByteBuffer & ByteBuffer::getString(std::string & v) BYTEBUFFER_THROW(ByteBuffer::out_of_range)
 {
     uint32_t size = 0;
     get(size);
@@ -225,7 +225,7 @@ ByteBuffer & ByteBuffer::getString(std::string & v) throw (ByteBuffer::out_of_ra
  * @param #see wrap
  */
 ByteBuffer & ByteBuffer::get(char* dst, 
-        uint32_t offset, uint32_t size) throw (ByteBuffer::out_of_range)
+        uint32_t offset, uint32_t size) BYTEBUFFER_THROW(ByteBuffer::out_of_range)
 {
     if (position_ + size > size_) throw out_of_range(position_, size, size_);
     memcpy(dst + offset, data_ + position_, size);
@@ -234,7 +234,7 @@ ByteBuffer & ByteBuffer::get(char* dst,
 }
 
 ByteBuffer & ByteBuffer::get(int index, char* dst, 
-        uint32_t offset, uint32_t size) throw (ByteBuffer::out_of_range)
+        uint32_t offset, uint32_t size) BYTEBUFFER_THROW(ByteBuffer::out_of_range)
 {
     position_ = index;
     return get(dst, offset, size);
@@ -249,7 +249,7 @@ ByteBuffer & ByteBuffer::get(int index, char* dst,
  * @param #see wrap
  */
 ByteBuffer & ByteBuffer::getRef(int index, const char* &dst, 
-        uint32_t size) throw (out_of_range)
+        uint32_t size) BYTEBUFFER_THROW(out_of_range)
 {
     //if (own_) throw out_of_range(position_, index, size);
     rawData(index, dst, size);
@@ -259,7 +259,7 @@ ByteBuffer & ByteBuffer::getRef(int index, const char* &dst,
 }
 
 const ByteBuffer & ByteBuffer::rawData(int index, const char* &dst, 
-        uint32_t size) const throw (out_of_range) 
+        uint32_t size) const BYTEBUFFER_THROW(out_of_range) 
 {
     if (index < 0) index = position_;
     if (index + size > size_) throw out_of_range(index, size, size_);
@@ -18,6 +18,13 @@
 
 #include "tbsys.h"
 
+// dynamic exception specifications are gone from C++17 on
+#if __cplusplus >= 201703L
+#define BYTEBUFFER_THROW(e)
+#else
+#define BYTEBUFFER_THROW(e) throw (e)
+#endif
+
 namespace tbutil { 
     /**
      * ByteBuffer 类似于Java里面的同名类,是一个二进制流的封装
@@ -60,40 +67,40 @@ namespace tbutil {
 
         public:
             // generic put & get
-            template <typename T> ByteBuffer & put (const T & e) throw (out_of_range);
-            template <typename T> ByteBuffer & get (T & e) throw (out_of_range);
-            template <typename T> ByteBuffer & put (const std::vector<T> & v) throw (out_of_range) ;
-            template <typename T> ByteBuffer & get (std::vector<T> & v) throw (out_of_range);
-            template <typename T> ByteBuffer & operator<<(const T &e) throw (out_of_range) { return put(e); }
-            template <typename T> ByteBuffer & operator>>(T &e) throw (out_of_range) { return get(e); }
+            template <typename T> ByteBuffer & put (const T & e) BYTEBUFFER_THROW(out_of_range);
+            template <typename T> ByteBuffer & get (T & e) BYTEBUFFER_THROW(out_of_range);
+            template <typename T> ByteBuffer & put (const std::vector<T> & v) BYTEBUFFER_THROW(out_of_range) ;
+            template <typename T> ByteBuffer & get (std::vector<T> & v) BYTEBUFFER_THROW(out_of_range);
+            template <typename T> ByteBuffer & operator<<(const T &e) BYTEBUFFER_THROW(out_of_range) { return put(e); }
+            template <typename T> ByteBuffer & operator>>(T &e) BYTEBUFFER_THROW(out_of_range) { return get(e); }
 
-            template <typename T> const ByteBuffer & peek (T & e) const throw (out_of_range);
-            template <typename T> T get () throw (out_of_range);
+            template <typename T> const ByteBuffer & peek (T & e) const BYTEBUFFER_THROW(out_of_range);
+            template <typename T> T get () BYTEBUFFER_THROW(out_of_range);
 
             // specialize put & get with std::string
-            ByteBuffer & put(const std::string & e) throw (out_of_range) { return putString(e);  }
-            ByteBuffer & get(std::string & e) throw (out_of_range) { return getString(e); }
+            ByteBuffer & put(const std::string & e) BYTEBUFFER_THROW(out_of_range) { return putString(e);  }
+            ByteBuffer & get(std::string & e) BYTEBUFFER_THROW(out_of_range) { return getString(e); }
 
 
-            ByteBuffer & putString(const std::string & v) throw (out_of_range);
-            ByteBuffer & getString(std::string & v) throw (out_of_range);
+            ByteBuffer & putString(const std::string & v) BYTEBUFFER_THROW(out_of_range);
+            ByteBuffer & getString(std::string & v) BYTEBUFFER_THROW(out_of_range);
 
             // get data_ directly..
-            virtual ByteBuffer & put(const char* src, uint32_t offset, uint32_t size)  throw (out_of_range);
-            virtual ByteBuffer & get(char* dst, uint32_t offset, uint32_t size) throw (out_of_range);
+            virtual ByteBuffer & put(const char* src, uint32_t offset, uint32_t size)  BYTEBUFFER_THROW(out_of_range);
+            virtual ByteBuffer & get(char* dst, uint32_t offset, uint32_t size) BYTEBUFFER_THROW(out_of_range);
             // relative get method, from index of data_
-            ByteBuffer & get(int index, char* dst, uint32_t offset, uint32_t size) throw (out_of_range);
+            ByteBuffer & get(int index, char* dst, uint32_t offset, uint32_t size) BYTEBUFFER_THROW(out_of_range);
             // fetch data_ directly, use them very carefully 
-            ByteBuffer & getRef(int index, const char* &dst, uint32_t size) throw (out_of_range);
-            const ByteBuffer & rawData(int index, const char* &dst, uint32_t size) const throw (out_of_range) ;
+            ByteBuffer & getRef(int index, const char* &dst, uint32_t size) BYTEBUFFER_THROW(out_of_range);
+            const ByteBuffer & rawData(int index, const char* &dst, uint32_t size) const BYTEBUFFER_THROW(out_of_range) ;
 
-            template <typename T> ByteBuffer & getRef(int index, T* &dst) throw (out_of_range);
-            template <typename T> ByteBuffer & getRef(int index, const T* &dst) throw (out_of_range);
+            template <typename T> ByteBuffer & getRef(int index, T* &dst) BYTEBUFFER_THROW(out_of_range);
+            template <typename T> ByteBuffer & getRef(int index, const T* &dst) BYTEBUFFER_THROW(out_of_range);
 
         public:
             void      reset();
             void      reset(uint32_t size);
-            uint32_t  position(uint32_t p) throw (ByteBuffer::out_of_range);
+            uint32_t  position(uint32_t p) BYTEBUFFER_THROW(ByteBuffer::out_of_range);
             uint32_t  position() const { return position_; }
             uint32_t  size() const { return size_; }
             int32_t   remaining() const { return size_ - position_; }
@@ -112,7 +119,7 @@ namespace tbutil {
 
     template <typename T>
         ByteBuffer & ByteBuffer::put(const T & e) 
-        throw (ByteBuffer::out_of_range)
+        BYTEBUFFER_THROW(ByteBuffer::out_of_range)
         {
             if (position_ + sizeof(T) > size_) 
                 throw out_of_range(position_, sizeof(T), size_);
@@ -123,7 +130,7 @@ namespace tbutil {
 
     template <typename T>
         ByteBuffer & ByteBuffer::get(T & e) 
-        throw (ByteBuffer::out_of_range)
+        BYTEBUFFER_THROW(ByteBuffer::out_of_range)
         {
             if (position_ + sizeof(T) > size_) 
                 throw out_of_range(position_, sizeof(T), size_);
@@ -134,7 +141,7 @@ namespace tbutil {
 
     template <typename T>
         T ByteBuffer::get() 
-        throw (ByteBuffer::out_of_range)
+        BYTEBUFFER_THROW(ByteBuffer::out_of_range)
         {
             T e;
             get(e);
@@ -144,7 +151,7 @@ namespace tbutil {
 
     template <typename T>
         const ByteBuffer & ByteBuffer::peek(T & e) const
-        throw (ByteBuffer::out_of_range)
+        BYTEBUFFER_THROW(ByteBuffer::out_of_range)
         {
             if (position_ + sizeof(T) > size_) 
                 throw out_of_range(position_, sizeof(T), size_);
@@ -154,7 +161,7 @@ namespace tbutil {
 
     template <typename T>
         ByteBuffer & ByteBuffer::put(const std::vector<T> & v) 
-        throw (ByteBuffer::out_of_range)
+        BYTEBUFFER_THROW(ByteBuffer::out_of_range)
         {
             put(v.size());
             for (uint32_t i = 0; i < v.size(); ++i) 
@@ -166,7 +173,7 @@ namespace tbutil {
 
     template <typename T>
         ByteBuffer & ByteBuffer::get(std::vector<T> & v) 
-        throw (ByteBuffer::out_of_range)
+        BYTEBUFFER_THROW(ByteBuffer::out_of_range)
         {
             uint32_t size;
             get(size);
@@ -181,7 +188,7 @@ namespace tbutil {
 
     template <typename T> 
         ByteBuffer & ByteBuffer::getRef(int index, T* &dst) 
-        throw (out_of_range)
+        BYTEBUFFER_THROW(out_of_range)
         {
             const char* ref = 0;
             getRef(index, ref, sizeof(T));
@@ -191,7 +198,7 @@ namespace tbutil {
 
     template <typename T> 
         ByteBuffer & ByteBuffer::getRef(int index, const T* &dst) 
-        throw (out_of_range)
+        BYTEBUFFER_THROW(out_of_range)
         {
             const char* ref = 0;
             getRef(index, ref, sizeof(T));